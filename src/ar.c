@@ -205,7 +205,7 @@ ar_glob_match (int desc UNUSED, const char *mem, int truncated UNUSED,
   if (fnmatch (state->pattern, mem, FNM_PATHNAME|FNM_PERIOD) == 0)
     {
       /* We have a match.  Add it to the chain.  */
-      struct nameseq *new = xcalloc (state->size);
+      struct nameseq *new = pool_alloc (&seq_pool);
 #ifdef VMS
       if (state->suffix)
         new->name = strcache_add(
@@ -19,6 +19,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "dep.h"
 #include "variable.h"
 #include "job.h"
+#include "os.h"
 #include "commands.h"
 #ifdef WINDOWS32
 #include <windows.h>
@@ -34,13 +35,18 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifndef HAVE_UNISTD_H
 int getpid ();
 #endif
+
+/* Recipes are never freed, so they all come from one pool.  */
+struct pool commands_pool = POOL_INIT (struct commands);
 
 
+/* Prerequisite names are in the strcache, which knows their hashes.  */
+
 static unsigned long
 dep_hash_1 (const void *key)
 {
   const struct dep *d = key;
-  return_STRING_HASH_1 (dep_name (d));
+  return strcache_hash (dep_name (d));
 }
 
 static unsigned long
@@ -181,9 +187,9 @@ set_file_variables (struct file *file)
         if (!d->need_2nd_expansion)
           {
             if (d->ignore_mtime)
-              bar_len += strlen (dep_name (d)) + 1;
+              bar_len += strcache_len (dep_name (d)) + 1;
             else
-              plus_len += strlen (dep_name (d)) + 1;
+              plus_len += strcache_len (dep_name (d)) + 1;
           }
       }
 
@@ -212,7 +218,7 @@ set_file_variables (struct file *file)
             }
           else
 #endif
-            len = strlen (c);
+            len = strcache_len (c);
 
           memcpy (cp, c, len);
           cp += len;
@@ -281,7 +287,7 @@ set_file_variables (struct file *file)
           }
         else
 #endif
-          len = strlen (c);
+          len = strcache_len (c);
 
         if (d->ignore_mtime)
           {
@@ -579,6 +585,9 @@ fatal_error_signal (int sig)
 
   remove_intermediates (1);
 
+  /* Remove a jobserver FIFO if we created one.  */
+  jobserver_clear ();
+
 #ifdef SIGQUIT
   if (sig == SIGQUIT)
     /* We don't want to send ourselves SIGQUIT, because it will
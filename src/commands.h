@@ -27,8 +27,14 @@ struct commands
     char recipe_prefix;         /* Recipe prefix for this command set.  */
     unsigned int any_recurse:1; /* Nonzero if any 'lines_flags' elt has */
                                 /* the COMMANDS_RECURSE bit set.  */
+    unsigned int expanded:1;    /* Nonzero if run at least once.  */
+    struct expansion **compiled_lines; /* Lines parsed for expanding.  */
   };
 
+extern struct pool commands_pool;
+
+#define alloc_commands()        pool_alloc (&commands_pool)
+
 /* Bits in 'lines_flags'.  */
 #define COMMANDS_RECURSE        1 /* Recurses: + or $(MAKE).  */
 #define COMMANDS_SILENT         2 /* Silent: @.  */
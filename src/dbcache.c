@@ -0,0 +1,2954 @@
+/* Cache of the makefile database for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "dep.h"
+#include "variable.h"
+#include "rule.h"
+#include "job.h"
+#include "commands.h"
+#include "debug.h"
+#include "hash.h"
+#include "dbcache.h"
+
+/* With --db-cache=FILE, make saves the database it has built by reading
+   the makefiles (and any --eval strings) in FILE.  The next time it is
+   invoked the same way, and none of the files it looked at while reading
+   has changed, it loads the database from FILE instead of reading the
+   makefiles again.
+
+   "Invoked the same way" means the same version of make, the same working
+   directory, the same arguments and the same environment: these decide
+   what the makefiles see before they are read, so they are stored in FILE
+   and compared byte for byte.  "The files it looked at" are every makefile
+   it tried to open, found or not, every file $(file <...) read, and every
+   file or directory that $(wildcard), $(realpath) or a glob in 'include'
+   examined.
+   Their modification times and sizes are stored and compared.  Anything
+   done while reading that can't be captured this way, such as running
+   $(shell ...), loading objects or writing files, stops the database from
+   being cached at all.  Messages printed while reading, for example by
+   $(info ...), are not printed again when the database is loaded.
+
+   The file starts with a magic string and the invocation, followed by the
+   length of the rest of the image, the image, and a checksum.  Numbers are
+   stored seven bits at a time, least significant first, with the top bit
+   set on every byte but the last.  Strings are stored as their length
+   plus one, followed by their bytes and a null; a null pointer is stored
+   as zero.  Lists are stored as a one before each element and a zero at
+   the end.  The image is replayed through the same functions that build
+   the database when reading makefiles (enter_file, create_pattern_rule,
+   create_pattern_var...), so it needs no pointer relocation.
+
+   Directories are handled specially: writing the cache may itself change
+   the modification time of the directory holding it, so their times are
+   taken after the cache is in place and appended to it.  */
+
+#define DBCACHE_MAGIC   "GNU make database cache 1\n"
+
+/* A growing buffer holding an image being written.  */
+
+struct image
+  {
+    char *buf;
+    size_t len;
+    size_t size;
+  };
+
+/* An image being read.  BAD is set if it turns out to be malformed.  */
+
+struct reader
+  {
+    const char *p;
+    const char *end;
+    int bad;
+  };
+
+/* A file or directory looked at while reading makefiles.  */
+
+struct noted
+  {
+    const char *name;           /* In the strcache.  */
+    int dir;                    /* Nonzero for a listed directory.  */
+  };
+
+static struct hash_table noted_files;
+
+/* Nonzero while we are noting the files we look at.  */
+static int noting = 0;
+
+/* If nonzero, why the database can't be cached.  */
+static const char *uncacheable = 0;
+
+static unsigned long
+noted_hash_1 (const void *key)
+{
+  return strcache_hash (((struct noted const *) key)->name);
+}
+
+static unsigned long
+noted_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((struct noted const *) key)->name);
+}
+
+static int
+noted_cmp (const void *x, const void *y)
+{
+  const struct noted *n1 = x;
+  const struct noted *n2 = y;
+
+  if (n1->dir != n2->dir)
+    return n1->dir - n2->dir;
+  return_STRING_COMPARE (n1->name, n2->name);
+}
+
+/* Remember that reading the makefiles looked at NAME, which is a directory
+   whose contents were listed if DIR is nonzero.  */
+
+void
+dbcache_note (const char *name, int dir)
+{
+  struct noted key;
+  struct noted **slot;
+
+  if (!noting)
+    return;
+
+  key.name = strcache_add (name);
+  key.dir = dir;
+  slot = (struct noted **) hash_find_slot (&noted_files, &key);
+  if (HASH_VACANT (*slot))
+    {
+      struct noted *n = xmalloc (sizeof (struct noted));
+      *n = key;
+      hash_insert_at (&noted_files, n, slot);
+    }
+}
+
+/* Note that something done while reading the makefiles, described by WHY,
+   can't be replayed from a cache.  */
+
+void
+dbcache_disable (const char *why)
+{
+  if (noting && !uncacheable)
+    uncacheable = why;
+}
+
+/* Writing an image.  */
+
+static void
+put_bytes (struct image *im, const void *p, size_t n)
+{
+  if (im->len + n > im->size)
+    {
+      im->size = (im->len + n) * 2;
+      im->buf = xrealloc (im->buf, im->size);
+    }
+  memcpy (im->buf + im->len, p, n);
+  im->len += n;
+}
+
+static void
+put_num (struct image *im, uintmax_t n)
+{
+  char c;
+
+  while (n >= 0x80)
+    {
+      c = (char) (0x80 | (n & 0x7f));
+      put_bytes (im, &c, 1);
+      n >>= 7;
+    }
+  c = (char) n;
+  put_bytes (im, &c, 1);
+}
+
+static void
+put_str (struct image *im, const char *s)
+{
+  size_t len;
+
+  if (s == 0)
+    {
+      put_num (im, 0);
+      return;
+    }
+
+  len = strlen (s);
+  put_num (im, len + 1);
+  put_bytes (im, s, len + 1);
+}
+
+/* Reading an image.  */
+
+static uintmax_t
+get_num (struct reader *r)
+{
+  uintmax_t n = 0;
+  unsigned int shift = 0;
+
+  while (r->p < r->end)
+    {
+      unsigned char c = *r->p++;
+
+      if (shift < sizeof (n) * CHAR_BIT)
+        n |= (uintmax_t) (c & 0x7f) << shift;
+      shift += 7;
+      if (!(c & 0x80))
+        return n;
+    }
+
+  r->bad = 1;
+  return 0;
+}
+
+/* Return the next string, which stays in the image.  */
+
+static const char *
+get_str (struct reader *r)
+{
+  uintmax_t len = get_num (r);
+  const char *s;
+
+  if (len == 0)
+    return 0;
+
+  if (len > (uintmax_t) (r->end - r->p) || r->p[len - 1] != '\0')
+    {
+      r->bad = 1;
+      r->p = r->end;
+      return "";
+    }
+
+  s = r->p;
+  r->p += len;
+  return s;
+}
+
+/* Return the next string in the strcache, or NULL.  */
+
+static const char *
+get_cached (struct reader *r)
+{
+  const char *s = get_str (r);
+  return s ? strcache_add (s) : 0;
+}
+
+static unsigned long
+checksum (const char *p, size_t len)
+{
+  unsigned long h = 2166136261UL;
+
+  while (len-- > 0)
+    h = ((h ^ (unsigned char) *p++) * 16777619UL) & 0xffffffffUL;
+
+  return h;
+}
+
+/* The invocation, which dbcache_load computes and dbcache_save stores.  */
+static struct image invocation;
+
+/* Store the invocation ARGV: what decides what the makefiles see.  */
+
+static void
+put_invocation (struct image *im, char **argv)
+{
+  extern char **environ;
+  char **pp;
+
+  put_str (im, DBCACHE_MAGIC);
+  put_str (im, version_string);
+  put_str (im, make_host);
+  put_str (im, starting_directory);
+
+  for (pp = argv; *pp != 0; ++pp)
+    {
+      put_num (im, 1);
+      put_str (im, *pp);
+    }
+  put_num (im, 0);
+
+  for (pp = environ; *pp != 0; ++pp)
+    {
+      put_num (im, 1);
+      put_str (im, *pp);
+    }
+  put_num (im, 0);
+}
+
+/* Store the state of file NAME: whether it exists, and if so its
+   modification time and size.  */
+
+static void
+put_stat (struct image *im, const char *name)
+{
+  struct stat st;
+  int r;
+
+  put_str (im, name);
+
+  EINTRLOOP (r, stat (name, &st));
+  if (r != 0)
+    {
+      put_num (im, 0);
+      return;
+    }
+
+  put_num (im, 1);
+  put_num (im, FILE_TIMESTAMP_STAT_MODTIME (name, st));
+  put_num (im, (uintmax_t) st.st_size);
+}
+
+/* Read a list stored by put_stat and return nonzero if it still matches
+   the file system.  */
+
+static int
+check_stats (struct reader *r)
+{
+  while (get_num (r))
+    {
+      const char *name = get_str (r);
+      struct stat st;
+      int exists = get_num (r) != 0;
+      int e;
+
+      EINTRLOOP (e, stat (name, &st));
+      if (!exists)
+        {
+          if (e == 0)
+            {
+              DB (DB_BASIC, (_("Database cache is stale: '%s' exists\n"),
+                             name));
+              return 0;
+            }
+          continue;
+        }
+
+      if (e != 0 || get_num (r) != FILE_TIMESTAMP_STAT_MODTIME (name, st)
+          || get_num (r) != (uintmax_t) st.st_size)
+        {
+          DB (DB_BASIC, (_("Database cache is stale: '%s' changed\n"),
+                         name));
+          return 0;
+        }
+    }
+
+  return !r->bad;
+}
+
+/* Variables.  */
+
+static void
+put_floc (struct image *im, const floc *flocp)
+{
+  put_str (im, flocp->filenm);
+  put_num (im, flocp->lineno);
+  put_num (im, flocp->offset);
+}
+
+static void
+get_floc (struct reader *r, floc *flocp)
+{
+  flocp->filenm = get_cached (r);
+  flocp->lineno = (unsigned long) get_num (r);
+  flocp->offset = (unsigned long) get_num (r);
+}
+
+static void
+put_variable (struct image *im, const struct variable *v)
+{
+  put_str (im, v->name);
+  put_str (im, v->value);
+  put_floc (im, &v->fileinfo);
+  put_num (im, (v->recursive | v->append << 1 | v->conditional << 2
+                | v->per_target << 3 | v->special << 4 | v->exportable << 5
+                | v->private_var << 6));
+  put_num (im, v->exp_count);
+  put_num (im, v->flavor);
+  put_num (im, v->origin);
+  put_num (im, v->export);
+}
+
+/* Read a variable stored by put_variable into V, whose name and value are
+   replaced.  */
+
+static void
+get_variable_fields (struct reader *r, struct variable *v)
+{
+  unsigned int bits;
+
+  uncompile_variable (v);
+  free (v->value);
+  v->value = xstrdup (get_str (r));
+  get_floc (r, &v->fileinfo);
+  bits = (unsigned int) get_num (r);
+  v->recursive = bits & 1;
+  v->append = (bits >> 1) & 1;
+  v->conditional = (bits >> 2) & 1;
+  v->per_target = (bits >> 3) & 1;
+  v->special = (bits >> 4) & 1;
+  v->exportable = (bits >> 5) & 1;
+  v->private_var = (bits >> 6) & 1;
+  v->expanding = 0;
+  v->exp_count = (unsigned int) get_num (r);
+  bits = (unsigned int) get_num (r);
+  v->flavor = (enum variable_flavor) bits;
+  bits = (unsigned int) get_num (r);
+  v->origin = (enum variable_origin) bits;
+  bits = (unsigned int) get_num (r);
+  v->export = (enum variable_export) bits;
+}
+
+/* Read a variable and define it in SET.  */
+
+static struct variable *
+get_variable (struct reader *r, struct variable_set *set)
+{
+  const char *name = get_str (r);
+  unsigned int len = strlen (name);
+  struct variable *v = lookup_variable_in_set (name, len, set);
+
+  if (v == 0)
+    v = define_variable_in_set (name, len, "", o_file, 0, set, NILF);
+  get_variable_fields (r, v);
+
+  return v;
+}
+
+static void
+put_variable_set (struct image *im, struct variable_set *set)
+{
+  struct variable **vp = (struct variable **) set->table.ht_vec;
+  struct variable **end = vp + set->table.ht_size;
+
+  for (; vp < end; ++vp)
+    if (!HASH_VACANT (*vp))
+      {
+        put_num (im, 1);
+        put_variable (im, *vp);
+      }
+  put_num (im, 0);
+}
+
+static int
+ptr_cmp (const void *a, const void *b)
+{
+  const void *x = *(const void **) a;
+  const void *y = *(const void **) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Restore the global variables.  Those defined before the makefiles were
+   read but not in the cache were undefined by the makefiles.  */
+
+static void
+get_global_variables (struct reader *r)
+{
+  struct variable_set *set = current_variable_set_list->set;
+  struct variable **seen = xmalloc (set->table.ht_fill * sizeof (*seen) + 1);
+  unsigned long nseen = 0, size = set->table.ht_fill;
+  struct variable **vp, **vec;
+
+  while (get_num (r) && !r->bad)
+    {
+      if (nseen == size)
+        seen = xrealloc (seen, (size *= 2) * sizeof (*seen) + 1);
+      seen[nseen++] = get_variable (r, set);
+    }
+
+  qsort (seen, nseen, sizeof (*seen), ptr_cmp);
+
+  vec = (struct variable **) hash_dump (&set->table, 0, 0);
+  for (vp = vec; *vp != 0; ++vp)
+    if (!bsearch (vp, seen, nseen, sizeof (*seen), ptr_cmp))
+      undefine_variable_in_set ((*vp)->name, (*vp)->length, o_automatic,
+                                set);
+
+  free (vec);
+  free (seen);
+}
+
+/* Files.  */
+
+static void
+put_deps (struct image *im, const struct dep *d)
+{
+  for (; d != 0; d = d->next)
+    {
+      put_num (im, 1);
+      put_str (im, dep_name (d));
+      put_str (im, d->stem);
+      put_num (im, d->flags);
+      put_num (im, ((d->name == 0) | d->changed << 1 | d->ignore_mtime << 2
+                    | d->staticpattern << 3 | d->need_2nd_expansion << 4));
+    }
+  put_num (im, 0);
+}
+
+static struct dep *
+get_deps (struct reader *r)
+{
+  struct dep *deps = 0;
+  struct dep **dp = &deps;
+
+  while (get_num (r) && !r->bad)
+    {
+      struct dep *d = alloc_dep ();
+      const char *name = get_str (r);
+      unsigned int bits;
+
+      d->stem = get_cached (r);
+      d->flags = (unsigned short) get_num (r);
+      bits = (unsigned int) get_num (r);
+      d->changed = (bits >> 1) & 1;
+      d->ignore_mtime = (bits >> 2) & 1;
+      d->staticpattern = (bits >> 3) & 1;
+      d->need_2nd_expansion = (bits >> 4) & 1;
+
+      if (bits & 1)
+        {
+          /* It was entered as a file.  */
+          name = strcache_add (name);
+          d->file = lookup_file (name);
+          if (d->file == 0)
+            d->file = enter_file (name);
+        }
+      else if (d->need_2nd_expansion)
+        /* snap_deps will free this one.  */
+        d->name = xstrdup (name);
+      else
+        d->name = strcache_add (name);
+
+      *dp = d;
+      dp = &d->next;
+    }
+
+  return deps;
+}
+
+static void
+put_commands (struct image *im, const struct commands *cmds)
+{
+  if (cmds == 0)
+    {
+      put_num (im, 0);
+      return;
+    }
+
+  put_num (im, 1);
+  put_floc (im, &cmds->fileinfo);
+  put_str (im, cmds->commands);
+  put_num (im, (unsigned char) cmds->recipe_prefix);
+}
+
+static struct commands *
+get_commands (struct reader *r)
+{
+  struct commands *cmds;
+
+  if (get_num (r) == 0)
+    return 0;
+
+  cmds = alloc_commands ();
+  get_floc (r, &cmds->fileinfo);
+  cmds->commands = xstrdup (get_str (r));
+  cmds->recipe_prefix = (char) get_num (r);
+
+  return cmds;
+}
+
+static void
+put_file (struct image *im, const struct file *f)
+{
+  put_str (im, f->stem);
+  put_num (im, (f->builtin | f->precious << 1 | f->loaded << 2
+                | f->low_resolution_time << 3 | f->is_target << 4
+                | f->cmd_target << 5 | f->phony << 6 | f->intermediate << 7
+                | f->secondary << 8 | f->dontcare << 9 | f->ignore_vpath << 10
+                | (f->double_colon != 0) << 11
+                | (f->last_mtime == NONEXISTENT_MTIME) << 12));
+  put_commands (im, f->cmds);
+  put_deps (im, f->deps);
+
+  if (f->variables)
+    {
+      put_num (im, 1);
+      put_variable_set (im, f->variables->set);
+    }
+  else
+    put_num (im, 0);
+}
+
+static void
+get_file (struct reader *r, struct file *f)
+{
+  unsigned int bits;
+
+  f->stem = get_cached (r);
+  bits = (unsigned int) get_num (r);
+  f->builtin = bits & 1;
+  f->precious = (bits >> 1) & 1;
+  f->loaded = (bits >> 2) & 1;
+  f->low_resolution_time = (bits >> 3) & 1;
+  f->is_target = (bits >> 4) & 1;
+  f->cmd_target = (bits >> 5) & 1;
+  f->phony = (bits >> 6) & 1;
+  f->intermediate = (bits >> 7) & 1;
+  f->secondary = (bits >> 8) & 1;
+  f->dontcare = (bits >> 9) & 1;
+  f->ignore_vpath = (bits >> 10) & 1;
+  if ((bits >> 11) & 1 && f->double_colon == 0)
+    f->double_colon = f;
+  if ((bits >> 12) & 1)
+    f->last_mtime = NONEXISTENT_MTIME;
+
+  f->cmds = get_commands (r);
+
+  /* Files defined before reading, like .SUFFIXES, already have deps.  */
+  free_dep_chain (f->deps);
+  f->deps = get_deps (r);
+
+  if (get_num (r))
+    {
+      initialize_file_variables (f, 1);
+      while (get_num (r) && !r->bad)
+        get_variable (r, f->variables->set);
+    }
+}
+
+/* Store a file and the other double-colon entries for the same name.  */
+
+static void
+put_file_chain (const void *item, void *arg)
+{
+  struct image *im = arg;
+  const struct file *f;
+
+  put_num (im, 1);
+  put_str (im, ((const struct file *) item)->name);
+  for (f = item; f != 0; f = f->prev)
+    {
+      put_num (im, 1);
+      put_file (im, f);
+    }
+  put_num (im, 0);
+}
+
+static void
+get_files (struct reader *r)
+{
+  while (get_num (r) && !r->bad)
+    {
+      const char *name = get_cached (r);
+      struct file *f = lookup_file (name);
+
+      if (f == 0)
+        f = enter_file (name);
+
+      /* The first entry is the one in the hash table; enter_file makes a
+         new entry for each further double-colon rule.  */
+      if (get_num (r))
+        do
+          get_file (r, f);
+        while (get_num (r) && !r->bad && (f = enter_file (name)) != 0);
+    }
+}
+
+/* Pattern rules, pattern-specific variables and vpath directives.  */
+
+static void
+put_rules (struct image *im)
+{
+  struct rule *rule;
+  unsigned int i;
+
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      put_num (im, 1);
+      put_num (im, rule->num);
+      for (i = 0; i < rule->num; ++i)
+        {
+          put_str (im, rule->targets[i]);
+          put_num (im, rule->suffixes[i] - 1 - rule->targets[i]);
+        }
+      put_num (im, rule->terminal);
+      put_deps (im, rule->deps);
+      put_commands (im, rule->cmds);
+    }
+  put_num (im, 0);
+}
+
+static void
+get_rules (struct reader *r)
+{
+  while (get_num (r) && !r->bad)
+    {
+      unsigned int i, n = (unsigned int) get_num (r);
+      const char **targets = xmalloc ((n + 1) * sizeof (const char *));
+      const char **percents = xmalloc ((n + 1) * sizeof (const char *));
+      struct dep *deps;
+      int terminal;
+
+      for (i = 0; i < n; ++i)
+        {
+          size_t off;
+
+          targets[i] = get_cached (r);
+          off = (size_t) get_num (r);
+          if (targets[i] == 0 || off >= strlen (targets[i]))
+            {
+              r->bad = 1;
+              return;
+            }
+          percents[i] = targets[i] + off;
+        }
+
+      terminal = (int) get_num (r);
+      deps = get_deps (r);
+      create_pattern_rule (targets, percents, n, terminal, deps,
+                           get_commands (r), 1);
+    }
+}
+
+static void
+put_pattern_vars (struct image *im)
+{
+  struct pattern_var *p;
+
+  for (p = pattern_var_list (); p != 0; p = p->next)
+    {
+      put_num (im, 1);
+      put_str (im, p->target);
+      put_num (im, p->suffix - 1 - p->target);
+      put_variable (im, &p->variable);
+    }
+  put_num (im, 0);
+}
+
+static void
+get_pattern_vars (struct reader *r)
+{
+  while (get_num (r) && !r->bad)
+    {
+      const char *target = get_cached (r);
+      size_t off = (size_t) get_num (r);
+      struct pattern_var *p;
+      const char *name;
+
+      if (target == 0 || off >= strlen (target))
+        {
+          r->bad = 1;
+          return;
+        }
+
+      p = create_pattern_var (target, target + off);
+      name = get_str (r);
+      p->variable.name = xstrdup (name);
+      p->variable.length = strlen (name);
+      get_variable_fields (r, &p->variable);
+    }
+}
+
+static void
+put_vpath (const char *pattern, const char **searchpath, void *arg)
+{
+  struct image *im = arg;
+
+  put_num (im, 1);
+  put_str (im, pattern);
+  for (; *searchpath != 0; ++searchpath)
+    {
+      put_num (im, 1);
+      put_str (im, *searchpath);
+    }
+  put_num (im, 0);
+}
+
+static void
+get_vpaths (struct reader *r)
+{
+  struct vp
+    {
+      struct vp *next;
+      char *pattern;
+      char *dirs;
+    } *vps = 0, *vp;
+
+  /* The list was stored from the newest entry to the oldest; each new
+     entry goes on the front, so define them in the opposite order.  */
+  while (get_num (r) && !r->bad)
+    {
+      size_t len = 0;
+
+      vp = xmalloc (sizeof (struct vp));
+      vp->pattern = xstrdup (get_str (r));
+      vp->dirs = xstrdup ("");
+      while (get_num (r) && !r->bad)
+        {
+          const char *dir = get_str (r);
+          size_t l = strlen (dir);
+
+          vp->dirs = xrealloc (vp->dirs, len + l + 2);
+          if (len > 0)
+            vp->dirs[len++] = PATH_SEPARATOR_CHAR;
+          memcpy (vp->dirs + len, dir, l + 1);
+          len += l;
+        }
+      vp->next = vps;
+      vps = vp;
+    }
+
+  while (vps)
+    {
+      vp = vps;
+      vps = vp->next;
+      if (!r->bad)
+        construct_vpath_list (vp->pattern, vp->dirs);
+      free (vp->pattern);
+      free (vp->dirs);
+      free (vp);
+    }
+}
+
+/* Build the image of the database, with the list of READ_FILES.  */
+
+static void
+put_database (struct image *im, const char **makefiles,
+              struct goaldep *read_files)
+{
+  struct goaldep *d;
+
+  put_num (im, posix_pedantic);
+  put_num (im, second_expansion);
+  put_num (im, one_shell);
+  put_num (im, export_all_variables);
+
+  put_variable_set (im, current_variable_set_list->set);
+  map_files (put_file_chain, im);
+  put_num (im, 0);
+  put_rules (im);
+  put_pattern_vars (im);
+  map_vpaths (put_vpath, im);
+  put_num (im, 0);
+
+  for (d = read_files; d != 0; d = d->next)
+    {
+      put_num (im, 1);
+      put_str (im, d->file->name);
+      put_num (im, d->flags);
+      put_num (im, d->error);
+      put_floc (im, &d->floc);
+    }
+  put_num (im, 0);
+
+  /* The makefiles from -f, as read_all_makefiles rewrote them.  */
+  if (makefiles)
+    for (; *makefiles != 0; ++makefiles)
+      put_str (im, *makefiles);
+}
+
+/* Replay the database from an image and store the list of makefiles read
+   in *READ_FILESP.  Return zero if the image is malformed.  */
+
+static int
+get_database (struct reader *r, const char **makefiles,
+              struct goaldep **read_filesp)
+{
+  struct goaldep *read_files = 0;
+  struct goaldep **dp = &read_files;
+  struct variable *v;
+
+  posix_pedantic = (int) get_num (r);
+  second_expansion = (int) get_num (r);
+  one_shell = (int) get_num (r);
+  export_all_variables = (int) get_num (r);
+
+  get_global_variables (r);
+  get_files (r);
+  get_rules (r);
+  get_pattern_vars (r);
+  get_vpaths (r);
+
+  while (get_num (r) && !r->bad)
+    {
+      struct goaldep *d = alloc_goaldep ();
+      const char *name = get_cached (r);
+
+      d->file = lookup_file (name);
+      if (d->file == 0)
+        d->file = enter_file (name);
+      d->flags = (unsigned short) get_num (r);
+      d->error = (unsigned short) get_num (r);
+      get_floc (r, &d->floc);
+      *dp = d;
+      dp = &d->next;
+    }
+
+  if (makefiles)
+    for (; *makefiles != 0; ++makefiles)
+      *makefiles = get_cached (r);
+
+  /* The recipe prefix takes effect as it is set.  */
+  v = lookup_variable (STRING_SIZE_TUPLE (RECIPEPREFIX_NAME));
+  if (v != 0)
+    cmd_prefix = v->value[0] == '\0' ? RECIPEPREFIX_DEFAULT : v->value[0];
+
+  *read_filesp = read_files;
+  return !r->bad;
+}
+
+/* Read the whole of file NAME into a new buffer.  Return it and store
+   its length in *LENP, or return NULL if it can't be read.  */
+
+static char *
+read_whole_file (const char *name, size_t *lenp)
+{
+  FILE *fp;
+  char *buf;
+  size_t len = 0, size = 65536, n;
+
+  ENULLLOOP (fp, _fopen (name, "rb"));
+  if (fp == 0)
+    return 0;
+
+  buf = xmalloc (size);
+  while ((n = _fread (buf + len, 1, size - len, fp)) > 0)
+    {
+      len += n;
+      if (len == size)
+        buf = xrealloc (buf, size *= 2);
+    }
+
+  _fclose (fp);
+  *lenp = len;
+  return buf;
+}
+
+/* If the database cache NAME was written by an invocation like this one,
+   with arguments ARGV, and nothing it depends on has changed, load the
+   database from it, store the list of makefiles that were read in
+   *READ_FILESP and return nonzero; MAKEFILES is updated as
+   read_all_makefiles would.  Otherwise return zero and start noting what
+   reading the makefiles looks at, for dbcache_save.  */
+
+int
+dbcache_load (const char *name, char **argv, const char **makefiles,
+              struct goaldep **read_filesp)
+{
+  struct reader r;
+  size_t len, body;
+  char *buf;
+  int loaded = 0;
+
+  hash_init (&noted_files, 1024, noted_hash_1, noted_hash_2, noted_cmp);
+  noting = 1;
+  put_invocation (&invocation, argv);
+
+  buf = read_whole_file (name, &len);
+  if (buf == 0)
+    {
+      DB (DB_BASIC, (_("No database cache '%s'\n"), name));
+      return 0;
+    }
+
+  r.p = buf;
+  r.end = buf + len;
+  r.bad = 0;
+
+  if (len < invocation.len
+      || memcmp (buf, invocation.buf, invocation.len) != 0)
+    {
+      DB (DB_BASIC, (_("Database cache '%s' is for a different invocation\n"),
+                     name));
+      goto done;
+    }
+  r.p += invocation.len;
+
+  /* Check the image is complete before looking at the file system.  */
+  body = (size_t) get_num (&r);
+  if (r.bad || body > (size_t) (r.end - r.p))
+    goto bad;
+  {
+    struct reader c;
+    c.p = r.p + body;
+    c.end = r.end;
+    c.bad = 0;
+    if (get_num (&c) != checksum (r.p, body) || c.bad
+        || !check_stats (&c) || c.p != c.end)
+      {
+        if (c.bad || c.p != c.end)
+          goto bad;
+        goto done;
+      }
+  }
+
+  if (!check_stats (&r))
+    goto done;
+
+  if (!get_database (&r, makefiles, read_filesp))
+    OS (fatal, NILF, _("%s: corrupt database cache"), name);
+
+  DB (DB_BASIC, (_("Loaded the database from '%s'\n"), name));
+  noting = 0;
+  loaded = 1;
+  goto done;
+
+ bad:
+  DB (DB_BASIC, (_("Database cache '%s' is incomplete\n"), name));
+
+ done:
+  free (buf);
+  return loaded;
+}
+
+/* Save the database just built from the makefiles, with the list of
+   READ_FILES, in the cache NAME.  MAKEFILES are the -f makefiles, as
+   read_all_makefiles left them.  */
+
+void
+dbcache_save (const char *name, const char **makefiles,
+              struct goaldep *read_files)
+{
+  struct image im, body;
+  struct noted **np, **end;
+  struct goaldep *d;
+  char *tmp;
+  FILE *fp;
+  int ok;
+
+  if (!noting)
+    return;
+  noting = 0;
+
+  if (uncacheable)
+    {
+      DB (DB_BASIC, (_("Not caching the database: %s\n"), uncacheable));
+      free (invocation.buf);
+      return;
+    }
+
+  im = invocation;
+  memset (&invocation, '\0', sizeof (invocation));
+  memset (&body, '\0', sizeof (body));
+
+  /* The makefiles read and the other files looked at.  */
+  for (d = read_files; d != 0; d = d->next)
+    {
+      put_num (&body, 1);
+      put_stat (&body, d->file->name);
+    }
+  np = (struct noted **) noted_files.ht_vec;
+  end = np + noted_files.ht_size;
+  for (; np < end; ++np)
+    if (!HASH_VACANT (*np) && !(*np)->dir)
+      {
+        put_num (&body, 1);
+        put_stat (&body, (*np)->name);
+      }
+  put_num (&body, 0);
+
+  put_database (&body, makefiles, read_files);
+
+  put_num (&im, body.len);
+  put_bytes (&im, body.buf, body.len);
+  put_num (&im, checksum (body.buf, body.len));
+  free (body.buf);
+
+  tmp = alloca (strlen (name) + CSTRLEN (".tmp") + 1);
+  sprintf (tmp, "%s.tmp", name);
+
+  ENULLLOOP (fp, _fopen (tmp, "wb"));
+  if (fp == 0)
+    {
+      perror_with_name (_("cannot write database cache: "), tmp);
+      free (im.buf);
+      return;
+    }
+  ok = _fwrite (im.buf, 1, im.len, fp) == im.len;
+  ok = _fclose (fp) == 0 && ok;
+  free (im.buf);
+
+  if (!ok || rename (tmp, name) != 0)
+    {
+      perror_with_name (_("cannot write database cache: "), name);
+      unlink (tmp);
+      return;
+    }
+
+  /* Now that the cache is in place, add the directories.  Appending to
+     it doesn't change the modification time of its own directory.  */
+  memset (&im, '\0', sizeof (im));
+  np = (struct noted **) noted_files.ht_vec;
+  for (; np < end; ++np)
+    if (!HASH_VACANT (*np) && (*np)->dir)
+      {
+        put_num (&im, 1);
+        put_stat (&im, (*np)->name);
+      }
+  put_num (&im, 0);
+
+  ENULLLOOP (fp, _fopen (name, "ab"));
+  ok = fp != 0 && _fwrite (im.buf, 1, im.len, fp) == im.len;
+  if (fp != 0)
+    ok = _fclose (fp) == 0 && ok;
+  free (im.buf);
+
+  if (!ok)
+    {
+      perror_with_name (_("cannot write database cache: "), name);
+      unlink (name);
+      return;
+    }
+
+  DB (DB_BASIC, (_("Saved the database in '%s'\n"), name));
+}
+
+/* The state of files between runs.
+
+   With --state-file=FILE, make saves in FILE the modification time of
+   every file it looked at, and of each directory holding one, when it
+   exits.  The next time it is run in the same directory, a file whose
+   directory still has the same modification time is taken to have the
+   same modification time itself, and isn't examined again.  Creating,
+   deleting or renaming a file changes the modification time of its
+   directory, and that is how most tools replace the files they write,
+   but changing a file in place doesn't; that is the price of a null
+   build which needs one stat per directory instead of one per file.
+
+   Nothing from FILE is trusted once make has started running commands,
+   and the files looked at before then are examined again before FILE is
+   saved.  Nor is it trusted after make has remade a makefile and
+   started over, since those makefiles may have been rewritten in place.
+
+   The file has the same layout as the database cache: a magic string,
+   the version of make and the directory, then the length of a list of
+   files and their times, the list, and a checksum.  The directories
+   follow.  */
+
+#define STATE_MAGIC     "GNU make file state 1\n"
+
+/* Both kinds of entry start with their name, which is what they are
+   hashed and compared on.  */
+
+struct filestate
+  {
+    const char *name;           /* In the strcache.  */
+    FILE_TIMESTAMP mtime;
+    unsigned int generation;    /* The file_generation when make found
+                                   MTIME, or 0 if it was only loaded.  */
+  };
+
+struct statedir
+  {
+    const char *name;           /* In the strcache.  */
+    FILE_TIMESTAMP mtime;       /* When the state was saved.  */
+    int same;                   /* 1 if it still has MTIME, 0 if not, or
+                                   -1 if that hasn't been checked.  */
+  };
+
+static const char *state_file = 0;
+static struct hash_table state_files;
+static struct hash_table state_dirs;
+
+/* The file_generation at which the loaded state may be used, or 0.  */
+static unsigned int state_generation = 0;
+
+static unsigned long
+state_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (*(const char * const *) key);
+}
+
+static unsigned long
+state_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (*(const char * const *) key);
+}
+
+static int
+state_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (*(const char * const *) x,
+                         *(const char * const *) y);
+}
+
+static void
+put_state_header (struct image *im)
+{
+  put_str (im, STATE_MAGIC);
+  put_str (im, version_string);
+  put_str (im, starting_directory);
+}
+
+/* Return the directory part of NAME in the strcache.  */
+
+static const char *
+state_dirname (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+
+  if (slash == 0)
+    return strcache_add (".");
+  if (slash == name)
+    return strcache_add ("/");
+  return strcache_add_len (name, slash - name);
+}
+
+/* Return the modification time of file or directory NAME, or
+   NONEXISTENT_MTIME, or UNKNOWN_MTIME if it can't be found.  */
+
+static FILE_TIMESTAMP
+state_stat (const char *name)
+{
+  struct stat st;
+  int e;
+
+  EINTRLOOP (e, stat (name, &st));
+  if (e == 0)
+    return FILE_TIMESTAMP_STAT_MODTIME (name, st);
+  if (errno == ENOENT || errno == ENOTDIR)
+    return NONEXISTENT_MTIME;
+  return UNKNOWN_MTIME;
+}
+
+/* Read a list of files, or of directories if DIRS is nonzero.  */
+
+static void
+get_state_list (struct reader *r, int dirs)
+{
+  while (get_num (r) && !r->bad)
+    {
+      const char *name = get_cached (r);
+      FILE_TIMESTAMP mtime = (FILE_TIMESTAMP) get_num (r);
+
+      if (name == 0 || r->bad)
+        continue;
+
+      if (dirs)
+        {
+          struct statedir *sd = xmalloc (sizeof (struct statedir));
+          sd->name = name;
+          sd->mtime = mtime;
+          sd->same = -1;
+          hash_insert (&state_dirs, sd);
+        }
+      else
+        {
+          struct filestate *fs = xmalloc (sizeof (struct filestate));
+          fs->name = name;
+          fs->mtime = mtime;
+          fs->generation = 0;
+          hash_insert (&state_files, fs);
+        }
+    }
+}
+
+/* Start noting the files whose modification times are found, to save
+   them in NAME.  If TRUST is nonzero, also load what NAME says about
+   them.  */
+
+void
+filestate_load (const char *name, int trust)
+{
+  struct image header;
+  struct reader r;
+  size_t len, body;
+  char *buf;
+
+  state_file = name;
+  hash_init (&state_files, 4096, state_hash_1, state_hash_2, state_hash_cmp);
+  hash_init (&state_dirs, 256, state_hash_1, state_hash_2, state_hash_cmp);
+
+  if (!trust)
+    return;
+
+  buf = read_whole_file (name, &len);
+  if (buf == 0)
+    {
+      DB (DB_BASIC, (_("No file state '%s'\n"), name));
+      return;
+    }
+
+  memset (&header, '\0', sizeof (header));
+  put_state_header (&header);
+
+  r.p = buf;
+  r.end = buf + len;
+  r.bad = 0;
+
+  if (len < header.len || memcmp (buf, header.buf, header.len) != 0)
+    {
+      DB (DB_BASIC, (_("File state '%s' is for a different directory\n"),
+                     name));
+      goto done;
+    }
+  r.p += header.len;
+
+  body = (size_t) get_num (&r);
+  if (r.bad || body > (size_t) (r.end - r.p))
+    goto bad;
+  {
+    struct reader c;
+    c.p = r.p + body;
+    c.end = r.end;
+    c.bad = 0;
+    if (get_num (&c) != checksum (r.p, body) || c.bad)
+      goto bad;
+
+    get_state_list (&c, 1);
+    if (c.bad || c.p != c.end)
+      goto bad;
+    r.end = r.p + body;
+  }
+
+  get_state_list (&r, 0);
+  if (r.bad || r.p != r.end)
+    goto bad;
+
+  state_generation = file_generation;
+  DB (DB_BASIC, (_("Loaded the state of %lu files from '%s'\n"),
+                 state_files.ht_fill, name));
+  goto done;
+
+ bad:
+  DB (DB_BASIC, (_("File state '%s' is incomplete\n"), name));
+  hash_free (&state_files, 1);
+  hash_free (&state_dirs, 1);
+  hash_init (&state_files, 4096, state_hash_1, state_hash_2, state_hash_cmp);
+  hash_init (&state_dirs, 256, state_hash_1, state_hash_2, state_hash_cmp);
+
+ done:
+  free (header.buf);
+  free (buf);
+}
+
+/* Return the modification time of file NAME according to the state
+   loaded, or UNKNOWN_MTIME if that can't be trusted.  */
+
+FILE_TIMESTAMP
+filestate_mtime (const char *name)
+{
+  struct filestate *fs;
+  struct statedir *sd;
+  struct statedir dir_key;
+
+  if (state_generation == 0)
+    return UNKNOWN_MTIME;
+  if (state_generation != file_generation)
+    {
+      /* Commands have been run since it was loaded.  */
+      state_generation = 0;
+      return UNKNOWN_MTIME;
+    }
+
+  fs = hash_find_item (&state_files, &name);
+  if (fs == 0)
+    return UNKNOWN_MTIME;
+  if (fs->generation != 0)
+    /* Found already.  */
+    return fs->mtime;
+
+  dir_key.name = state_dirname (name);
+  sd = hash_find_item (&state_dirs, &dir_key);
+  if (sd == 0)
+    return UNKNOWN_MTIME;
+
+  if (sd->same < 0)
+    {
+      sd->same = state_stat (sd->name) == sd->mtime;
+      if (!sd->same)
+        DB (DB_VERBOSE, (_("Directory '%s' has changed since '%s' was saved\n"),
+                         sd->name, state_file));
+    }
+
+  return sd->same ? fs->mtime : UNKNOWN_MTIME;
+}
+
+/* Note that the modification time of file NAME was found to be MTIME.  */
+
+void
+filestate_note (const char *name, FILE_TIMESTAMP mtime)
+{
+  struct filestate *fs;
+  struct filestate **slot;
+
+  if (state_file == 0)
+    return;
+
+  slot = (struct filestate **) hash_find_slot (&state_files, &name);
+  fs = *slot;
+  if (HASH_VACANT (fs))
+    {
+      fs = xcalloc (sizeof (struct filestate));
+      fs->name = strcache_add (name);
+      hash_insert_at (&state_files, fs, slot);
+    }
+  fs->mtime = mtime;
+  fs->generation = file_generation;
+}
+
+/* Save the state of the files noted in the file given to
+   filestate_load.  */
+
+void
+filestate_save (void)
+{
+  struct image im, body;
+  struct filestate **fp, **fend;
+  struct statedir **dp, **dend;
+  struct hash_table dirs;
+  unsigned int count = 0;
+  FILE_TIMESTAMP now;
+  FILE *f;
+  int ok;
+
+  if (state_file == 0)
+    return;
+
+  memset (&im, '\0', sizeof (im));
+  memset (&body, '\0', sizeof (body));
+  hash_init (&dirs, 256, state_hash_1, state_hash_2, state_hash_cmp);
+
+  fp = (struct filestate **) state_files.ht_vec;
+  fend = fp + state_files.ht_size;
+  for (; fp < fend; ++fp)
+    {
+      struct filestate *fs = *fp;
+      struct statedir dir_key;
+      struct statedir **slot;
+
+      if (HASH_VACANT (fs) || fs->generation == 0)
+        continue;
+
+      /* Commands run since it was found may have changed it.  */
+      if (fs->generation != file_generation)
+        {
+          fs->mtime = state_stat (fs->name);
+          if (fs->mtime == UNKNOWN_MTIME)
+            continue;
+        }
+
+      put_num (&body, 1);
+      put_str (&body, fs->name);
+      put_num (&body, fs->mtime);
+      ++count;
+
+      dir_key.name = state_dirname (fs->name);
+      slot = (struct statedir **) hash_find_slot (&dirs, &dir_key);
+      if (HASH_VACANT (*slot))
+        {
+          struct statedir *sd = xcalloc (sizeof (struct statedir));
+          sd->name = dir_key.name;
+          hash_insert_at (&dirs, sd, slot);
+        }
+    }
+  put_num (&body, 0);
+
+  put_state_header (&im);
+  put_num (&im, body.len);
+  put_bytes (&im, body.buf, body.len);
+  put_num (&im, checksum (body.buf, body.len));
+  free (body.buf);
+
+  /* Write the file in place: replacing it would change the modification
+     time of its directory.  If it is cut short, the checksum shows it.  */
+  ENULLLOOP (f, _fopen (state_file, "wb"));
+  ok = f != 0 && _fwrite (im.buf, 1, im.len, f) == im.len;
+  if (f != 0)
+    ok = _fclose (f) == 0 && ok;
+  now = ok ? state_stat (state_file) : UNKNOWN_MTIME;
+  if (now == UNKNOWN_MTIME || now == NONEXISTENT_MTIME)
+    {
+      perror_with_name (_("cannot write file state: "), state_file);
+      goto done;
+    }
+
+  /* Add the directories.  The file's own time says what time it is by the
+     clock of the file system.  A directory changed at that time or later
+     may change again without its time showing it, so it is left out.  */
+  im.len = 0;
+  dp = (struct statedir **) dirs.ht_vec;
+  dend = dp + dirs.ht_size;
+  for (; dp < dend; ++dp)
+    if (!HASH_VACANT (*dp))
+      {
+        FILE_TIMESTAMP mtime = state_stat ((*dp)->name);
+        if (mtime == UNKNOWN_MTIME || mtime >= now)
+          continue;
+        put_num (&im, 1);
+        put_str (&im, (*dp)->name);
+        put_num (&im, mtime);
+      }
+  put_num (&im, 0);
+
+  ENULLLOOP (f, _fopen (state_file, "ab"));
+  ok = f != 0 && _fwrite (im.buf, 1, im.len, f) == im.len;
+  if (f != 0)
+    ok = _fclose (f) == 0 && ok;
+
+  if (!ok)
+    {
+      perror_with_name (_("cannot write file state: "), state_file);
+      unlink (state_file);
+      goto done;
+    }
+
+  DB (DB_BASIC, (_("Saved the state of %u files in '%s'\n"),
+                 count, state_file));
+
+ done:
+  free (im.buf);
+  hash_free (&dirs, 1);
+  state_file = 0;
+}
+
+/* Hashes of file contents.
+
+   With --content-hash=FILE, make keeps in FILE a hash of the contents of
+   every target it remakes, of each of its prerequisites at the time, and
+   of its recipe as expanded.  When a target is older than one of its
+   prerequisites but none of those hashes has changed, it is taken to be
+   up to date after all.  Touching a file, or remaking one that comes out
+   the same, then remakes nothing that depends on it.
+
+   Hashing a file means reading all of it, so the hash found for each
+   file is kept too, with the times and size the file had then, and used
+   as long as the file still has them.  A hash taken in the same second
+   as the file was changed may be of the contents before a later change
+   in that second, so it isn't kept.
+
+   Recipes are expanded again to compare them, so a function with side
+   effects in one runs an extra time when its target is checked.  One
+   that uses $? is different whenever other prerequisites are newer, and
+   is remade as make would without this option.
+
+   The file has the same layout as the file state: a magic string, the
+   version of make and the directory, then the length of the rest, the
+   hashes of files, the targets with their recipes and prerequisites,
+   and a checksum.
+
+   The hash is XXH64.  */
+
+#define HASH_MAGIC      "GNU make content hashes 1\n"
+
+#define PRIME64_1 UINT64_C (0x9E3779B185EBCA87)
+#define PRIME64_2 UINT64_C (0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 UINT64_C (0x165667B19E3779F9)
+#define PRIME64_4 UINT64_C (0x85EBCA77C2B2AE63)
+#define PRIME64_5 UINT64_C (0x27D4EB2F165667C5)
+
+struct xxh64
+  {
+    uint64_t v[4];
+    uint64_t total;
+    unsigned char mem[32];
+    unsigned int memsize;
+  };
+
+#define ROTL64(_x,_r)   (((_x) << (_r)) | ((_x) >> (64 - (_r))))
+
+static uint64_t
+read64 (const unsigned char *p)
+{
+  return ((uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+          | (uint64_t) p[3] << 24 | (uint64_t) p[4] << 32
+          | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48
+          | (uint64_t) p[7] << 56);
+}
+
+static uint64_t
+read32 (const unsigned char *p)
+{
+  return ((uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+          | (uint64_t) p[3] << 24);
+}
+
+static uint64_t
+xxh64_round (uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = ROTL64 (acc, 31);
+  return acc * PRIME64_1;
+}
+
+static uint64_t
+xxh64_merge (uint64_t acc, uint64_t v)
+{
+  acc ^= xxh64_round (0, v);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static void
+xxh64_init (struct xxh64 *x)
+{
+  x->v[0] = PRIME64_1 + PRIME64_2;
+  x->v[1] = PRIME64_2;
+  x->v[2] = 0;
+  x->v[3] = 0 - PRIME64_1;
+  x->total = 0;
+  x->memsize = 0;
+}
+
+static void
+xxh64_stripe (struct xxh64 *x, const unsigned char *p)
+{
+  x->v[0] = xxh64_round (x->v[0], read64 (p));
+  x->v[1] = xxh64_round (x->v[1], read64 (p + 8));
+  x->v[2] = xxh64_round (x->v[2], read64 (p + 16));
+  x->v[3] = xxh64_round (x->v[3], read64 (p + 24));
+}
+
+static void
+xxh64_update (struct xxh64 *x, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  const unsigned char *end = p + len;
+
+  x->total += len;
+
+  if (x->memsize + len < 32)
+    {
+      memcpy (x->mem + x->memsize, p, len);
+      x->memsize += len;
+      return;
+    }
+
+  if (x->memsize)
+    {
+      memcpy (x->mem + x->memsize, p, 32 - x->memsize);
+      xxh64_stripe (x, x->mem);
+      p += 32 - x->memsize;
+      x->memsize = 0;
+    }
+
+  for (; p + 32 <= end; p += 32)
+    xxh64_stripe (x, p);
+
+  memcpy (x->mem, p, end - p);
+  x->memsize = end - p;
+}
+
+static uint64_t
+xxh64_digest (const struct xxh64 *x)
+{
+  const unsigned char *p = x->mem;
+  const unsigned char *end = p + x->memsize;
+  uint64_t h;
+
+  if (x->total >= 32)
+    {
+      h = (ROTL64 (x->v[0], 1) + ROTL64 (x->v[1], 7)
+           + ROTL64 (x->v[2], 12) + ROTL64 (x->v[3], 18));
+      h = xxh64_merge (h, x->v[0]);
+      h = xxh64_merge (h, x->v[1]);
+      h = xxh64_merge (h, x->v[2]);
+      h = xxh64_merge (h, x->v[3]);
+    }
+  else
+    h = x->v[2] + PRIME64_5;
+
+  h += x->total;
+
+  for (; p + 8 <= end; p += 8)
+    {
+      h ^= xxh64_round (0, read64 (p));
+      h = ROTL64 (h, 27) * PRIME64_1 + PRIME64_4;
+    }
+  if (p + 4 <= end)
+    {
+      h ^= read32 (p) * PRIME64_1;
+      h = ROTL64 (h, 23) * PRIME64_2 + PRIME64_3;
+      p += 4;
+    }
+  for (; p < end; ++p)
+    {
+      h ^= *p * PRIME64_5;
+      h = ROTL64 (h, 11) * PRIME64_1;
+    }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* The hash of a file's contents, found when it had modification time
+   MTIME.  */
+
+struct filehash
+  {
+    const char *name;           /* In the strcache.  */
+    FILE_TIMESTAMP mtime;
+    uintmax_t ctime;            /* The time of the last change, in seconds.  */
+    uintmax_t size;
+    uint64_t hash;
+    int keep;                   /* Nonzero if it may be used again.  */
+  };
+
+/* What a target was made from.  */
+
+struct prereqhash
+  {
+    const char *name;           /* In the strcache.  */
+    uint64_t hash;
+  };
+
+struct targethash
+  {
+    const char *name;           /* In the strcache.  */
+    uint64_t recipe;            /* The hash of the expanded recipe.  */
+    uint64_t output;            /* The hash of the target.  */
+    unsigned int nprereqs;
+    struct prereqhash *prereqs;
+    int valid;                  /* Nonzero if the rest may be used.  */
+    uint64_t running;           /* The hash of the recipe being run.  */
+  };
+
+static const char *hash_file = 0;
+static struct hash_table file_hashes;
+static struct hash_table target_hashes;
+
+static void
+free_targethash (const void *item)
+{
+  struct targethash *th = (struct targethash *) item;
+
+  free (th->prereqs);
+  free (th);
+}
+
+static void
+put_hash_header (struct image *im)
+{
+  put_str (im, HASH_MAGIC);
+  put_str (im, version_string);
+  put_str (im, starting_directory);
+}
+
+/* Return the entry for NAME in TABLE, making a new one of SIZE bytes if
+   there is none.  */
+
+static void *
+hash_entry (struct hash_table *table, const char *name, size_t size)
+{
+  const char **slot = (const char **) hash_find_slot (table, &name);
+  const char **entry = (const char **) *slot;
+
+  if (HASH_VACANT (entry))
+    {
+      entry = xcalloc (size);
+      *entry = strcache_add (name);
+      hash_insert_at (table, entry, slot);
+    }
+
+  return entry;
+}
+
+/* Start keeping hashes in NAME, and load those it has already.  */
+
+void
+contenthash_load (const char *name)
+{
+  struct image header;
+  struct reader r;
+  size_t len, body;
+  char *buf;
+
+  hash_file = name;
+  /* The key of .SHELL_CACHE may have needed hashes while reading.  */
+  if (file_hashes.ht_vec == 0)
+    hash_init (&file_hashes, 4096, state_hash_1, state_hash_2,
+               state_hash_cmp);
+  hash_init (&target_hashes, 1024, state_hash_1, state_hash_2,
+             state_hash_cmp);
+
+  buf = read_whole_file (name, &len);
+  if (buf == 0)
+    {
+      DB (DB_BASIC, (_("No content hashes '%s'\n"), name));
+      return;
+    }
+
+  memset (&header, '\0', sizeof (header));
+  put_hash_header (&header);
+
+  r.p = buf;
+  r.end = buf + len;
+  r.bad = 0;
+
+  if (len < header.len || memcmp (buf, header.buf, header.len) != 0)
+    {
+      DB (DB_BASIC, (_("Content hashes '%s' are for a different directory\n"),
+                     name));
+      goto done;
+    }
+  r.p += header.len;
+
+  body = (size_t) get_num (&r);
+  if (r.bad || body > (size_t) (r.end - r.p))
+    goto bad;
+  {
+    struct reader c;
+    c.p = r.p + body;
+    c.end = r.end;
+    c.bad = 0;
+    if (get_num (&c) != checksum (r.p, body) || c.bad || c.p != c.end)
+      goto bad;
+    r.end = r.p + body;
+  }
+
+  while (get_num (&r) && !r.bad)
+    {
+      const char *fname = get_cached (&r);
+      struct filehash *fh;
+
+      if (fname == 0 || r.bad)
+        goto bad;
+      fh = hash_entry (&file_hashes, fname, sizeof (struct filehash));
+      fh->mtime = (FILE_TIMESTAMP) get_num (&r);
+      fh->ctime = get_num (&r);
+      fh->size = get_num (&r);
+      fh->hash = (uint64_t) get_num (&r);
+      fh->keep = 1;
+    }
+
+  while (get_num (&r) && !r.bad)
+    {
+      const char *tname = get_cached (&r);
+      struct targethash *th;
+      unsigned int i;
+
+      if (tname == 0 || r.bad)
+        goto bad;
+      th = hash_entry (&target_hashes, tname, sizeof (struct targethash));
+      th->recipe = (uint64_t) get_num (&r);
+      th->output = (uint64_t) get_num (&r);
+      th->nprereqs = (unsigned int) get_num (&r);
+      if (r.bad || th->nprereqs > (size_t) (r.end - r.p))
+        goto bad;
+      th->prereqs = xmalloc (th->nprereqs * sizeof (struct prereqhash));
+      for (i = 0; i < th->nprereqs; ++i)
+        {
+          th->prereqs[i].name = get_cached (&r);
+          th->prereqs[i].hash = (uint64_t) get_num (&r);
+          if (th->prereqs[i].name == 0)
+            r.bad = 1;
+        }
+      th->valid = 1;
+    }
+  if (r.bad || r.p != r.end)
+    goto bad;
+
+  DB (DB_BASIC, (_("Loaded the content hashes of %lu targets from '%s'\n"),
+                 target_hashes.ht_fill, name));
+  goto done;
+
+ bad:
+  DB (DB_BASIC, (_("Content hashes '%s' are incomplete\n"), name));
+  hash_map (&target_hashes, free_targethash);
+  hash_free (&target_hashes, 0);
+  hash_free (&file_hashes, 1);
+  hash_init (&file_hashes, 4096, state_hash_1, state_hash_2, state_hash_cmp);
+  hash_init (&target_hashes, 1024, state_hash_1, state_hash_2,
+             state_hash_cmp);
+
+ done:
+  free (header.buf);
+  free (buf);
+}
+
+/* Find the hash of the contents of file F, and store it in *HASHP.
+   Return zero if it doesn't exist or can't be read.  */
+
+static int
+file_hash (struct file *f, uint64_t *hashp)
+{
+  FILE_TIMESTAMP mtime = file_mtime (f);
+  struct filehash *fh;
+  struct stat st;
+  struct xxh64 x;
+  FILE *fp;
+  char buf[65536];
+  size_t n;
+  int e;
+
+  if (f->phony || mtime < ORDINARY_MTIME_MIN || mtime > ORDINARY_MTIME_MAX)
+    return 0;
+
+  EINTRLOOP (e, stat (f->name, &st));
+  if (e != 0)
+    return 0;
+
+  /* The modification time can be set back to what it was, but the time
+     of the last change can't.  */
+  fh = hash_entry (&file_hashes, f->name, sizeof (struct filehash));
+  if (fh->keep && fh->mtime == mtime && fh->ctime == (uintmax_t) st.st_ctime
+      && fh->size == (uintmax_t) st.st_size)
+    {
+      *hashp = fh->hash;
+      return 1;
+    }
+
+  ENULLLOOP (fp, _fopen (f->name, "rb"));
+  if (fp == 0)
+    return 0;
+  xxh64_init (&x);
+  while ((n = _fread (buf, 1, sizeof (buf), fp)) > 0)
+    xxh64_update (&x, buf, n);
+  _fclose (fp);
+
+  /* A file changed in the second it was read may change again without
+     its times showing it, so its hash can't be used again, even in this
+     run.  */
+  fh->mtime = mtime;
+  fh->ctime = st.st_ctime;
+  fh->size = st.st_size;
+  fh->hash = xxh64_digest (&x);
+  fh->keep = st.st_ctime < time (NULL);
+  DB (DB_VERBOSE, (_("Hashed the contents of '%s'\n"), f->name));
+
+  *hashp = fh->hash;
+  return 1;
+}
+
+/* Return the hash of the N recipe lines LINES.  */
+
+static uint64_t
+recipe_hash (char **lines, unsigned int n)
+{
+  struct xxh64 x;
+  unsigned int i;
+
+  xxh64_init (&x);
+  for (i = 0; i < n; ++i)
+    xxh64_update (&x, lines[i], strlen (lines[i]) + 1);
+
+  return xxh64_digest (&x);
+}
+
+/* Return nonzero if FILE, and each of its prerequisites, has the same
+   contents as when FILE was last remade, and its recipe expands to the
+   same text; that is, if remaking FILE would change nothing.  */
+
+int
+contenthash_unchanged (struct file *file)
+{
+  struct targethash *th;
+  struct dep *d;
+  unsigned int i;
+  uint64_t hash;
+  char **lines;
+  struct commands *cmds = file->cmds;
+
+  if (hash_file == 0)
+    return 0;
+
+  th = hash_find_item (&target_hashes, &file->name);
+  if (th == 0 || !th->valid)
+    return 0;
+
+  for (d = file->deps, i = 0; d != 0; d = d->next)
+    if (!d->ignore_mtime)
+      {
+        if (i == th->nprereqs || !streq (d->file->name, th->prereqs[i].name))
+          return 0;
+        ++i;
+      }
+  if (i != th->nprereqs)
+    return 0;
+
+  if (!file_hash (file, &hash) || hash != th->output)
+    return 0;
+
+  for (d = file->deps, i = 0; d != 0; d = d->next)
+    if (!d->ignore_mtime)
+      {
+        if (!file_hash (d->file, &hash) || hash != th->prereqs[i].hash)
+          {
+            DB (DB_VERBOSE, (_("Contents of '%s' have changed.\n"),
+                             d->file->name));
+            return 0;
+          }
+        ++i;
+      }
+
+  chop_commands (cmds);
+  initialize_file_variables (file, 0);
+  set_file_variables (file);
+  lines = xmalloc (cmds->ncommand_lines * sizeof (char *));
+  for (i = 0; i < cmds->ncommand_lines; ++i)
+    lines[i] = allocated_variable_expand_for_file (cmds->command_lines[i],
+                                                   file);
+  hash = recipe_hash (lines, cmds->ncommand_lines);
+  for (i = 0; i < cmds->ncommand_lines; ++i)
+    free (lines[i]);
+  free (lines);
+
+  if (hash != th->recipe)
+    {
+      DB (DB_VERBOSE, (_("Recipe for '%s' has changed.\n"), file->name));
+      return 0;
+    }
+
+  return 1;
+}
+
+/* Note that the recipe for FILE is being run, expanded to the N lines
+   LINES.  */
+
+void
+contenthash_recipe (struct file *file, char **lines, unsigned int n)
+{
+  struct targethash *th;
+
+  if (hash_file == 0)
+    return;
+
+  th = hash_entry (&target_hashes, file->name, sizeof (struct targethash));
+  th->valid = 0;
+  th->running = recipe_hash (lines, n);
+}
+
+/* Note that the recipe for FILE has finished.  If it succeeded, record
+   what FILE was made from.  */
+
+void
+contenthash_remade (struct file *file)
+{
+  struct targethash *th;
+  struct dep *d;
+  unsigned int n = 0;
+
+  if (hash_file == 0)
+    return;
+
+  th = hash_find_item (&target_hashes, &file->name);
+  if (th == 0 || th->running == 0)
+    return;
+
+  th->recipe = th->running;
+  th->running = 0;
+  if (file->update_status != us_success
+      || question_flag || just_print_flag || touch_flag
+      || !file_hash (file, &th->output))
+    return;
+
+  for (d = file->deps; d != 0; d = d->next)
+    if (!d->ignore_mtime)
+      ++n;
+  th->prereqs = xrealloc (th->prereqs, n * sizeof (struct prereqhash));
+  th->nprereqs = n;
+
+  for (d = file->deps, n = 0; d != 0; d = d->next)
+    if (!d->ignore_mtime)
+      {
+        th->prereqs[n].name = d->file->name;
+        if (!file_hash (d->file, &th->prereqs[n].hash))
+          return;
+        ++n;
+      }
+
+  th->valid = 1;
+}
+
+/* Save the hashes in the file given to contenthash_load.  */
+
+void
+contenthash_save (void)
+{
+  struct image im, body;
+  const void **p, **end;
+  unsigned int count = 0;
+  FILE *f;
+  int ok;
+
+  if (hash_file == 0)
+    return;
+
+  memset (&im, '\0', sizeof (im));
+  memset (&body, '\0', sizeof (body));
+
+  p = (const void **) file_hashes.ht_vec;
+  end = p + file_hashes.ht_size;
+  for (; p < end; ++p)
+    {
+      const struct filehash *fh = *p;
+      if (HASH_VACANT (fh) || !fh->keep)
+        continue;
+      put_num (&body, 1);
+      put_str (&body, fh->name);
+      put_num (&body, fh->mtime);
+      put_num (&body, fh->ctime);
+      put_num (&body, fh->size);
+      put_num (&body, fh->hash);
+    }
+  put_num (&body, 0);
+
+  p = (const void **) target_hashes.ht_vec;
+  end = p + target_hashes.ht_size;
+  for (; p < end; ++p)
+    {
+      const struct targethash *th = *p;
+      unsigned int i;
+
+      if (HASH_VACANT (th) || !th->valid)
+        continue;
+      put_num (&body, 1);
+      put_str (&body, th->name);
+      put_num (&body, th->recipe);
+      put_num (&body, th->output);
+      put_num (&body, th->nprereqs);
+      for (i = 0; i < th->nprereqs; ++i)
+        {
+          put_str (&body, th->prereqs[i].name);
+          put_num (&body, th->prereqs[i].hash);
+        }
+      ++count;
+    }
+  put_num (&body, 0);
+
+  put_hash_header (&im);
+  put_num (&im, body.len);
+  put_bytes (&im, body.buf, body.len);
+  put_num (&im, checksum (body.buf, body.len));
+  free (body.buf);
+
+  ENULLLOOP (f, _fopen (hash_file, "wb"));
+  ok = f != 0 && _fwrite (im.buf, 1, im.len, f) == im.len;
+  if (f != 0)
+    ok = _fclose (f) == 0 && ok;
+  if (!ok)
+    {
+      perror_with_name (_("cannot write content hashes: "), hash_file);
+      unlink (hash_file);
+    }
+  else
+    DB (DB_BASIC, (_("Saved the content hashes of %u targets in '%s'\n"),
+                   count, hash_file));
+
+  free (im.buf);
+}
+
+/* Cache of the results of recipes.
+
+   With --action-cache=DIR, make keeps a copy of the targets each recipe
+   made in DIR, under a key computed before the recipe was run.  When it
+   is about to run a recipe whose key is already in DIR, it copies the
+   targets from there instead.  Going back to sources that were built
+   before, say by switching branches, then runs no recipe again.
+
+   The key is a hash of the directory make runs in, the names of the
+   targets, the recipe as expanded, the contents of the prerequisites
+   (other than order-only ones), and the variables exported to the
+   recipe.  A variable that has the value it had in make's own
+   environment is left out, unless it is PATH; so is anything that
+   depends on how make was invoked, like MAKEFLAGS.  Files a recipe reads
+   without their being prerequisites are not part of the key, nor is
+   anything the recipe writes other than its targets, including its
+   output.  Recipes that run make, and targets with a prerequisite that
+   can't be hashed, such as a phony one, are never cached.
+
+   An entry is a directory DIR/XX/KEY, where XX is the first two digits
+   of KEY, holding one file per target named after its place: the target
+   itself first, then the targets made by the same recipe.  It is built
+   under a temporary name and renamed into place, so another make sees it
+   whole or not at all.  Targets are copied into a temporary file that is
+   renamed over them, cloning the data where the file system can.  They
+   aren't hard linked, since a recipe that appends to a file it made
+   before would then change the cache too.  */
+
+#ifdef HAVE_LINUX_FS_H
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+#define ACTION_MAGIC    "GNU make action 1"
+
+/* The key of the recipe being run for a target.  */
+
+struct action
+  {
+    const char *name;           /* The target, in the strcache.  */
+    uint64_t key;               /* The key, if VALID.  */
+    int valid;                  /* Nonzero while the recipe is run.  */
+  };
+
+static const char *action_dir = 0;
+static struct hash_table actions;
+
+/* Variables in the recipe environment that say how make was invoked
+   rather than what the recipe does.  */
+
+static const char *const action_ignored_vars[] =
+  {
+    "MAKEFLAGS", "MFLAGS", "MAKELEVEL", "MAKE_TERMOUT", "MAKE_TERMERR", 0
+  };
+
+void
+actioncache_init (const char *dir)
+{
+  action_dir = dir;
+  hash_init (&actions, 256, state_hash_1, state_hash_2, state_hash_cmp);
+
+  /* Hashes of files are shared with --content-hash, if it's used.  */
+  if (file_hashes.ht_vec == 0)
+    hash_init (&file_hashes, 4096, state_hash_1, state_hash_2,
+               state_hash_cmp);
+}
+
+/* Return a hash of the environment ENV that doesn't depend on the order
+   of its entries, leaving out those that don't matter to the recipe.  */
+
+static uint64_t
+environment_hash (char **env)
+{
+  uint64_t sum = 0;
+  char **ep;
+
+  for (ep = env; *ep != 0; ++ep)
+    {
+      const char *eq = strchr (*ep, '=');
+      const char *const *ip;
+      struct xxh64 x;
+      size_t len;
+
+      if (eq == 0)
+        continue;
+      len = eq - *ep;
+
+      for (ip = action_ignored_vars; *ip != 0; ++ip)
+        if (strlen (*ip) == len && strneq (*ep, *ip, len))
+          break;
+      if (*ip != 0)
+        continue;
+
+      if (len != CSTRLEN ("PATH") || !strneq (*ep, "PATH", len))
+        {
+          char *name = xstrndup (*ep, len);
+          const char *value = getenv (name);
+          free (name);
+          if (value != 0 && streq (value, eq + 1))
+            continue;
+        }
+
+      xxh64_init (&x);
+      xxh64_update (&x, *ep, strlen (*ep));
+      sum += xxh64_digest (&x);
+    }
+
+  return sum;
+}
+
+/* Compute the key of running the recipe LINES of FILE with environment
+   ENV into *KEYP.  Return zero if it can't be computed.  */
+
+static int
+action_key (struct file *file, char **lines, char **env, uint64_t *keyp)
+{
+  struct xxh64 x;
+  struct dep *d;
+  unsigned int i;
+  uint64_t h;
+
+  xxh64_init (&x);
+  xxh64_update (&x, ACTION_MAGIC, sizeof (ACTION_MAGIC));
+  if (starting_directory != 0)
+    xxh64_update (&x, starting_directory, strlen (starting_directory));
+  xxh64_update (&x, "", 1);
+
+  xxh64_update (&x, file->name, strlen (file->name) + 1);
+  for (d = file->also_make; d != 0; d = d->next)
+    xxh64_update (&x, d->file->name, strlen (d->file->name) + 1);
+  xxh64_update (&x, "", 1);
+
+  for (i = 0; i < file->cmds->ncommand_lines; ++i)
+    xxh64_update (&x, lines[i], strlen (lines[i]) + 1);
+
+  for (d = file->deps; d != 0; d = d->next)
+    if (!d->ignore_mtime)
+      {
+        if (!file_hash (d->file, &h))
+          return 0;
+        xxh64_update (&x, d->file->name, strlen (d->file->name) + 1);
+        xxh64_update (&x, &h, sizeof (h));
+      }
+
+  h = environment_hash (env);
+  xxh64_update (&x, &h, sizeof (h));
+
+  *keyp = xxh64_digest (&x);
+  return 1;
+}
+
+/* Return the name of the entry for KEY in the cache, or of a temporary
+   entry for it if TMP is nonzero, in a new string.  */
+
+static char *
+action_entry (uint64_t key, int tmp)
+{
+  char hex[17];
+  char *name = xmalloc (strlen (action_dir) + 3 + 1 + 16 + 30);
+
+  sprintf (hex, "%08lx%08lx", (unsigned long) (key >> 32),
+           (unsigned long) (key & 0xffffffff));
+  if (tmp)
+    sprintf (name, "%s/%.2s/%s.%ld.tmp", action_dir, hex, hex,
+             (long) getpid ());
+  else
+    sprintf (name, "%s/%.2s/%s", action_dir, hex, hex);
+
+  return name;
+}
+
+/* Copy the file FROM, which has mode MODE, to a new file TO.  If TMP is
+   nonzero, copy to a temporary name and rename it over TO.  Return
+   nonzero on success, and zero with errno set otherwise.  */
+
+static int
+copy_file (const char *from, const char *to, mode_t mode, int tmp)
+{
+  char *name = (char *) to;
+  char buf[65536];
+  int in, out;
+  int ok = 0;
+  int e;
+
+  if (tmp)
+    {
+      name = alloca (strlen (to) + 30);
+      sprintf (name, "%s.%ld.tmp", to, (long) getpid ());
+    }
+
+  EINTRLOOP (in, open (from, O_RDONLY));
+  if (in < 0)
+    return 0;
+  EINTRLOOP (out, open (name, O_WRONLY | O_CREAT | O_EXCL, mode & 0777));
+  if (out < 0)
+    {
+      e = errno;
+      close (in);
+      errno = e;
+      return 0;
+    }
+
+#ifdef FICLONE
+  /* Share the data if the file system can.  */
+  if (ioctl (out, FICLONE, in) == 0)
+    ok = 1;
+  else
+#endif
+    while (1)
+      {
+        ssize_t n, w, done;
+
+        EINTRLOOP (n, read (in, buf, sizeof (buf)));
+        if (n <= 0)
+          {
+            ok = n == 0;
+            break;
+          }
+        for (done = 0; done < n; done += w)
+          {
+            EINTRLOOP (w, write (out, buf + done, n - done));
+            if (w < 0)
+              break;
+          }
+        if (done < n)
+          break;
+      }
+
+  e = errno;
+  close (in);
+  if (close (out) != 0 && ok)
+    {
+      e = errno;
+      ok = 0;
+    }
+  if (ok && tmp && rename (name, to) != 0)
+    {
+      e = errno;
+      ok = 0;
+    }
+  if (!ok)
+    unlink (name);
+  errno = e;
+
+  return ok;
+}
+
+/* Return the Nth target made by the recipe of FILE, or null.  */
+
+static struct file *
+action_target (struct file *file, unsigned int n)
+{
+  struct dep *d;
+
+  if (n == 0)
+    return file;
+  for (d = file->also_make; d != 0; d = d->next)
+    if (--n == 0)
+      return d->file;
+
+  return 0;
+}
+
+/* The recipe LINES of FILE is about to be run, with the environment in
+   *ENVP, which is set up here if it is still null.  If its targets are
+   in the action cache, copy them from there and return nonzero; the
+   recipe needn't be run.  */
+
+int
+actioncache_restore (struct file *file, char **lines, char ***envp)
+{
+  struct action *a;
+  struct file *t;
+  struct stat st;
+  char *entry;
+  char *from;
+  unsigned int i;
+  int e;
+
+  if (action_dir == 0 || file->phony || file->cmds->any_recurse
+      || question_flag || just_print_flag || touch_flag)
+    return 0;
+
+  a = hash_entry (&actions, file->name, sizeof (struct action));
+  a->valid = 0;
+
+  if (*envp == 0)
+    *envp = target_environment (file);
+  if (!action_key (file, lines, *envp, &a->key))
+    return 0;
+  a->valid = 1;
+
+  entry = action_entry (a->key, 0);
+  from = alloca (strlen (entry) + 12);
+
+  /* Make sure the entry is whole before changing any target.  */
+  for (i = 0; action_target (file, i) != 0; ++i)
+    {
+      sprintf (from, "%s/%u", entry, i);
+      EINTRLOOP (e, stat (from, &st));
+      if (e != 0 || !S_ISREG (st.st_mode))
+        {
+          DB (DB_VERBOSE, (_("No action cache entry for '%s'.\n"),
+                           file->name));
+          free (entry);
+          return 0;
+        }
+    }
+
+  for (i = 0; (t = action_target (file, i)) != 0; ++i)
+    {
+      sprintf (from, "%s/%u", entry, i);
+      EINTRLOOP (e, stat (from, &st));
+      if (e != 0 || !copy_file (from, t->name, st.st_mode, 1))
+        {
+          perror_with_name (_("cannot restore from the action cache: "),
+                            t->name);
+          free (entry);
+          return 0;
+        }
+    }
+
+  DB (DB_BASIC, (_("Restored '%s' from the action cache.\n"), file->name));
+  free (entry);
+
+  return 1;
+}
+
+/* The recipe of FILE has been run.  If it worked, keep its targets in
+   the action cache.  */
+
+void
+actioncache_remade (struct file *file)
+{
+  struct action *a;
+  struct file *t;
+  struct stat st;
+  char *entry;
+  char *tmp;
+  char *to;
+  unsigned int i;
+  int e;
+
+  if (action_dir == 0)
+    return;
+
+  a = hash_find_item (&actions, &file->name);
+  if (a == 0 || !a->valid)
+    return;
+  a->valid = 0;
+  if (file->update_status != us_success)
+    return;
+
+  entry = action_entry (a->key, 0);
+  EINTRLOOP (e, stat (entry, &st));
+  if (e == 0)
+    {
+      /* It was restored from there, or another make put it there.  */
+      free (entry);
+      return;
+    }
+
+  tmp = action_entry (a->key, 1);
+  to = alloca (strlen (tmp) + 12);
+
+  /* Make the directories holding the entry.  */
+  if (mkdir (action_dir, 0777) != 0 && errno != EEXIST)
+    goto error;
+  strcpy (to, entry);
+  *strrchr (to, '/') = '\0';
+  if (mkdir (to, 0777) != 0 && errno != EEXIST)
+    goto error;
+  if (mkdir (tmp, 0777) != 0)
+    goto error;
+
+  for (i = 0; (t = action_target (file, i)) != 0; ++i)
+    {
+      EINTRLOOP (e, stat (t->name, &st));
+      if (e != 0 || !S_ISREG (st.st_mode))
+        {
+          /* Only plain files are kept.  */
+          DB (DB_VERBOSE, (_("Not keeping '%s' in the action cache.\n"),
+                           t->name));
+          goto remove;
+        }
+      sprintf (to, "%s/%u", tmp, i);
+      if (!copy_file (t->name, to, st.st_mode, 0))
+        {
+          perror_with_name (_("cannot add to the action cache: "), t->name);
+          goto remove;
+        }
+    }
+
+  /* If another make put the entry in place first, it's as good.  */
+  if (rename (tmp, entry) == 0)
+    DB (DB_VERBOSE, (_("Kept '%s' in the action cache.\n"), file->name));
+  else
+    goto remove;
+
+  free (tmp);
+  free (entry);
+  return;
+
+ error:
+  perror_with_name (_("cannot add to the action cache: "), action_dir);
+  free (tmp);
+  free (entry);
+  return;
+
+ remove:
+  while (i-- > 0)
+    {
+      sprintf (to, "%s/%u", tmp, i);
+      unlink (to);
+    }
+  rmdir (tmp);
+  free (tmp);
+  free (entry);
+}
+
+/* Results of $(shell ...).
+
+   Once a makefile mentions the special target .SHELL_CACHE, the output of
+   each $(shell ...) command that succeeds is kept, and the same command
+   run again with the same environment gives the same output without a
+   shell being started.  A command in a recursively expanded variable is
+   then run once however many times the variable is expanded.  Only the
+   output is kept: anything the command writes to its standard error is
+   seen the first time only, and a command that fails is run every time.
+
+   The prerequisites of .SHELL_CACHE are the key of the results: when the
+   contents of any of them change, the results found before are no longer
+   used.  With --shell-cache=FILE, the results found under a key are kept
+   in FILE for the next run, which uses them as long as the key is still
+   the same; a .SHELL_CACHE with no prerequisites keeps nothing between
+   runs.  The environment is that of make itself, less what says how make
+   was invoked.
+
+   The file has the same layout as the content hashes: a magic string,
+   the version of make and the directory, then the length of the rest,
+   the results, and a checksum.  */
+
+#define SHELL_MAGIC     "GNU make shell results 1\n"
+
+struct shellresult
+  {
+    const char *command;
+    uint64_t env;               /* The hash of the environment.  */
+    uint64_t key;               /* The hash of the key files.  */
+    char *output;
+    size_t len;
+    int keep;                   /* Nonzero if it's to be saved.  */
+  };
+
+static const char *shell_file = 0;
+static struct hash_table shell_results;
+
+/* The command $(shell ...) is about to run, when its result is to be
+   kept, and what it is to be kept under.  */
+static struct shellresult shell_pending;
+
+/* The hash of the key files of .SHELL_CACHE, found at file_generation
+   KEY_GENERATION from its first KEY_NDEPS prerequisites.  */
+static uint64_t shell_key;
+static int shell_keyed;
+static unsigned int key_generation = 0;
+static unsigned int key_ndeps = 0;
+
+static unsigned long
+shellresult_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct shellresult *) key)->command);
+}
+
+static unsigned long
+shellresult_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct shellresult *) key)->command);
+}
+
+static int
+shellresult_cmp (const void *x, const void *y)
+{
+  const struct shellresult *a = x;
+  const struct shellresult *b = y;
+
+  if (a->env != b->env)
+    return a->env < b->env ? -1 : 1;
+  if (a->key != b->key)
+    return a->key < b->key ? -1 : 1;
+  return_STRING_COMPARE (a->command, b->command);
+}
+
+static void
+free_shellresult (const void *item)
+{
+  struct shellresult *sr = (struct shellresult *) item;
+
+  free ((char *) sr->command);
+  free (sr->output);
+  free (sr);
+}
+
+static void
+shellcache_init (void)
+{
+  if (shell_results.ht_vec == 0)
+    hash_init (&shell_results, 256, shellresult_hash_1, shellresult_hash_2,
+               shellresult_cmp);
+  if (file_hashes.ht_vec == 0)
+    hash_init (&file_hashes, 4096, state_hash_1, state_hash_2,
+               state_hash_cmp);
+}
+
+static void
+put_shell_header (struct image *im)
+{
+  put_str (im, SHELL_MAGIC);
+  put_str (im, version_string);
+  put_str (im, starting_directory);
+}
+
+/* Start keeping the results of $(shell ...) in NAME, and load those it
+   has already.  */
+
+void
+shellcache_load (const char *name)
+{
+  struct image header;
+  struct reader r;
+  size_t len, body;
+  char *buf;
+
+  shell_file = name;
+  shellcache_init ();
+
+  buf = read_whole_file (name, &len);
+  if (buf == 0)
+    {
+      DB (DB_BASIC, (_("No shell results '%s'\n"), name));
+      return;
+    }
+
+  memset (&header, '\0', sizeof (header));
+  put_shell_header (&header);
+
+  r.p = buf;
+  r.end = buf + len;
+  r.bad = 0;
+
+  if (len < header.len || memcmp (buf, header.buf, header.len) != 0)
+    {
+      DB (DB_BASIC, (_("Shell results '%s' are for a different directory\n"),
+                     name));
+      goto done;
+    }
+  r.p += header.len;
+
+  body = (size_t) get_num (&r);
+  if (r.bad || body > (size_t) (r.end - r.p))
+    goto bad;
+  {
+    struct reader c;
+    c.p = r.p + body;
+    c.end = r.end;
+    c.bad = 0;
+    if (get_num (&c) != checksum (r.p, body) || c.bad || c.p != c.end)
+      goto bad;
+    r.end = r.p + body;
+  }
+
+  while (get_num (&r) && !r.bad)
+    {
+      const char *command = get_str (&r);
+      struct shellresult *sr;
+
+      if (command == 0 || r.bad)
+        goto bad;
+      sr = xcalloc (sizeof (struct shellresult));
+      sr->command = xstrdup (command);
+      sr->env = (uint64_t) get_num (&r);
+      sr->key = (uint64_t) get_num (&r);
+      sr->len = (size_t) get_num (&r);
+      if (r.bad || sr->len > (size_t) (r.end - r.p))
+        {
+          free_shellresult (sr);
+          goto bad;
+        }
+      sr->output = xmalloc (sr->len + 1);
+      memcpy (sr->output, r.p, sr->len);
+      sr->output[sr->len] = '\0';
+      r.p += sr->len;
+      sr = hash_insert (&shell_results, sr);
+      if (sr != 0)
+        free_shellresult (sr);
+    }
+  if (r.bad || r.p != r.end)
+    goto bad;
+
+  DB (DB_BASIC, (_("Loaded %lu shell results from '%s'\n"),
+                 shell_results.ht_fill, name));
+  goto done;
+
+ bad:
+  DB (DB_BASIC, (_("Shell results '%s' are incomplete\n"), name));
+  hash_map (&shell_results, free_shellresult);
+  hash_free (&shell_results, 0);
+  hash_init (&shell_results, 256, shellresult_hash_1, shellresult_hash_2,
+             shellresult_cmp);
+
+ done:
+  free (header.buf);
+  free (buf);
+}
+
+/* Return a hash of make's own environment that doesn't depend on the
+   order of its entries.  */
+
+static uint64_t
+shell_environment_hash (void)
+{
+  uint64_t sum = 0;
+  char **ep;
+
+  for (ep = environ; *ep != 0; ++ep)
+    {
+      const char *eq = strchr (*ep, '=');
+      const char *const *ip;
+      struct xxh64 x;
+      size_t len;
+
+      if (eq == 0)
+        continue;
+      len = eq - *ep;
+
+      for (ip = action_ignored_vars; *ip != 0; ++ip)
+        if (strlen (*ip) == len && strneq (*ep, *ip, len))
+          break;
+      if (*ip != 0 || (len == CSTRLEN ("MAKE_RESTARTS")
+                       && strneq (*ep, "MAKE_RESTARTS", len)))
+        continue;
+
+      xxh64_init (&x);
+      xxh64_update (&x, *ep, strlen (*ep));
+      sum += xxh64_digest (&x);
+    }
+
+  return sum;
+}
+
+/* Find the hash of the prerequisites of .SHELL_CACHE, the file F, and
+   of their contents.  It is found again only when commands may have
+   changed them, or more have been added.  */
+
+static void
+find_shell_key (struct file *f)
+{
+  struct xxh64 x;
+  struct dep *d;
+  unsigned int n = 0;
+
+  for (d = f->deps; d != 0; d = d->next)
+    ++n;
+  if (key_generation == file_generation && key_ndeps == n && n != 0)
+    return;
+
+  xxh64_init (&x);
+  shell_keyed = 0;
+  for (d = f->deps; d != 0; d = d->next)
+    {
+      uint64_t h = 0;
+
+      if (d->file == 0)
+        continue;
+      if (!file_hash (d->file, &h))
+        h = 0;
+      xxh64_update (&x, d->file->name, strlen (d->file->name) + 1);
+      xxh64_update (&x, &h, sizeof (h));
+      shell_keyed = 1;
+    }
+
+  shell_key = shell_keyed ? xxh64_digest (&x) : 0;
+  key_generation = file_generation;
+  key_ndeps = n;
+}
+
+/* If .SHELL_CACHE has been seen and COMMAND has been run before, return
+   the output it gave and store its length in *LENP.  Otherwise return
+   null, and remember to keep the result if shellcache_store is told of
+   it next.  */
+
+const char *
+shellcache_lookup (const char *command, size_t *lenp)
+{
+  struct file *f;
+  struct shellresult *sr;
+
+  shell_pending.command = 0;
+
+  f = lookup_file (".SHELL_CACHE");
+  if (f == 0)
+    return 0;
+
+  shellcache_init ();
+  find_shell_key (f);
+
+  shell_pending.command = command;
+  shell_pending.env = shell_environment_hash ();
+  shell_pending.key = shell_key;
+
+  sr = hash_find_item (&shell_results, &shell_pending);
+  if (sr == 0)
+    return 0;
+
+  shell_pending.command = 0;
+  sr->keep = shell_keyed;
+  DB (DB_VERBOSE, (_("Using the output $(shell %s) gave before.\n"),
+                   command));
+  *lenp = sr->len;
+  return sr->output;
+}
+
+/* Note that COMMAND, which shellcache_lookup was last asked about,
+   succeeded and wrote the LEN bytes OUTPUT.  */
+
+void
+shellcache_store (const char *command, const char *output, size_t len)
+{
+  struct shellresult *sr;
+
+  if (shell_pending.command != command)
+    return;
+  shell_pending.command = 0;
+
+  sr = xmalloc (sizeof (struct shellresult));
+  sr->command = xstrdup (command);
+  sr->env = shell_pending.env;
+  sr->key = shell_pending.key;
+  sr->output = xmalloc (len + 1);
+  memcpy (sr->output, output, len);
+  sr->output[len] = '\0';
+  sr->len = len;
+  sr->keep = shell_keyed;
+  sr = hash_insert (&shell_results, sr);
+  if (sr != 0)
+    free_shellresult (sr);
+}
+
+/* Save the results found or used in this run under a key in the file
+   given to shellcache_load.  */
+
+void
+shellcache_save (void)
+{
+  struct image im, body;
+  const void **p, **end;
+  unsigned int count = 0;
+  FILE *f;
+  int ok;
+
+  if (shell_file == 0)
+    return;
+
+  memset (&im, '\0', sizeof (im));
+  memset (&body, '\0', sizeof (body));
+
+  p = (const void **) shell_results.ht_vec;
+  end = p + shell_results.ht_size;
+  for (; p < end; ++p)
+    {
+      const struct shellresult *sr = *p;
+
+      if (HASH_VACANT (sr) || !sr->keep)
+        continue;
+      put_num (&body, 1);
+      put_str (&body, sr->command);
+      put_num (&body, sr->env);
+      put_num (&body, sr->key);
+      put_num (&body, sr->len);
+      put_bytes (&body, sr->output, sr->len);
+      ++count;
+    }
+  put_num (&body, 0);
+
+  put_shell_header (&im);
+  put_num (&im, body.len);
+  put_bytes (&im, body.buf, body.len);
+  put_num (&im, checksum (body.buf, body.len));
+  free (body.buf);
+
+  ENULLLOOP (f, _fopen (shell_file, "wb"));
+  ok = f != 0 && _fwrite (im.buf, 1, im.len, f) == im.len;
+  if (f != 0)
+    ok = _fclose (f) == 0 && ok;
+  if (!ok)
+    {
+      perror_with_name (_("cannot write shell results: "), shell_file);
+      unlink (shell_file);
+    }
+  else
+    DB (DB_BASIC, (_("Saved %u shell results in '%s'\n"),
+                   count, shell_file));
+
+  free (im.buf);
+}
@@ -0,0 +1,44 @@
+/* Cache of the makefile database for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+struct goaldep;
+
+int dbcache_load (const char *name, char **argv, const char **makefiles,
+                  struct goaldep **read_filesp);
+void dbcache_save (const char *name, const char **makefiles,
+                   struct goaldep *read_files);
+void dbcache_note (const char *name, int dir);
+void dbcache_disable (const char *why);
+
+void filestate_load (const char *name, int trust);
+FILE_TIMESTAMP filestate_mtime (const char *name);
+void filestate_note (const char *name, FILE_TIMESTAMP mtime);
+void filestate_save (void);
+
+void contenthash_load (const char *name);
+int contenthash_unchanged (struct file *file);
+void contenthash_recipe (struct file *file, char **lines, unsigned int n);
+void contenthash_remade (struct file *file);
+void contenthash_save (void);
+
+void actioncache_init (const char *dir);
+int actioncache_restore (struct file *file, char **lines, char ***envp);
+void actioncache_remade (struct file *file);
+
+void shellcache_load (const char *name);
+const char *shellcache_lookup (const char *command, size_t *lenp);
+void shellcache_store (const char *command, const char *output, size_t len);
+void shellcache_save (void);
@@ -708,7 +708,7 @@ install_default_suffix_rules (void)
       struct file *f = enter_file (strcache_add (s[0]));
       /* This function should run before any makefile is parsed.  */
       assert (f->cmds == 0);
-      f->cmds = xmalloc (sizeof (struct commands));
+      f->cmds = alloc_commands ();
       f->cmds->fileinfo.filenm = 0;
       f->cmds->commands = xstrdup (s[1]);
       f->cmds->command_lines = 0;
@@ -34,6 +34,7 @@ struct nameseq
 #define RM_INCLUDED             (1 << 1) /* Search makefile search path.  */
 #define RM_DONTCARE             (1 << 2) /* No error if it doesn't exist.  */
 #define RM_NO_TILDE             (1 << 3) /* Don't expand ~ in file name.  */
+#define RM_DEPFILE              (1 << 4) /* Try reading it as a .d file.  */
 #define RM_NOFLAG               0
 
 /* Structure representing one dependency of a file.
@@ -95,33 +96,37 @@ struct nameseq *ar_glob (const char *arname, const char *member_pattern, unsigne
 
 #define dep_name(d)        ((d)->name ? (d)->name : (d)->file->name)
 
-#define alloc_seq_elt(_t)   xcalloc (sizeof (_t))
+/* Elements of chains of names and of deps come from one pool, sized for a
+   dep, so either can be freed with free_ns.  Goals have their own pool.  */
+extern struct pool seq_pool;
+extern struct pool goaldep_pool;
+
+#define alloc_seq_elt(_t)   pool_alloc (&seq_pool)
 void free_ns_chain (struct nameseq *n);
+void free_goal_chain (struct goaldep *g);
 
 #if defined(MAKE_MAINTAINER_MODE) && defined(__GNUC__)
 /* Use inline to get real type-checking.  */
 #define SI static inline
 SI struct nameseq *alloc_ns()      { return alloc_seq_elt (struct nameseq); }
 SI struct dep *alloc_dep()         { return alloc_seq_elt (struct dep); }
-SI struct goaldep *alloc_goaldep() { return alloc_seq_elt (struct goaldep); }
+SI struct goaldep *alloc_goaldep() { return pool_alloc (&goaldep_pool); }
 
-SI void free_ns(struct nameseq *n)      { free (n); }
+SI void free_ns(struct nameseq *n)      { pool_free (&seq_pool, n); }
 SI void free_dep(struct dep *d)         { free_ns ((struct nameseq *)d); }
-SI void free_goaldep(struct goaldep *g) { free_dep ((struct dep *)g); }
+SI void free_goaldep(struct goaldep *g) { pool_free (&goaldep_pool, g); }
 
 SI void free_dep_chain(struct dep *d)      { free_ns_chain((struct nameseq *)d); }
-SI void free_goal_chain(struct goaldep *g) { free_dep_chain((struct dep *)g); }
 #else
 # define alloc_ns()          alloc_seq_elt (struct nameseq)
 # define alloc_dep()         alloc_seq_elt (struct dep)
-# define alloc_goaldep()     alloc_seq_elt (struct goaldep)
+# define alloc_goaldep()     pool_alloc (&goaldep_pool)
 
-# define free_ns(_n)         free (_n)
+# define free_ns(_n)         pool_free (&seq_pool, (_n))
 # define free_dep(_d)        free_ns (_d)
-# define free_goaldep(_g)    free_dep (_g)
+# define free_goaldep(_g)    pool_free (&goaldep_pool, (_g))
 
 # define free_dep_chain(_d)  free_ns_chain ((struct nameseq *)(_d))
-# define free_goal_chain(_g) free_ns_chain ((struct nameseq *)(_g))
 #endif
 
 struct dep *copy_dep_chain (const struct dep *d);
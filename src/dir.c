@@ -18,6 +18,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "hash.h"
 #include "filedef.h"
 #include "dep.h"
+#include "profile.h"
+#include "dbcache.h"
+#include "debug.h"
 
 #ifdef  HAVE_DIRENT_H
 # include <dirent.h>
@@ -58,6 +61,21 @@ const char *vmsify (const char *name, int type);
 # define REAL_DIR_ENTRY(dp) (dp->d_ino != 0)
 # define FAKE_DIR_ENTRY(dp) (dp->d_ino = 1)
 #endif /* POSIX */
+
+/* Stat the files in a directory relative to the directory itself.  */
+#if defined(HAVE_FSTATAT) && !defined(WINDOWS32) && !defined(VMS) \
+    && !defined(__MSDOS__) && !defined(HAVE_CASE_INSENSITIVE_FS)
+# define DIR_MTIMES 1
+# include <fcntl.h>
+#endif
+
+/* Read the directories a glob pattern looks in with several threads.  */
+#if defined(MAKE_THREADS) && !defined(WINDOWS32) && !defined(VMS) \
+    && !defined(__MSDOS__) && !defined(HAVE_CASE_INSENSITIVE_FS)
+# define DIR_READ_AHEAD 1
+# include <pthread.h>
+# include <signal.h>
+#endif
 
 #ifdef __MSDOS__
 #include <ctype.h>
@@ -262,7 +280,10 @@ struct directory_contents
 # endif
 #endif /* WINDOWS32 */
     struct hash_table dirfiles; /* Files in this directory.  */
+    struct hash_table dirpatterns; /* Patterns looked for in it.  */
     DIR *dirstream;             /* Stream reading this directory.  */
+    unsigned int generation;    /* file_generation when it was opened.  */
+    unsigned int mtime_generation; /* Likewise when its files were stat'd.  */
   };
 
 static unsigned long
@@ -406,6 +427,7 @@ struct dirfile
   {
     const char *name;           /* Name of the file.  */
     size_t length;
+    FILE_TIMESTAMP mtime;       /* Its mtime, if its directory was stat'd.  */
     short impossible;           /* This file is impossible.  */
   };
 
@@ -435,11 +457,61 @@ dirfile_hash_cmp (const void *xv, const void *yv)
 #ifndef DIRFILE_BUCKETS
 #define DIRFILE_BUCKETS 107
 #endif
+
+/* Hash table of the file name patterns looked for in each directory.  */
+
+struct dirpattern
+  {
+    const char *pattern;        /* The pattern, with one %.  */
+    short impossible;           /* No file in the directory matches it.  */
+  };
+
+static unsigned long
+dirpattern_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 (((struct dirpattern const *) key)->pattern);
+}
+
+static unsigned long
+dirpattern_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 (((struct dirpattern const *) key)->pattern);
+}
+
+static int
+dirpattern_hash_cmp (const void *xv, const void *yv)
+{
+  return_ISTRING_COMPARE (((struct dirpattern const *) xv)->pattern,
+                          ((struct dirpattern const *) yv)->pattern);
+}
+
+#ifndef DIRPATTERN_BUCKETS
+#define DIRPATTERN_BUCKETS 23
+#endif
 
 static int dir_contents_file_exists_p (struct directory_contents *dir,
                                        const char *filename);
 static struct directory *find_directory (const char *name);
 
+#ifdef DIR_READ_AHEAD
+/* A directory read by a thread before glob asks for it.  */
+
+struct dirlisting
+  {
+    const char *name;           /* The directory, in the strcache.  */
+    int error;                  /* The errno from stat, or 0.  */
+    struct stat st;             /* What stat said about it.  */
+    char *names;                /* Its files, each followed by a null, or
+                                   null if it couldn't be read.  */
+    size_t length;              /* The length of NAMES.  */
+  };
+
+static struct dirlisting *take_listing (const char *name);
+static void enter_listing (struct directory_contents *dc,
+                           struct dirlisting *dl);
+static void free_listing (struct dirlisting *dl);
+#endif
+
 /* Find the directory named NAME and return its 'struct directory'.  */
 
 static struct directory *
@@ -459,6 +531,9 @@ find_directory (const char *name)
       const char *p = name + strlen (name);
       struct stat st;
       int r;
+#ifdef DIR_READ_AHEAD
+      struct dirlisting *listing = take_listing (name);
+#endif
 
       dir = xmalloc (sizeof (struct directory));
 #if defined(HAVE_CASE_INSENSITIVE_FS) && defined(VMS)
@@ -493,7 +568,15 @@ find_directory (const char *name)
         r = stat (tem, &st);
       }
 #else
-      EINTRLOOP (r, stat (name, &st));
+# ifdef DIR_READ_AHEAD
+      if (listing != 0)
+        {
+          r = listing->error != 0 ? -1 : 0;
+          st = listing->st;
+        }
+      else
+# endif
+        EINTRLOOP (r, stat (name, &st));
 #endif
 
       if (r < 0)
@@ -571,28 +654,47 @@ find_directory (const char *name)
               dc->ino = st.st_ino;
 # endif
 #endif /* WINDOWS32 */
+              dc->dirpatterns.ht_vec = 0;
+              dc->generation = file_generation;
+              dc->mtime_generation = 0;
               hash_insert_at (&directory_contents, dc, dc_slot);
-              ENULLLOOP (dc->dirstream, opendir (name));
-              if (dc->dirstream == 0)
-                /* Couldn't open the directory.  Mark this by setting the
-                   'files' member to a nil pointer.  */
-                dc->dirfiles.ht_vec = 0;
+#ifdef DIR_READ_AHEAD
+              if (listing != 0 && listing->names != 0)
+                {
+                  /* A thread has read it already.  */
+                  dc->dirstream = 0;
+                  enter_listing (dc, listing);
+                }
               else
+#endif
                 {
-                  hash_init (&dc->dirfiles, DIRFILE_BUCKETS,
-                             dirfile_hash_1, dirfile_hash_2, dirfile_hash_cmp);
-                  /* Keep track of how many directories are open.  */
-                  ++open_directories;
-                  if (open_directories == MAX_OPEN_DIRECTORIES)
-                    /* We have too many directories open already.
-                       Read the entire directory and then close it.  */
-                    dir_contents_file_exists_p (dc, 0);
+                  ENULLLOOP (dc->dirstream, opendir (name));
+                  if (dc->dirstream == 0)
+                    /* Couldn't open the directory.  Mark this by setting
+                       the 'files' member to a nil pointer.  */
+                    dc->dirfiles.ht_vec = 0;
+                  else
+                    {
+                      hash_init (&dc->dirfiles, DIRFILE_BUCKETS,
+                                 dirfile_hash_1, dirfile_hash_2,
+                                 dirfile_hash_cmp);
+                      /* Keep track of how many directories are open.  */
+                      ++open_directories;
+                      if (open_directories == MAX_OPEN_DIRECTORIES)
+                        /* We have too many directories open already.
+                           Read the entire directory and then close it.  */
+                        dir_contents_file_exists_p (dc, 0);
+                    }
                 }
             }
 
           /* Point the name-hashed entry for DIR at its contents data.  */
           dir->contents = dc;
         }
+
+#ifdef DIR_READ_AHEAD
+      free_listing (listing);
+#endif
     }
 
   return dir;
@@ -732,6 +834,7 @@ dir_contents_file_exists_p (struct directory_contents *dir,
           df->name = strcache_add_len (d->d_name, len);
 #endif
           df->length = len;
+          df->mtime = UNKNOWN_MTIME;
           df->impossible = 0;
           hash_insert_at (&dir->dirfiles, df, dirfile_slot);
         }
@@ -946,6 +1049,7 @@ file_impossible (const char *filename)
 #else
   new->name = strcache_add_len (filename, new->length);
 #endif
+  new->mtime = UNKNOWN_MTIME;
   new->impossible = 1;
   hash_insert (&dir->contents->dirfiles, new);
 }
@@ -1047,6 +1151,218 @@ file_impossible_p (const char *filename)
   return 0;
 }
 
+/* Return nonzero if no file in the directory DIRNAME can match PATTERN, a
+   file name with one % and no slashes: either there is no such directory,
+   or none of the files read from it match.  The answer is remembered for
+   each pattern, so pattern rules that cannot apply in a directory are
+   ruled out without looking for every file they would need.  */
+
+int
+dir_pattern_impossible_p (const char *dirname, const char *pattern)
+{
+#if defined(WINDOWS32) || defined(VMS) || defined(__MSDOS__) \
+    || defined(HAVE_CASE_INSENSITIVE_FS)
+  /* The directory cache can be reread or the names in it changed, so
+     it cannot answer for every name at once.  */
+  (void) dirname;
+  (void) pattern;
+  return 0;
+#else
+  struct directory_contents *dir = find_directory (dirname)->contents;
+  struct dirpattern dirpattern_key;
+  struct dirpattern **dirpattern_slot;
+  struct dirpattern *dp;
+  struct dirfile **files_slot;
+  struct dirfile **files_end;
+  const char *suffix;
+  size_t prefixlen;
+  size_t suffixlen;
+
+  if (dir == 0 || dir->dirfiles.ht_vec == 0)
+    /* The directory could not be stat'd or opened.  */
+    return 1;
+
+  if (dir->dirpatterns.ht_vec == 0)
+    hash_init (&dir->dirpatterns, DIRPATTERN_BUCKETS,
+               dirpattern_hash_1, dirpattern_hash_2, dirpattern_hash_cmp);
+
+  dirpattern_key.pattern = pattern;
+  dirpattern_slot = (struct dirpattern **)
+    hash_find_slot (&dir->dirpatterns, &dirpattern_key);
+  if (! HASH_VACANT (*dirpattern_slot))
+    return (*dirpattern_slot)->impossible;
+
+  /* Read in the rest of the directory and look at each file in it.  */
+  if (dir->dirstream != 0)
+    dir_contents_file_exists_p (dir, 0);
+
+  suffix = strchr (pattern, '%');
+  prefixlen = suffix - pattern;
+  ++suffix;
+  suffixlen = strlen (suffix);
+
+  dp = xmalloc (sizeof (struct dirpattern));
+  dp->pattern = strcache_add (pattern);
+  dp->impossible = 1;
+
+  files_slot = (struct dirfile **) dir->dirfiles.ht_vec;
+  files_end = files_slot + dir->dirfiles.ht_size;
+  for ( ; files_slot < files_end; files_slot++)
+    {
+      struct dirfile *df = *files_slot;
+      if (! HASH_VACANT (df) && ! df->impossible
+          && df->length >= prefixlen + suffixlen
+          && strneq (df->name, pattern, prefixlen)
+          && streq (df->name + df->length - suffixlen, suffix))
+        {
+          dp->impossible = 0;
+          break;
+        }
+    }
+
+  hash_insert_at (&dir->dirpatterns, dp, dirpattern_slot);
+  return dp->impossible;
+#endif
+}
+
+/* Counts the times something other than make may have changed files: each
+   recipe started or finished and each $(shell) run.  A directory listing or
+   mtimes read in an earlier generation can no longer be trusted.  */
+
+unsigned int file_generation = 1;
+
+#ifdef DIR_MTIMES
+/* Stat every file in DIR, which is named DIRNAME, relative to the directory
+   itself, and remember their mtimes.  Files whose mtimes were looked up by
+   prefetch_mtimes aren't stat'd again.  Return nonzero if that was done.  */
+
+static int
+dir_read_mtimes (struct directory_contents *dir, const char *dirname)
+{
+  struct dirfile **files_slot;
+  struct dirfile **files_end;
+  size_t dirlen = strcmp (dirname, ".") == 0 ? 0 : strlen (dirname);
+  size_t pathsize = 0;
+  char *path = 0;
+  int fd;
+
+  if (dir->generation != file_generation)
+    /* The names we have may be out of date.  */
+    return 0;
+
+  if (dir->dirstream != 0)
+    dir_contents_file_exists_p (dir, 0);
+
+  EINTRLOOP (fd, open (dirname, O_RDONLY));
+  if (fd < 0)
+    return 0;
+
+  files_slot = (struct dirfile **) dir->dirfiles.ht_vec;
+  files_end = files_slot + dir->dirfiles.ht_size;
+  for ( ; files_slot < files_end; files_slot++)
+    {
+      struct dirfile *df = *files_slot;
+      struct stat st;
+      int e;
+
+      if (HASH_VACANT (df) || df->impossible)
+        continue;
+
+      if (dirlen == 0)
+        df->mtime = prefetched_mtime (df->name);
+      else
+        {
+          if (pathsize < dirlen + df->length + 2)
+            {
+              pathsize = dirlen + df->length + 2;
+              path = xrealloc (path, pathsize);
+              memcpy (path, dirname, dirlen);
+              path[dirlen] = '/';
+            }
+          memcpy (path + dirlen + 1, df->name, df->length + 1);
+          df->mtime = prefetched_mtime (path);
+        }
+      if (df->mtime != UNKNOWN_MTIME)
+        continue;
+
+      EINTRLOOP (e, fstatat (fd, df->name, &st, 0));
+      if (e == 0)
+        df->mtime = FILE_TIMESTAMP_STAT_MODTIME (df->name, st);
+      else if (errno == ENOENT || errno == ENOTDIR)
+        df->mtime = NONEXISTENT_MTIME;
+      else
+        /* Let name_mtime report the error.  */
+        df->mtime = UNKNOWN_MTIME;
+    }
+
+  free (path);
+  close (fd);
+  dir->mtime_generation = file_generation;
+  return 1;
+}
+#endif
+
+/* Return the mtime of the file NAME from the directory cache, or
+   UNKNOWN_MTIME if it cannot tell.  If BATCH is nonzero, the first time the
+   mtime of a file in a directory that has been read completely is asked
+   for, all the files in it are stat'd together.  Their mtimes are used
+   until something else might have changed them.  */
+
+FILE_TIMESTAMP
+dir_file_mtime (const char *name, int batch)
+{
+#ifndef DIR_MTIMES
+  (void) name;
+  (void) batch;
+  return UNKNOWN_MTIME;
+#else
+  const char *base = strrchr (name, '/');
+  const char *dirname;
+  struct directory_contents *dir;
+  struct dirfile dirfile_key;
+  struct dirfile *df;
+
+  if (base == 0)
+    {
+      dirname = ".";
+      base = name;
+    }
+  else
+    {
+      if (base == name)
+        dirname = "/";
+      else
+        {
+          char *cp = alloca (base - name + 1);
+          memcpy (cp, name, base - name);
+          cp[base - name] = '\0';
+          dirname = cp;
+        }
+      ++base;
+    }
+
+  if (*base == '\0')
+    return UNKNOWN_MTIME;
+
+  dir = find_directory (dirname)->contents;
+  if (dir == 0 || dir->dirfiles.ht_vec == 0)
+    return UNKNOWN_MTIME;
+
+  if (dir->mtime_generation != file_generation
+      && (!batch || dir->mtime_generation != 0
+          || !dir_read_mtimes (dir, dirname)))
+    return UNKNOWN_MTIME;
+
+  dirfile_key.name = base;
+  dirfile_key.length = strlen (base);
+  df = hash_find_item (&dir->dirfiles, &dirfile_key);
+  if (df == 0 || df->impossible)
+    return NONEXISTENT_MTIME;
+
+  return df->mtime;
+#endif
+}
+
 /* Return the already allocated name in the
    directory hash table that matches DIR.  */
 
@@ -1187,6 +1503,8 @@ open_dirstream (const char *directory)
   struct dirstream *new;
   struct directory *dir = find_directory (directory);
 
+  dbcache_note (directory, 1);
+
   if (dir->contents == 0 || dir->contents->dirfiles.ht_vec == 0)
     /* DIR->contents is nil if the directory could not be stat'd.
        DIR->contents->dirfiles is nil if it could not be opened.  */
@@ -1325,14 +1643,376 @@ local_lstat (const char *path, struct stat *buf)
 }
 #endif
 
+/* Let the database cache know which files glob looks at.  */
+
+static int
+glob_stat (const char *path, struct stat *buf)
+{
+  dbcache_note (path, 0);
+  return local_stat (path, buf);
+}
+
+static int
+glob_lstat (const char *path, struct stat *buf)
+{
+  dbcache_note (path, 0);
+  return local_lstat (path, buf);
+}
+
 void
 dir_setup_glob (glob_t *gl)
 {
   gl->gl_opendir = open_dirstream;
   gl->gl_readdir = read_dirstream;
   gl->gl_closedir = free;
-  gl->gl_lstat = local_lstat;
-  gl->gl_stat = local_stat;
+  gl->gl_lstat = glob_lstat;
+  gl->gl_stat = glob_stat;
+}
+
+/* Results of glob.
+
+   $(wildcard) is often expanded many times with the same pattern, for
+   instance when it is in a recursive variable.  Each time, glob would
+   match the pattern against every name in the directories it looks in
+   and stat what it finds, so what it found is kept and used again until
+   something other than make may have changed the file system, that is
+   until file_generation moves on.
+
+   A pattern with wildcards in its directory part, such as one for the C
+   files in every subdirectory of src, makes glob read one directory
+   after another, each waiting for the disk in turn.  So the directories are found first, and those the directory
+   cache doesn't have yet are read by a few threads at once before glob
+   is called.  find_directory takes what they read instead of reading
+   the directories itself.  */
+
+struct globbed
+  {
+    const char *pattern;        /* The pattern, in the strcache.  */
+    unsigned int generation;    /* The file_generation of the results.  */
+    int status;                 /* What glob returned.  */
+    unsigned int count;         /* The number of names it found.  */
+    const char **names;         /* Those names, in the strcache.  */
+  };
+
+static unsigned long
+name_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (*(const char **) key);
+}
+
+static unsigned long
+name_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (*(const char **) key);
+}
+
+static int
+name_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (*(const char **) x, *(const char **) y);
+}
+
+static struct hash_table globbed_table;
+
+#ifdef DIR_READ_AHEAD
+
+/* Below this many directories it isn't worth starting threads.  */
+#define READ_AHEAD_MIN          4
+
+/* How many threads read directories.  They mostly wait, so there can be
+   more of them than there are CPUs.  */
+#define READ_AHEAD_THREADS      8
+
+static struct hash_table dir_listings;
+
+static struct dirlisting **read_ahead;
+static unsigned int read_ahead_count;
+static unsigned int read_ahead_next;
+static pthread_mutex_t read_ahead_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Read the directories in READ_AHEAD no other thread has taken.  Only
+   system calls and malloc are used here: the rest of make isn't safe to
+   call from more than one thread.  */
+
+static void *
+dir_read_worker (void *arg UNUSED)
+{
+  while (1)
+    {
+      struct dirlisting *dl;
+      struct dirent *d;
+      size_t size = 0;
+      DIR *ds;
+      int e;
+
+      pthread_mutex_lock (&read_ahead_lock);
+      dl = (read_ahead_next < read_ahead_count
+            ? read_ahead[read_ahead_next++] : 0);
+      pthread_mutex_unlock (&read_ahead_lock);
+
+      if (dl == 0)
+        break;
+
+      EINTRLOOP (e, stat (dl->name, &dl->st));
+      if (e != 0)
+        {
+          dl->error = errno;
+          continue;
+        }
+      if (!S_ISDIR (dl->st.st_mode))
+        continue;
+
+      ENULLLOOP (ds, opendir (dl->name));
+      if (ds == 0)
+        continue;
+
+      while (1)
+        {
+          size_t len;
+
+          ENULLLOOP (d, readdir (ds));
+          if (d == 0)
+            break;
+          if (!REAL_DIR_ENTRY (d))
+            continue;
+
+          len = NAMLEN (d);
+          if (dl->length + len + 1 > size)
+            {
+              char *n;
+              size = (dl->length + len + 1) * 2;
+              n = realloc (dl->names, size);
+              if (n == 0)
+                break;
+              dl->names = n;
+            }
+          memcpy (dl->names + dl->length, d->d_name, len);
+          dl->length += len;
+          dl->names[dl->length++] = '\0';
+        }
+
+      /* Let find_directory read it again if this went wrong.  */
+      if (d != 0 || errno != 0)
+        {
+          free (dl->names);
+          dl->names = 0;
+        }
+      else if (dl->names == 0)
+        /* It was empty.  */
+        dl->names = malloc (1);
+
+      closedir (ds);
+    }
+
+  return 0;
+}
+
+/* Read, with several threads, the directories that glob will open to
+   match PATTERN, if there are enough of them not yet known.  */
+
+static void
+dir_read_ahead (const char *pattern)
+{
+  const char *slash = strrchr (pattern, '/');
+  pthread_t threads[READ_AHEAD_THREADS];
+  sigset_t all, old;
+  const char **dirs;
+  unsigned int ndirs;
+  unsigned int i, n;
+  char *dirpat;
+  int status;
+
+  if (slash == 0 || slash == pattern)
+    return;
+
+  dirpat = xstrndup (pattern, slash - pattern);
+  if (strpbrk (dirpat, "?*[") == 0)
+    status = GLOB_NOMATCH;
+  else
+    status = dir_glob (dirpat, &dirs, &ndirs);
+  free (dirpat);
+  if (status != 0)
+    return;
+
+  read_ahead = xmalloc (ndirs * sizeof (struct dirlisting *));
+  read_ahead_count = read_ahead_next = 0;
+  for (i = 0; i < ndirs; ++i)
+    {
+      struct directory key;
+
+      key.name = dirs[i];
+      if (hash_find_item (&directories, &key) == 0)
+        {
+          struct dirlisting *dl = xcalloc (sizeof (struct dirlisting));
+          dl->name = dirs[i];
+          read_ahead[read_ahead_count++] = dl;
+        }
+    }
+
+  if (read_ahead_count >= READ_AHEAD_MIN)
+    {
+      n = MIN (READ_AHEAD_THREADS, read_ahead_count);
+
+      /* Leave signals to the main thread.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      for (i = 0; i < n; ++i)
+        if (pthread_create (&threads[i], NULL, dir_read_worker, NULL) != 0)
+          break;
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+      /* Whatever the threads don't get to, find_directory will.  */
+      n = i;
+      for (i = 0; i < n; ++i)
+        pthread_join (threads[i], NULL);
+
+      DB (DB_VERBOSE, (_("Read %u directories for '%s' with %u threads.\n"),
+                       read_ahead_next, pattern, n));
+
+      if (dir_listings.ht_vec == 0)
+        hash_init (&dir_listings, 64, name_hash_1, name_hash_2,
+                   name_hash_cmp);
+      for (i = 0; i < read_ahead_next; ++i)
+        hash_insert (&dir_listings, read_ahead[i]);
+      i = read_ahead_next;
+    }
+  else
+    i = 0;
+
+  for (; i < read_ahead_count; ++i)
+    free_listing (read_ahead[i]);
+  free (read_ahead);
+  read_ahead = 0;
+}
+
+/* Take what a thread read of the directory NAME, if it did.  */
+
+static struct dirlisting *
+take_listing (const char *name)
+{
+  if (dir_listings.ht_vec == 0 || dir_listings.ht_fill == 0)
+    return 0;
+
+  return hash_delete (&dir_listings, &name);
+}
+
+/* Enter the files in the directory DL into DC.  */
+
+static void
+enter_listing (struct directory_contents *dc, struct dirlisting *dl)
+{
+  const char *p = dl->names;
+  const char *end = p + dl->length;
+
+  hash_init (&dc->dirfiles, DIRFILE_BUCKETS,
+             dirfile_hash_1, dirfile_hash_2, dirfile_hash_cmp);
+
+  while (p < end)
+    {
+      unsigned int len = strlen (p);
+      struct dirfile dirfile_key;
+      struct dirfile **dirfile_slot;
+
+      dirfile_key.name = p;
+      dirfile_key.length = len;
+      dirfile_slot = (struct dirfile **) hash_find_slot (&dc->dirfiles,
+                                                         &dirfile_key);
+      if (HASH_VACANT (*dirfile_slot))
+        {
+          struct dirfile *df = xmalloc (sizeof (struct dirfile));
+          df->name = strcache_add_len (p, len);
+          df->length = len;
+          df->mtime = UNKNOWN_MTIME;
+          df->impossible = 0;
+          hash_insert_at (&dc->dirfiles, df, dirfile_slot);
+        }
+      p += len + 1;
+    }
+}
+
+static void
+free_listing (struct dirlisting *dl)
+{
+  if (dl != 0)
+    {
+      free (dl->names);
+      free (dl);
+    }
+}
+
+/* Forget the directories read ahead that glob didn't open.  */
+
+static void
+drop_listings (void)
+{
+  struct dirlisting **dlp, **end;
+
+  if (dir_listings.ht_vec == 0 || dir_listings.ht_fill == 0)
+    return;
+
+  dlp = (struct dirlisting **) dir_listings.ht_vec;
+  end = dlp + dir_listings.ht_size;
+  for (; dlp < end; ++dlp)
+    if (!HASH_VACANT (*dlp))
+      free_listing (*dlp);
+  hash_free (&dir_listings, 0);
+  dir_listings.ht_vec = 0;
+}
+
+#endif /* DIR_READ_AHEAD */
+
+/* Glob PATTERN, or take what globbing it found before if nothing may
+   have changed since.  Set *NAMESP to the names found, which are in the
+   strcache, and *COUNTP to how many there are, and return what glob
+   returned.  */
+
+int
+dir_glob (const char *pattern, const char ***namesp, unsigned int *countp)
+{
+  struct globbed **slot;
+  struct globbed *g;
+  glob_t gl;
+  unsigned int i;
+
+  if (globbed_table.ht_vec == 0)
+    hash_init (&globbed_table, 64, name_hash_1, name_hash_2, name_hash_cmp);
+
+  slot = (struct globbed **) hash_find_slot (&globbed_table, &pattern);
+  g = *slot;
+  if (HASH_VACANT (g))
+    {
+      g = xcalloc (sizeof (struct globbed));
+      g->pattern = strcache_add (pattern);
+      hash_insert_at (&globbed_table, g, slot);
+    }
+  else if (g->generation == file_generation)
+    goto done;
+
+  /* This may glob other patterns, so SLOT can't be used after it.  */
+#ifdef DIR_READ_AHEAD
+  dir_read_ahead (g->pattern);
+#endif
+
+  dir_setup_glob (&gl);
+  g->status = glob (g->pattern, GLOB_NOSORT|GLOB_ALTDIRFUNC, NULL, &gl);
+  if (g->status == GLOB_NOSPACE)
+    out_of_memory ();
+
+#ifdef DIR_READ_AHEAD
+  drop_listings ();
+#endif
+
+  g->generation = file_generation;
+  g->count = g->status == 0 ? gl.gl_pathc : 0;
+  g->names = xrealloc (g->names, (g->count + 1) * sizeof (const char *));
+  for (i = 0; i < g->count; ++i)
+    g->names[i] = strcache_add (gl.gl_pathv[i]);
+  globfree (&gl);
+
+ done:
+  *namesp = g->names;
+  *countp = g->count;
+  return g->status;
 }
 
 void
@@ -1343,4 +2023,6 @@ hash_init_directories (void)
   hash_init (&directory_contents, DIRECTORY_BUCKETS,
              directory_contents_hash_1, directory_contents_hash_2,
              directory_contents_hash_cmp);
+  profile_hash_table ("directories", &directories);
+  profile_hash_table ("directory contents", &directory_contents);
 }
@@ -23,6 +23,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "variable.h"
 #include "rule.h"
+#include "profile.h"
 
 /* Initially, any errors reported when expanding strings will be reported
    against the file where the error appears.  */
@@ -91,6 +92,7 @@ initialize_variable_output (void)
 /* Recursively expand V.  The returned string is malloc'd.  */
 
 static char *allocated_variable_append (const struct variable *v);
+static char *allocated_variable_expand_value (struct variable *v);
 
 char *
 recursively_expand_for_file (struct variable *v, struct file *file)
@@ -137,7 +139,7 @@ recursively_expand_for_file (struct variable *v, struct file *file)
   if (v->append)
     value = allocated_variable_append (v);
   else
-    value = allocated_variable_expand (v->value);
+    value = allocated_variable_expand_value (v);
   v->expanding = 0;
 
   if (set_reading)
@@ -151,19 +153,17 @@ recursively_expand_for_file (struct variable *v, struct file *file)
   return value;
 }
 
-/* Expand a simple reference to variable NAME, which is LENGTH chars long.  */
+/* Expand a reference to V, which was looked up as NAME, LENGTH chars long.  */
 
 #ifdef __GNUC__
 __inline
 #endif
 static char *
-reference_variable (char *o, const char *name, unsigned int length)
+output_variable (char *o, struct variable *v,
+                 const char *name, unsigned int length)
 {
-  struct variable *v;
   char *value;
 
-  v = lookup_variable (name, length);
-
   if (v == 0)
     warn_undefined (name, length);
 
@@ -180,6 +180,14 @@ reference_variable (char *o, const char *name, unsigned int length)
 
   return o;
 }
+
+/* Expand a simple reference to variable NAME, which is LENGTH chars long.  */
+
+static char *
+reference_variable (char *o, const char *name, unsigned int length)
+{
+  return output_variable (o, lookup_variable (name, length), name, length);
+}
 
 /* Scan STRING for variable references and expansion-function calls.  Only
    LENGTH bytes of STRING are actually scanned.  If LENGTH is -1, scan until
@@ -210,6 +218,8 @@ variable_expand_string (char *line, const char *string, long length)
       return (variable_buffer);
     }
 
+  PROFILE_ENTER (PROF_EXPAND);
+
   /* We need a copy of STRING: due to eval, it's possible that it will get
      freed as we process it (it might be the value of a variable that's reset
      for example).  Also having a nil-terminated string is handy.  */
@@ -403,6 +413,8 @@ variable_expand_string (char *line, const char *string, long length)
   free (save);
 
   variable_buffer_output (o, "", 1);
+
+  PROFILE_LEAVE (PROF_EXPAND);
   return (variable_buffer + line_offset);
 }
 
@@ -595,3 +607,393 @@ restore_variable_buffer (char *buf, unsigned int len)
   variable_buffer = buf;
   variable_buffer_length = len;
 }
+
+/* Values of recursive variables and lines of recipes are expanded again
+   and again.  The second time one is expanded, it is parsed once and for
+   all into a list of items: runs of text, references to variables named
+   ahead of time, and calls to builtin functions with their arguments
+   already split and parsed in turn.  Anything else, such as a reference
+   whose name is itself computed, is left to variable_expand_string().  */
+
+enum exp_kind
+  {
+    EXP_TEXT,                   /* Copy TEXT.  */
+    EXP_VAR,                    /* $(TEXT).  */
+    EXP_SUBST,                  /* $(TEXT:PATTERN=REPLACE).  */
+    EXP_FUNC,                   /* A builtin function call.  */
+    EXP_OTHER                   /* Expand TEXT the usual way.  */
+  };
+
+struct exp_item
+  {
+    enum exp_kind kind;
+    const char *text;           /* Points into the expansion's copy.  */
+    unsigned int len;
+    unsigned int hash;          /* Of the name, for EXP_VAR and EXP_SUBST.  */
+    struct funcall *func;       /* For EXP_FUNC.  */
+    char *pattern;              /* For EXP_SUBST, as patsubst_expand_pat()  */
+    char *replace;              /* wants them; the % we may have added  */
+    char *ppercent;             /* in front of each is at PBUF and RBUF.  */
+    char *rpercent;
+    char *pbuf;
+    char *rbuf;
+  };
+
+struct expansion
+  {
+    unsigned int refs;          /* Its owner, and any expansions of it.  */
+    unsigned int generation;    /* function_generation when parsed.  */
+    unsigned int nitems;
+    unsigned int maxitems;
+    struct exp_item *items;
+    char *text;                 /* A copy of the string it was parsed from.  */
+  };
+
+static struct exp_item *
+add_exp_item (struct expansion *e, enum exp_kind kind,
+              const char *text, unsigned int len)
+{
+  struct exp_item *it;
+
+  if (e->nitems == e->maxitems)
+    {
+      e->maxitems *= 2;
+      e->items = xrealloc (e->items, e->maxitems * sizeof (struct exp_item));
+    }
+
+  it = &e->items[e->nitems++];
+  memset (it, '\0', sizeof (struct exp_item));
+  it->kind = kind;
+  it->text = text;
+  it->len = len;
+  if (kind == EXP_VAR || kind == EXP_SUBST)
+    it->hash = variable_name_hash (text, len);
+
+  return it;
+}
+
+/* Parse STRING, LENGTH chars long, for expanding it later with
+   expand_compiled().  Return 0 if it can't be parsed ahead of time, say
+   because it has an unterminated reference: variable_expand_string()
+   reports those when it reaches them.  */
+
+struct expansion *
+compile_expansion (const char *string, unsigned int length)
+{
+  struct expansion *e = xmalloc (sizeof (struct expansion));
+  const char *p;
+
+  e->refs = 1;
+  e->generation = function_generation;
+  e->nitems = 0;
+  e->maxitems = 4;
+  e->items = xmalloc (e->maxitems * sizeof (struct exp_item));
+  e->text = xstrndup (string, length);
+
+  p = e->text;
+  while (1)
+    {
+      const char *p1 = strchr (p, '$');
+
+      if (p1 == 0)
+        {
+          if (*p != '\0')
+            add_exp_item (e, EXP_TEXT, p, strlen (p));
+          break;
+        }
+
+      /* $$ or $ at the end of the string is a $: keep it with the text
+         before it.  */
+      if (p1[1] == '$' || p1[1] == '\0')
+        {
+          add_exp_item (e, EXP_TEXT, p, p1 - p + 1);
+          if (p1[1] == '\0')
+            break;
+          p = p1 + 2;
+          continue;
+        }
+
+      if (p1 > p)
+        add_exp_item (e, EXP_TEXT, p, p1 - p);
+      p = p1 + 1;
+
+      if (*p == '(' || *p == '{')
+        {
+          char openparen = *p;
+          char closeparen = openparen == '(' ? ')' : '}';
+          const char *beg = p + 1;
+          const char *end;
+          const char *colon;
+          const char *subst_end;
+          struct funcall *fc;
+
+          switch (compile_function (&p, &fc))
+            {
+            case 1:
+              add_exp_item (e, EXP_FUNC, p1, p - p1 + 1)->func = fc;
+              ++p;
+              continue;
+            case -1:
+              free_expansion (e);
+              return 0;
+            }
+
+          end = strchr (beg, closeparen);
+          if (end == 0)
+            {
+              free_expansion (e);
+              return 0;
+            }
+
+          if (lindex (beg, end, '$') != 0)
+            {
+              /* The name is computed; find the matching paren or brace
+                 the way variable_expand_string() does.  */
+              int count = 0;
+              for (p = beg; *p != '\0'; ++p)
+                if (*p == openparen)
+                  ++count;
+                else if (*p == closeparen && --count < 0)
+                  break;
+              if (count >= 0)
+                {
+                  free_expansion (e);
+                  return 0;
+                }
+              add_exp_item (e, EXP_OTHER, p1, p - p1 + 1);
+              ++p;
+              continue;
+            }
+
+          colon = lindex (beg, end, ':');
+          subst_end = colon ? lindex (colon + 1, end, '=') : 0;
+          if (subst_end == 0)
+            add_exp_item (e, EXP_VAR, beg, end - beg);
+          else
+            {
+              struct exp_item *it;
+              unsigned int plen = subst_end - (colon + 1);
+              unsigned int rlen = end - (subst_end + 1);
+
+              it = add_exp_item (e, EXP_SUBST, beg, colon - beg);
+              it->pbuf = xmalloc (plen + 2);
+              it->pbuf[0] = '%';
+              memcpy (it->pbuf + 1, colon + 1, plen);
+              it->pbuf[plen + 1] = '\0';
+              it->rbuf = xmalloc (rlen + 2);
+              it->rbuf[0] = '%';
+              memcpy (it->rbuf + 1, subst_end + 1, rlen);
+              it->rbuf[rlen + 1] = '\0';
+
+              it->pattern = it->pbuf + 1;
+              it->replace = it->rbuf + 1;
+              it->ppercent = find_percent (it->pattern);
+              if (it->ppercent)
+                {
+                  ++it->ppercent;
+                  it->rpercent = find_percent (it->replace);
+                  if (it->rpercent)
+                    ++it->rpercent;
+                }
+              else
+                {
+                  it->ppercent = it->pattern;
+                  it->rpercent = it->replace;
+                  it->pattern = it->pbuf;
+                  it->replace = it->rbuf;
+                }
+            }
+          p = end + 1;
+        }
+      else
+        {
+          /* $a is equivalent to $(a).  */
+          add_exp_item (e, EXP_VAR, p, 1);
+          ++p;
+        }
+    }
+
+  return e;
+}
+
+/* Drop a reference to E, freeing it if that was the last.  */
+
+void
+free_expansion (struct expansion *e)
+{
+  unsigned int i;
+
+  if (e == 0 || --e->refs > 0)
+    return;
+
+  for (i = 0; i < e->nitems; ++i)
+    {
+      struct exp_item *it = &e->items[i];
+      if (it->func)
+        free_funcall (it->func);
+      free (it->pbuf);
+      free (it->rbuf);
+    }
+  free (e->items);
+  free (e->text);
+  free (e);
+}
+
+/* Expand E into the variable buffer at O, like variable_expand_string()
+   would expand the string it was parsed from.  Return the end of the
+   output, which isn't null-terminated.  */
+
+char *
+expand_compiled (char *o, struct expansion *e)
+{
+  unsigned int i;
+
+  PROFILE_ENTER (PROF_EXPAND);
+
+  /* Hold on to E: an $(eval ...) could redefine the variable it came
+     from while we're expanding it.  */
+  ++e->refs;
+
+  for (i = 0; i < e->nitems; ++i)
+    {
+      const struct exp_item *it = &e->items[i];
+      struct variable *v;
+
+      switch (it->kind)
+        {
+        case EXP_TEXT:
+          o = variable_buffer_output (o, it->text, it->len);
+          break;
+
+        case EXP_VAR:
+          v = lookup_variable_hashed (it->text, it->len, it->hash);
+          o = output_variable (o, v, it->text, it->len);
+          break;
+
+        case EXP_SUBST:
+          v = lookup_variable_hashed (it->text, it->len, it->hash);
+          if (v == 0)
+            warn_undefined (it->text, it->len);
+          if (v != 0 && *v->value != '\0')
+            {
+              char *value = v->recursive ? recursively_expand (v) : v->value;
+              o = patsubst_expand_pat (o, value, it->pattern, it->replace,
+                                       it->ppercent, it->rpercent);
+              if (v->recursive)
+                free (value);
+            }
+          break;
+
+        case EXP_FUNC:
+          o = expand_funcall (o, it->func);
+          break;
+
+        case EXP_OTHER:
+          {
+            unsigned int offset = o - variable_buffer;
+            o = variable_expand_string (o, it->text, it->len);
+            o = variable_buffer + offset + strlen (o);
+          }
+          break;
+        }
+    }
+
+  free_expansion (e);
+
+  PROFILE_LEAVE (PROF_EXPAND);
+  return o;
+}
+
+/* Expand E into a malloc'd string, like allocated_variable_expand().  */
+
+char *
+allocated_expand_compiled (struct expansion *e)
+{
+  char *value;
+  char *o;
+
+  char *obuf = variable_buffer;
+  unsigned int olen = variable_buffer_length;
+
+  variable_buffer = 0;
+
+  /* Like variable_expand_string(), end with two nuls: some functions,
+     such as func_sort(), look past the first.  */
+  o = expand_compiled (initialize_variable_output (), e);
+  variable_buffer_output (o, "\0", 2);
+  value = variable_buffer;
+
+  variable_buffer = obuf;
+  variable_buffer_length = olen;
+
+  return value;
+}
+
+/* Like allocated_variable_expand_for_file, for E.  */
+
+char *
+allocated_expand_compiled_for_file (struct expansion *e, struct file *file)
+{
+  char *result;
+  struct variable_set_list *savev;
+  const floc *savef;
+
+  savev = current_variable_set_list;
+  current_variable_set_list = file->variables;
+
+  savef = reading_file;
+  if (file->cmds && file->cmds->fileinfo.filenm)
+    reading_file = &file->cmds->fileinfo;
+  else
+    reading_file = 0;
+
+  result = allocated_expand_compiled (e);
+
+  current_variable_set_list = savev;
+  reading_file = savef;
+
+  return result;
+}
+
+/* Return nonzero if E was parsed with the builtin functions as they are.  */
+
+int
+compiled_is_current (const struct expansion *e)
+{
+  return e->generation == function_generation;
+}
+
+/* Forget the parsed value of V, when V is redefined.  */
+
+void
+uncompile_variable (struct variable *v)
+{
+  free_expansion (v->compiled);
+  v->compiled = 0;
+  v->expanded = 0;
+}
+
+/* Expand the value of the recursive variable V into a malloc'd string.
+   The second time it is expanded, parse it for next time.  */
+
+static char *
+allocated_variable_expand_value (struct variable *v)
+{
+  if (v->compiled != 0 && !compiled_is_current (v->compiled))
+    uncompile_variable (v);
+
+  if (v->compiled == 0)
+    {
+      if (!v->expanded)
+        {
+          v->expanded = 1;
+          return allocated_variable_expand (v->value);
+        }
+
+      v->compiled = compile_expansion (v->value, strlen (v->value));
+      if (v->compiled == 0)
+        return allocated_variable_expand (v->value);
+    }
+
+  return allocated_expand_compiled (v->compiled);
+}
@@ -23,44 +23,26 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 struct file
   {
+    /* The members used each time the graph of dependencies is walked come
+       first: on most hosts they fill a single cache line, so checking a
+       file that needs no work touches only that line.  */
+
     const char *name;
     const char *hname;          /* Hashed filename */
-    const char *vpath;          /* VPATH/vpath pathname */
     struct dep *deps;           /* all dependencies, including duplicates */
-    struct commands *cmds;      /* Commands to execute for this target.  */
-    const char *stem;           /* Implicit stem, if an implicit
-                                   rule has been used */
-    struct dep *also_make;      /* Targets that are made by making this.  */
-    struct file *prev;          /* Previous entry for same file name;
-                                   used when there are multiple double-colon
-                                   entries for the same file.  */
-    struct file *last;          /* Last entry for the same file name.  */
 
     /* File that this file was renamed to.  After any time that a
        file could be renamed, call 'check_renamed' (below).  */
     struct file *renamed;
 
-    /* List of variable sets used for this file.  */
-    struct variable_set_list *variables;
-
-    /* Pattern-specific variable reference for this target, or null if there
-       isn't one.  Also see the pat_searched flag, below.  */
-    struct variable_set_list *pat_variables;
-
-    /* Immediate dependent that caused this target to be remade,
-       or nil if there isn't one.  */
-    struct file *parent;
-
     /* For a double-colon entry, this is the first double-colon entry for
        the same file.  Otherwise this is null.  */
     struct file *double_colon;
 
+    struct commands *cmds;      /* Commands to execute for this target.  */
     FILE_TIMESTAMP last_mtime;  /* File's modtime, if already known.  */
-    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
-                                           has been performed.  */
     unsigned int considered;    /* equal to 'considered' if file has been
                                    considered on current scan of goal chain */
-    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
     enum update_status          /* Status of the last attempt to update.  */
       {
         us_success = 0,         /* Successfully updated.  Must be 0!  */
@@ -100,6 +82,33 @@ struct file
                                    pattern-specific variables.  */
     unsigned int no_diag:1;     /* True if the file failed to update and no
                                    diagnostics has been issued (dontcare). */
+
+    /* The rest are only needed when the file is remade, or not at all
+       while walking the graph.  */
+
+    const char *vpath;          /* VPATH/vpath pathname */
+    const char *stem;           /* Implicit stem, if an implicit
+                                   rule has been used */
+    struct dep *also_make;      /* Targets that are made by making this.  */
+    struct file *prev;          /* Previous entry for same file name;
+                                   used when there are multiple double-colon
+                                   entries for the same file.  */
+    struct file *last;          /* Last entry for the same file name.  */
+
+    /* List of variable sets used for this file.  */
+    struct variable_set_list *variables;
+
+    /* Pattern-specific variable reference for this target, or null if there
+       isn't one.  Also see the pat_searched flag, above.  */
+    struct variable_set_list *pat_variables;
+
+    /* Immediate dependent that caused this target to be remade,
+       or nil if there isn't one.  */
+    struct file *parent;
+
+    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
+                                           has been performed.  */
+    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
   };
 
 
@@ -121,6 +130,7 @@ void verify_file_data_base (void);
 char *build_target_list (char *old_list);
 void print_prereqs (const struct dep *deps);
 void print_file_data_base (void);
+void map_files (void (*fn) (const void *, void *), void *arg);
 int try_implicit_rule (struct file *file, unsigned int depth);
 int stemlen_compare (const void *v1, const void *v2);
 
@@ -164,6 +174,10 @@ int stemlen_compare (const void *v1, const void *v2);
    + 1 + 1 + 4 + 25)
 
 FILE_TIMESTAMP file_timestamp_cons (char const *, time_t, long int);
+FILE_TIMESTAMP dir_file_mtime (const char *, int);
+void prefetch_mtimes (void);
+FILE_TIMESTAMP prefetched_mtime (const char *);
+int watch_changes (void);
 FILE_TIMESTAMP file_timestamp_now (int *);
 void file_timestamp_sprintf (char *p, FILE_TIMESTAMP ts);
 
@@ -22,6 +22,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "os.h"
 #include "commands.h"
 #include "debug.h"
+#include "dbcache.h"
 
 #ifdef _AMIGA
 #include "amiga.h"
@@ -68,6 +69,11 @@ function_table_entry_hash_cmp (const void *xv, const void *yv)
 }
 
 static struct hash_table function_table;
+
+/* Changed whenever a function is defined, so that what was parsed with
+   compile_expansion() can be parsed again.  */
+
+unsigned int function_generation = 0;
 
 
 /* Store into VARIABLE_BUFFER at O the result of scanning TEXT and replacing
@@ -390,7 +396,7 @@ string_glob (char *line)
 
       /* Because we used PARSEFS_NOCACHE above, we have to free() NAME.  */
       free ((char *)chain->name);
-      free (chain);
+      free_ns (chain);
       chain = next;
     }
 
@@ -1460,6 +1466,7 @@ fold_newlines (char *buffer, unsigned int *length, int trim_newlines)
 
 pid_t shell_function_pid = 0;
 static int shell_function_completed;
+static int shell_function_status;
 
 void
 shell_completed (int exit_code, int exit_sig)
@@ -1475,6 +1482,7 @@ shell_completed (int exit_code, int exit_sig)
   if (exit_code == 0 && exit_sig > 0)
     exit_code = 128 + exit_sig;
 
+  shell_function_status = exit_code;
   sprintf (buf, "%d", exit_code);
   define_variable_cname (".SHELLSTATUS", buf, o_override, 0);
 }
@@ -1703,6 +1711,23 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   char **envp;
   int pipedes[2];
   pid_t pid;
+  const char *cached;
+  size_t cached_len;
+
+  /* Under .SHELL_CACHE, a command that succeeded before isn't run again.  */
+  cached = shellcache_lookup (argv[0], &cached_len);
+  if (cached)
+    {
+      char *buffer = xmalloc (cached_len + 1);
+      unsigned int i = (unsigned int) cached_len;
+
+      memcpy (buffer, cached, cached_len + 1);
+      fold_newlines (buffer, &i, trim_newlines);
+      o = variable_buffer_output (o, buffer, i);
+      free (buffer);
+      define_variable_cname (".SHELLSTATUS", "0", o_override, 0);
+      return o;
+    }
 
 #ifndef __MSDOS__
 #ifdef WINDOWS32
@@ -1756,6 +1781,9 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   errfd = (output_context && output_context->err >= 0
            ? output_context->err : FD_STDERR);
 
+  /* The command may change any file.  */
+  ++file_generation;
+
 #if defined(__MSDOS__)
   fpipe = msdos_openpipe (pipedes, &pid, argv[0]);
   if (pipedes[0] < 0)
@@ -1885,6 +1913,8 @@ func_shell_base (char *o, char **argv, int trim_newlines)
       {
         /* The child finished normally.  Replace all newlines in its output
            with spaces, and put that in the variable output buffer.  */
+        if (shell_function_status == 0)
+          shellcache_store (argv[0], buffer, i);
         fold_newlines (buffer, &i, trim_newlines);
         o = variable_buffer_output (o, buffer, i);
       }
@@ -1986,6 +2016,7 @@ func_shell_base (char *o, char **argv, int trim_newlines)
 static char *
 func_shell (char *o, char **argv, const char *funcname UNUSED)
 {
+  dbcache_disable (_("$(shell ...) was used"));
   return func_shell_base (o, argv, 1);
 }
 #endif  /* !VMS */
@@ -2171,6 +2202,7 @@ func_realpath (char *o, char **argv, const char *funcname UNUSED)
 
           strncpy (in, path, len);
           in[len] = '\0';
+          dbcache_note (in, 0);
 
 #ifdef HAVE_REALPATH
           ENULLLOOP (rp, realpath (in, out));
@@ -2221,6 +2253,7 @@ func_file (char *o, char **argv, const char *funcname UNUSED)
       if (fn[0] == '\0')
         O (fatal, *expanding_var, _("file: missing filename"));
 
+      dbcache_disable (_("$(file >...) was used"));
       ENULLLOOP (fp, _fopen (fn, mode));
       if (fp == NULL)
         OSS (fatal, reading_file, _("open: %s: %s"), fn, strerror (errno));
@@ -2235,6 +2268,9 @@ func_file (char *o, char **argv, const char *funcname UNUSED)
         }
       if (_fclose (fp))
         OSS (fatal, reading_file, _("close: %s: %s"), fn, strerror (errno));
+
+      /* What $(wildcard) found before may not be so any more.  */
+      ++file_generation;
     }
   else if (fn[0] == '<')
     {
@@ -2249,6 +2285,7 @@ func_file (char *o, char **argv, const char *funcname UNUSED)
       if (argv[1])
         O (fatal, *expanding_var, _("file: too many arguments"));
 
+      dbcache_note (fn, 0);
       ENULLLOOP (fp, _fopen (fn, "r"));
       if (fp == NULL)
         {
@@ -2544,6 +2581,149 @@ handle_function (char **op, const char **stringp)
 
   return 1;
 }
+
+/* A builtin function call, parsed by compile_function().  */
+
+struct funcall
+  {
+    const struct function_table_entry *entry;
+    int nargs;
+    struct expansion **args;    /* Each argument, if they're expanded.  */
+    char *text;                 /* If not, the arguments, null-separated.  */
+    unsigned int len;           /* Length of TEXT.  */
+  };
+
+/* Like handle_function(), but parse the function invocation at *STRINGP
+   into *FCP rather than expanding it.  Return 1 if there is one, leaving
+   *STRINGP at its closing paren or brace; 0 if there isn't; or -1 if it
+   can't be parsed ahead of time.  */
+
+int
+compile_function (const char **stringp, struct funcall **fcp)
+{
+  const struct function_table_entry *entry_p;
+  char openparen = (*stringp)[0];
+  char closeparen = openparen == '(' ? ')' : '}';
+  const char *beg;
+  const char *end;
+  struct funcall *fc;
+  char *p, *aend;
+  int count = 0;
+  int nargs;
+
+  beg = *stringp + 1;
+
+  entry_p = lookup_function (beg);
+
+  if (!entry_p)
+    return 0;
+
+  beg += entry_p->len;
+  NEXT_TOKEN (beg);
+
+  for (end = beg; *end != '\0'; ++end)
+    if (!STOP_SET (*end, MAP_VARSEP|MAP_COMMA))
+      continue;
+    else if (*end == openparen)
+      ++count;
+    else if (*end == closeparen && --count < 0)
+      break;
+
+  /* Leave an unterminated call for handle_function() to complain about.  */
+  if (count >= 0)
+    return -1;
+
+  *stringp = end;
+
+  fc = xmalloc (sizeof (struct funcall));
+  fc->entry = entry_p;
+  fc->args = 0;
+  fc->len = end - beg;
+  fc->text = xstrndup (beg, fc->len);
+
+  /* Chop the arguments as handle_function() does.  */
+  aend = fc->text + fc->len;
+  for (p = fc->text, nargs = 0; p <= aend; )
+    {
+      char *next;
+
+      ++nargs;
+
+      if (nargs == entry_p->maximum_args
+          || (! (next = find_next_argument (openparen, closeparen, p, aend))))
+        next = aend;
+
+      *next = '\0';
+      p = next + 1;
+    }
+  fc->nargs = nargs;
+
+  if (entry_p->expand_args)
+    {
+      int i;
+
+      fc->args = xcalloc (nargs * sizeof (struct expansion *));
+      for (i = 0, p = fc->text; i < nargs; ++i, p += strlen (p) + 1)
+        {
+          fc->args[i] = compile_expansion (p, strlen (p));
+          if (fc->args[i] == 0)
+            {
+              free_funcall (fc);
+              return -1;
+            }
+        }
+    }
+
+  *fcp = fc;
+  return 1;
+}
+
+/* Expand the function call FC into the buffer at O, as handle_function()
+   would.  Return the end of the output.  */
+
+char *
+expand_funcall (char *o, const struct funcall *fc)
+{
+  char **argv = alloca (sizeof (char *) * (fc->nargs + 1));
+  char *abeg = NULL;
+  int i;
+
+  if (fc->entry->expand_args)
+    for (i = 0; i < fc->nargs; ++i)
+      argv[i] = allocated_expand_compiled (fc->args[i]);
+  else
+    {
+      char *p = abeg = xmalloc (fc->len + 1);
+      memcpy (abeg, fc->text, fc->len + 1);
+      for (i = 0; i < fc->nargs; ++i, p += strlen (p) + 1)
+        argv[i] = p;
+    }
+  argv[fc->nargs] = NULL;
+
+  o = expand_builtin_function (o, fc->nargs, argv, fc->entry);
+
+  if (fc->entry->expand_args)
+    for (i = 0; i < fc->nargs; ++i)
+      free (argv[i]);
+  else
+    free (abeg);
+
+  return o;
+}
+
+void
+free_funcall (struct funcall *fc)
+{
+  if (fc->args)
+    {
+      int i;
+      for (i = 0; i < fc->nargs; ++i)
+        free_expansion (fc->args[i]);
+      free (fc->args);
+    }
+  free (fc->text);
+  free (fc);
+}
 
 
 /* User-defined functions.  Expand the first argument as either a builtin
@@ -2678,6 +2858,9 @@ define_new_function (const floc *flocp, const char *name,
   ent->fptr.alloc_func_ptr = func;
 
   hash_insert (&function_table, ent);
+
+  /* Anything parsed before might have a call to it.  */
+  ++function_generation;
 }
 
 void
@@ -24,6 +24,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "filedef.h"
 #include "dep.h"
 #include "variable.h"
+#include "dbcache.h"
 
 #include <libguile.h>
 
@@ -122,6 +123,8 @@ func_guile (const char *funcname UNUSED, unsigned int argc UNUSED, char **argv)
 {
   static int init = 0;
 
+  dbcache_disable (_("$(guile ...) was used"));
+
   if (! init)
     {
       /* Initialize the Guile interpreter.  */
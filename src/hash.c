@@ -30,7 +30,12 @@ static unsigned long round_up_2 __P((unsigned long rough));
    is forced to return an odd-value, in order to be relatively prime
    to the table size.  This guarantees that the increment can
    potentially hit every slot in the table during collision
-   resolution.  */
+   resolution.
+
+   The primary hash of the item in each slot is kept in a parallel
+   vector, 'ht_hashes'.  A probe only looks at the item itself, and
+   calls the comparison function, when the hashes are equal; and the
+   table can grow without hashing every item again.  */
 
 void *hash_deleted_item = &hash_deleted_item;
 
@@ -50,6 +55,8 @@ hash_init (struct hash_table *ht, unsigned long size,
 	       ht->ht_size * (unsigned long) sizeof (struct token *));
       exit (MAKE_TROUBLE);
     }
+  ht->ht_hashes = MALLOC (unsigned int, ht->ht_size);
+  ht->ht_last_slot = 0;
 
   ht->ht_capacity = ht->ht_size - (ht->ht_size / 16); /* 93.75% loading factor */
   ht->ht_fill = 0;
@@ -82,11 +89,21 @@ hash_load (struct hash_table *ht, void *item_table,
 
 void **
 hash_find_slot (struct hash_table *ht, const void *key)
+{
+  return hash_find_slot_hashed (ht, key, (*ht->ht_hash_1) (key));
+}
+
+/* Like hash_find_slot, for a caller that already knows HASH, the primary
+   hash of 'key'.  */
+
+void **
+hash_find_slot_hashed (struct hash_table *ht, const void *key,
+                       unsigned int hash)
 {
   void **slot;
   void **deleted_slot = 0;
   unsigned int hash_2 = 0;
-  unsigned int hash_1 = (*ht->ht_hash_1) (key);
+  unsigned int hash_1 = hash;
 
   ht->ht_lookups++;
   for (;;)
@@ -95,7 +112,11 @@ hash_find_slot (struct hash_table *ht, const void *key)
       slot = &ht->ht_vec[hash_1];
 
       if (*slot == 0)
-	return (deleted_slot ? deleted_slot : slot);
+	{
+	  if (deleted_slot)
+	    slot = deleted_slot;
+	  break;
+	}
       if (*slot == hash_deleted_item)
 	{
 	  if (deleted_slot == 0)
@@ -104,15 +125,45 @@ hash_find_slot (struct hash_table *ht, const void *key)
       else
 	{
 	  if (key == *slot)
-	    return slot;
-	  if ((*ht->ht_compare) (key, *slot) == 0)
-	    return slot;
+	    break;
+	  if (ht->ht_hashes[hash_1] == hash
+	      && (*ht->ht_compare) (key, *slot) == 0)
+	    break;
 	  ht->ht_collisions++;
 	}
       if (!hash_2)
 	  hash_2 = (*ht->ht_hash_2) (key) | 1;
       hash_1 += hash_2;
     }
+
+  /* Remember the hash in case the caller inserts into this slot.  */
+  ht->ht_last_slot = slot;
+  ht->ht_last_hash = hash;
+  return slot;
+}
+
+/* Return the empty slot where ITEM, whose primary hash is HASH, goes in
+   a table being rebuilt: it has no deleted slots, and ITEM isn't in it.  */
+
+static void **
+hash_find_empty_slot (struct hash_table *ht, const void *item,
+                      unsigned int hash)
+{
+  unsigned int hash_2 = 0;
+  unsigned int hash_1 = hash;
+
+  for (;;)
+    {
+      hash_1 &= (ht->ht_size - 1);
+      if (ht->ht_vec[hash_1] == 0)
+	{
+	  ht->ht_hashes[hash_1] = hash;
+	  return &ht->ht_vec[hash_1];
+	}
+      if (!hash_2)
+	  hash_2 = (*ht->ht_hash_2) (item) | 1;
+      hash_1 += hash_2;
+    }
 }
 
 void *
@@ -122,6 +173,14 @@ hash_find_item (struct hash_table *ht, const void *key)
   return ((HASH_VACANT (*slot)) ? 0 : *slot);
 }
 
+void *
+hash_find_item_hashed (struct hash_table *ht, const void *key,
+                       unsigned int hash)
+{
+  void **slot = hash_find_slot_hashed (ht, key, hash);
+  return ((HASH_VACANT (*slot)) ? 0 : *slot);
+}
+
 void *
 hash_insert (struct hash_table *ht, const void *item)
 {
@@ -131,10 +190,15 @@ hash_insert (struct hash_table *ht, const void *item)
   return (void *)((HASH_VACANT (old_item)) ? 0 : old_item);
 }
 
+/* Put ITEM in SLOT, which the last call of hash_find_slot on HT returned
+   for ITEM's key.  */
+
 void *
 hash_insert_at (struct hash_table *ht, const void *item, const void *slot)
 {
   const void *old_item = *(void **) slot;
+  unsigned long i = (void **) slot - ht->ht_vec;
+
   if (HASH_VACANT (old_item))
     {
       ht->ht_fill++;
@@ -143,6 +207,10 @@ hash_insert_at (struct hash_table *ht, const void *item, const void *slot)
       old_item = item;
     }
   *(void const **) slot = item;
+  if (slot == ht->ht_last_slot)
+    ht->ht_hashes[i] = ht->ht_last_hash;
+  else
+    ht->ht_hashes[i] = (*ht->ht_hash_1) (item);
   if (ht->ht_empty_slots < ht->ht_size - ht->ht_capacity)
     {
       hash_rehash (ht);
@@ -214,7 +282,10 @@ hash_free (struct hash_table *ht, int free_items)
       ht->ht_empty_slots = ht->ht_size;
     }
   free (ht->ht_vec);
+  free (ht->ht_hashes);
   ht->ht_vec = 0;
+  ht->ht_hashes = 0;
+  ht->ht_last_slot = 0;
   ht->ht_capacity = 0;
 }
 
@@ -251,7 +322,8 @@ hash_rehash (struct hash_table *ht)
 {
   unsigned long old_ht_size = ht->ht_size;
   void **old_vec = ht->ht_vec;
-  void **ovp;
+  unsigned int *old_hashes = ht->ht_hashes;
+  unsigned long i;
 
   if (ht->ht_fill >= ht->ht_capacity)
     {
@@ -260,17 +332,20 @@ hash_rehash (struct hash_table *ht)
     }
   ht->ht_rehashes++;
   ht->ht_vec = (void **) CALLOC (struct token *, ht->ht_size);
+  ht->ht_hashes = MALLOC (unsigned int, ht->ht_size);
+  ht->ht_last_slot = 0;
 
-  for (ovp = old_vec; ovp < &old_vec[old_ht_size]; ovp++)
+  for (i = 0; i < old_ht_size; i++)
     {
-      if (! HASH_VACANT (*ovp))
+      if (! HASH_VACANT (old_vec[i]))
 	{
-	  void **slot = hash_find_slot (ht, *ovp);
-	  *slot = *ovp;
+	  void **slot = hash_find_empty_slot (ht, old_vec[i], old_hashes[i]);
+	  *slot = old_vec[i];
 	}
     }
   ht->ht_empty_slots = ht->ht_size - ht->ht_fill;
   free (old_vec);
+  free (old_hashes);
 }
 
 void
@@ -328,150 +403,58 @@ round_up_2 (unsigned long n)
   return n + 1;
 }
 
-#define rol32(v, n) \
-	((v) << (n) | ((v) >> (32 - (n))))
-
-/* jhash_mix -- mix 3 32-bit values reversibly. */
-#define jhash_mix(a, b, c)                      \
-{                                               \
-        a -= c;  a ^= rol32(c, 4);  c += b;     \
-        b -= a;  b ^= rol32(a, 6);  a += c;     \
-        c -= b;  c ^= rol32(b, 8);  b += a;     \
-        a -= c;  a ^= rol32(c, 16); c += b;     \
-        b -= a;  b ^= rol32(a, 19); a += c;     \
-        c -= b;  c ^= rol32(b, 4);  b += a;     \
-}
-
-/* jhash_final - final mixing of 3 32-bit values (a,b,c) into c */
-#define jhash_final(a, b, c)                    \
-{                                               \
-        c ^= b; c -= rol32(b, 14);              \
-        a ^= c; a -= rol32(c, 11);              \
-        b ^= a; b -= rol32(a, 25);              \
-        c ^= b; c -= rol32(b, 16);              \
-        a ^= c; a -= rol32(c, 4);               \
-        b ^= a; b -= rol32(a, 14);              \
-        c ^= b; c -= rol32(b, 24);              \
-}
-
-/* An arbitrary initial parameter */
-#define JHASH_INITVAL           0xdeadbeef
+/* Hash the LEN bytes at KEY a word at a time: each word is folded into
+   the state with a rotate, xor and multiply, then the state is mixed so
+   that the low bits used to index the table depend on all of the key.
+   A partial last word is read as the word ending at the end of the key,
+   overlapping the one before, so there's no byte loop unless the whole
+   key is shorter than a word.  */
+
+#if defined(ULONG_MAX) && ULONG_MAX > 4294967295UL
+typedef unsigned long hash_word_t;
+# define HASH_WORD_BITS 64
+# define HASH_MULTIPLIER 0x9e3779b97f4a7c15UL
+#else
+typedef unsigned int hash_word_t;
+# define HASH_WORD_BITS 32
+# define HASH_MULTIPLIER 0x9e3779b9U
+#endif
 
-#define sum_get_unaligned_32(r, p)              \
-  do {                                          \
-    unsigned int val;                           \
-    memcpy(&val, (p), 4);                       \
-    r += val;                                   \
-  } while(0);
+#define hash_mix(h, w) \
+	((h) = (((h) << 5 | (h) >> (HASH_WORD_BITS - 5)) ^ (w)) * HASH_MULTIPLIER)
 
-unsigned jhash(unsigned const char *k, int length)
+unsigned
+hash_string (const char *key, unsigned int len)
 {
-  unsigned int a, b, c;
-
-  /* Set up the internal state */
-  a = b = c = JHASH_INITVAL + length;
-
-  /* All but the last block: affect some 32 bits of (a,b,c) */
-  while (length > 12) {
-    sum_get_unaligned_32(a, k);
-    sum_get_unaligned_32(b, k + 4);
-    sum_get_unaligned_32(c, k + 8);
-    jhash_mix(a, b, c);
-    length -= 12;
-    k += 12;
-  }
+  hash_word_t h = len;
+  hash_word_t w;
+  const char *end = key + len;
 
-  if (!length)
-    return c;
-
-  if (length > 8)
+  if (len < sizeof (w))
     {
-      sum_get_unaligned_32(a, k);
-      length -= 4;
-      k += 4;
+      w = 0;
+      while (key < end)
+        w = w << 8 | (unsigned char) *--end;
+      hash_mix (h, w);
     }
-  if (length > 4)
+  else
     {
-      sum_get_unaligned_32(b, k);
-      length -= 4;
-      k += 4;
+      while (len >= sizeof (w))
+        {
+          memcpy (&w, key, sizeof (w));
+          hash_mix (h, w);
+          key += sizeof (w);
+          len -= sizeof (w);
+        }
+      if (len > 0)
+        {
+          memcpy (&w, end - sizeof (w), sizeof (w));
+          hash_mix (h, w);
+        }
     }
 
-  if (length == 4)
-    c += (unsigned)k[3]<<24;
-  if (length >= 3)
-    c += (unsigned)k[2]<<16;
-  if (length >= 2)
-    c += (unsigned)k[1]<<8;
-  c += k[0];
-  jhash_final(a, b, c);
-  return c;
-}
-
-#ifdef WORDS_BIGENDIAN
-/* The ifs are ordered from the first byte in memory to the last.  */
-#define sum_up_to_nul(r, p, flag)         \
-  do {                                    \
-    unsigned int val;                     \
-    memcpy(&val, (p), 4);                 \
-    if ((val & 0xFF000000) == 0)          \
-      flag = 1;                           \
-    else if ((val & 0xFF0000) == 0)       \
-      r += val & ~0xFFFF, flag = 1;       \
-    else if ((val & 0xFF00) == 0)         \
-      r += val & ~0xFF, flag = 1;         \
-    else                                  \
-      r += val, flag = (val & 0xFF) == 0; \
-  } while (0)
-#else
-/* First detect the presence of zeroes.  If there is none, we can
-   sum the 4 bytes directly.  Otherwise, the ifs are ordered as in the
-   big endian case, from the first byte in memory to the last.  */
-#define sum_up_to_nul(r, p, flag)                   \
-  do {                                              \
-    unsigned int val;                               \
-    unsigned int zeroes;                            \
-    memcpy(&val, (p), 4);                           \
-    zeroes = ((val - 0x01010101) & ~val);           \
-    if (!(zeroes & 0x80808080))                     \
-      r += val;                                     \
-    else if ((val & 0xFF) == 0)                     \
-      flag = 1;                                     \
-    else if ((val & 0xFF00) == 0)                   \
-      r += val & 0xFF, flag = 1;                    \
-    else if ((val & 0xFF0000) == 0)                 \
-      r += val & 0xFFFF, flag = 1;                  \
-    else                                            \
-      r += val, flag = 1;                           \
-  } while (0)
-#endif
-
-unsigned jhash_string(unsigned const char *k)
-{
-  unsigned int a, b, c;
-  unsigned int have_nul = 0;
-  unsigned const char *start = k;
-
-  /* Set up the internal state */
-  a = b = c = JHASH_INITVAL;
-
-  /* All but the last block: affect some 32 bits of (a,b,c) */
-  for (;;) {
-    sum_up_to_nul(a, k, have_nul);
-    if (have_nul)
-      break;
-    k += 4;
-    sum_up_to_nul(b, k, have_nul);
-    if (have_nul)
-      break;
-    k += 4;
-    sum_up_to_nul(c, k, have_nul);
-    if (have_nul)
-      break;
-    k += 4;
-    jhash_mix(a, b, c);
-  }
-
-  jhash_final(a, b, c);
-  return c + (k - start);
+  h ^= h >> (HASH_WORD_BITS / 2);
+  h *= HASH_MULTIPLIER;
+  h ^= h >> (HASH_WORD_BITS / 2);
+  return (unsigned) h;
 }
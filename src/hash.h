@@ -41,6 +41,9 @@ typedef void (*hash_map_arg_func_t) __P((void const *item, void *arg));
 struct hash_table
 {
   void **ht_vec;
+  unsigned int *ht_hashes;	/* primary hash of the item in each slot */
+  void **ht_last_slot;		/* slot returned by the last lookup... */
+  unsigned int ht_last_hash;	/* ...and the primary hash of its key */
   hash_func_t ht_hash_1;	/* primary hash function */
   hash_func_t ht_hash_2;	/* secondary hash function */
   hash_cmp_func_t ht_compare;	/* comparison function */
@@ -61,6 +64,10 @@ void hash_load __P((struct hash_table *ht, void *item_table,
 		    unsigned long cardinality, unsigned long size));
 void **hash_find_slot __P((struct hash_table *ht, void const *key));
 void *hash_find_item __P((struct hash_table *ht, void const *key));
+void **hash_find_slot_hashed __P((struct hash_table *ht, void const *key,
+                                  unsigned int hash));
+void *hash_find_item_hashed __P((struct hash_table *ht, void const *key,
+                                 unsigned int hash));
 void *hash_insert __P((struct hash_table *ht, const void *item));
 void *hash_insert_at __P((struct hash_table *ht, const void *item, void const *slot));
 void *hash_delete __P((struct hash_table *ht, void const *item));
@@ -73,8 +80,7 @@ void hash_map_arg __P((struct hash_table *ht, hash_map_arg_func_t map, void *arg
 void hash_print_stats __P((struct hash_table *ht, FILE *out_FILE));
 void **hash_dump __P((struct hash_table *ht, void **vector_0, qsort_cmp_t compare));
 
-extern unsigned jhash(unsigned char const *key, int n);
-extern unsigned jhash_string(unsigned char const *key);
+extern unsigned hash_string(char const *key, unsigned int n);
 
 extern void *hash_deleted_item;
 #define HASH_VACANT(item) ((item) == 0 || (void *) (item) == hash_deleted_item)
@@ -86,8 +92,8 @@ extern void *hash_deleted_item;
    be identical.  Take advantage of that to short-circuit string compares.  */
 
 #define STRING_HASH_1(KEY, RESULT) do { \
-  unsigned char const *_key_ = (unsigned char const *) (KEY); \
-  (RESULT) += jhash_string(_key_); \
+  char const *_key_ = (char const *) (KEY); \
+  (RESULT) += hash_string(_key_, strlen (_key_)); \
 } while (0)
 #define return_STRING_HASH_1(KEY) do { \
   unsigned long _result_ = 0; \
@@ -95,7 +101,7 @@ extern void *hash_deleted_item;
   return _result_; \
 } while (0)
 
-/* No need for a second hash because jhash already provides
+/* No need for a second hash because hash_string already provides
    pretty good results.  However, do evaluate the arguments
    to avoid warnings.  */
 #define STRING_HASH_2(KEY, RESULT) do { \
@@ -116,8 +122,8 @@ extern void *hash_deleted_item;
 
 
 #define STRING_N_HASH_1(KEY, N, RESULT) do { \
-  unsigned char const *_key_ = (unsigned char const *) (KEY); \
-  (RESULT) += jhash(_key_, N); \
+  char const *_key_ = (char const *) (KEY); \
+  (RESULT) += hash_string(_key_, N); \
 } while (0)
 
 #define return_STRING_N_HASH_1(KEY, N) do { \
@@ -126,7 +132,7 @@ extern void *hash_deleted_item;
   return _result_; \
 } while (0)
 
-/* No need for a second hash because jhash already provides
+/* No need for a second hash because hash_string already provides
    pretty good results.  However, do evaluate the arguments
    to avoid warnings.  */
 #define STRING_N_HASH_2(KEY, N, RESULT) do { \
@@ -22,6 +22,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "variable.h"
 #include "job.h"      /* struct child, used inside commands.h */
 #include "commands.h" /* set_file_variables */
+#include "profile.h"
 
 static int pattern_search (struct file *file, int archive,
                            unsigned int depth, unsigned int recursions);
@@ -183,6 +184,60 @@ stemlen_compare (const void *v1, const void *v2)
   return r != 0 ? r : (int)(r1->order - r2->order);
 }
 
+/* Return nonzero if NAME, which PATTERN gives as a prerequisite of FILE
+   for the stem STEM, is neither a file make knows about nor one it can find
+   on disk or through VPATH, and would be ruled out for any other stem in
+   the same directory just the same.  PERCENT points at the % in PATTERN.
+   Names that parse_file_seq would change are left to the full search.  */
+
+static int
+prereq_impossible_p (struct file *file, const char *pattern,
+                     const char *percent, const char *name, const char *stem)
+{
+  const char *base;
+  const char *slash;
+  const char *dirname;
+  const char *p;
+  struct dep *d;
+
+  if (strchr (stem, '/') != 0 || strchr (percent, '/') != 0
+      || (name[0] == '.' && name[1] == '/'))
+    return 0;
+
+  for (p = name; *p != '\0'; ++p)
+    switch (*p)
+      {
+      case ' ': case '\t': case '\\': case '~':
+      case '*': case '?': case '[': case '(':
+        return 0;
+      }
+
+  for (base = percent; base > pattern && base[-1] != '/'; --base)
+    ;
+
+  slash = strrchr (name, '/');
+  if (slash == 0)
+    dirname = ".";
+  else if (slash == name)
+    dirname = "/";
+  else
+    {
+      char *cp = alloca (slash - name + 1);
+      memcpy (cp, name, slash - name);
+      cp[slash - name] = '\0';
+      dirname = cp;
+    }
+
+  if (!dir_pattern_impossible_p (dirname, base))
+    return 0;
+
+  for (d = file->deps; d != 0; d = d->next)
+    if (streq (dep_name (d), name))
+      return 0;
+
+  return lookup_file (name) == 0 && vpath_search (name, 0, NULL, NULL) == 0;
+}
+
 /* Search the pattern rules for a rule with an existing dependency to make
    FILE.  If a rule is found, the appropriate commands and deps are put in FILE
    and 1 is returned.  If not, 0 is returned.
@@ -228,9 +283,13 @@ pattern_search (struct file *file, int archive,
   unsigned int stemlen = 0;
   unsigned int fullstemlen = 0;
 
+  /* The buckets of rule targets whose suffix FILENAME ends with.  */
+  struct rule_bucket **buckets;
+  unsigned int nbuckets;
+  unsigned int bi;
+
   /* Buffer in which we store all the rules that are possibly applicable.  */
-  struct tryrule *tryrules = xmalloc (num_pattern_rules * max_pattern_targets
-                                      * sizeof (struct tryrule));
+  struct tryrule *tryrules;
 
   /* Number of valid elements in TRYRULES.  */
   unsigned int nrules;
@@ -256,6 +315,8 @@ pattern_search (struct file *file, int archive,
 
   PATH_VAR (stem_str); /* @@ Need to get rid of stem, stemlen, etc. */
 
+  PROFILE_ENTER (PROF_PATTERN);
+
 #ifndef NO_ARCHIVES
   if (archive || ar_name (filename))
     lastslash = 0;
@@ -291,33 +352,53 @@ pattern_search (struct file *file, int archive,
 
   pathlen = lastslash - filename + 1;
 
+  /* Only the rules in the index buckets for FILENAME's suffixes can
+     match it.  */
+
+  index_pattern_rules ();
+  buckets = alloca (max_rule_buckets * sizeof (struct rule_bucket *));
+  nbuckets = find_pattern_rules (filename, namelen, buckets);
+
+  nrules = 0;
+  for (bi = 0; bi < nbuckets; ++bi)
+    nrules += buckets[bi]->count;
+  tryrules = xmalloc (nrules * sizeof (struct tryrule));
+
   /* First see which pattern rules match this target and may be considered.
      Put them in TRYRULES.  */
 
   nrules = 0;
-  for (rule = pattern_rules; rule != 0; rule = rule->next)
+  for (bi = 0; bi < nbuckets; ++bi)
     {
-      unsigned int ti;
+      struct rule_target *rt = buckets[bi]->targets;
+      struct rule_target *end = rt + buckets[bi]->count;
 
-      /* If the pattern rule has deps but no commands, ignore it.
-         Users cancel built-in rules by redefining them without commands.  */
-      if (rule->deps != 0 && rule->cmds == 0)
-        continue;
-
-      /* If this rule is in use by a parent pattern_search,
-         don't use it here.  */
-      if (rule->in_use)
-        {
-          DBS (DB_IMPLICIT, (_("Avoiding implicit rule recursion.\n")));
-          continue;
-        }
-
-      for (ti = 0; ti < rule->num; ++ti)
+      for (; rt < end; ++rt)
         {
-          const char *target = rule->targets[ti];
-          const char *suffix = rule->suffixes[ti];
+          unsigned int ti = rt->ti;
+          const char *target;
+          const char *suffix;
           char check_lastslash;
 
+          rule = rt->rule;
+
+          /* If the pattern rule has deps but no commands, ignore it.
+             Users cancel built-in rules by redefining them without
+             commands.  */
+          if (rule->deps != 0 && rule->cmds == 0)
+            continue;
+
+          /* If this rule is in use by a parent pattern_search,
+             don't use it here.  */
+          if (rule->in_use)
+            {
+              DBS (DB_IMPLICIT, (_("Avoiding implicit rule recursion.\n")));
+              continue;
+            }
+
+          target = rule->targets[ti];
+          suffix = rule->suffixes[ti];
+
           /* Rules that can match any filename and are not terminal
              are ignored if we're recursing, so that they cannot be
              intermediate files.  */
@@ -397,7 +478,7 @@ pattern_search (struct file *file, int archive,
           tryrules[nrules].rule = rule;
           tryrules[nrules].matches = ti;
           tryrules[nrules].stemlen = stemlen + (check_lastslash ? pathlen : 0);
-          tryrules[nrules].order = nrules;
+          tryrules[nrules].order = rt->order;
           tryrules[nrules].checked_lastslash = check_lastslash;
           ++nrules;
         }
@@ -405,7 +486,10 @@ pattern_search (struct file *file, int archive,
 
   /* Bail out early if we haven't found any rules. */
   if (nrules == 0)
-    goto done;
+    {
+      rule = 0;
+      goto done;
+    }
 
   /* Sort the rules to place matches with the shortest stem first. This
      way the most specific rules will be tried first. */
@@ -548,13 +632,30 @@ pattern_search (struct file *file, int archive,
                       strcpy (o, p + 1);
                     }
 
-                  /* Parse the expanded string.  It might have wildcards.  */
-                  p = depname;
-                  dl = PARSE_SIMPLE_SEQ (&p, struct dep);
-                  for (d = dl; d != NULL; d = d->next)
+                  /* On the first pass a prerequisite that cannot exist just
+                     fails the rule.  If no file in its directory matches its
+                     pattern, find that out without entering the name.  */
+                  if (!intermed_ok && p != 0
+                      && prereq_impossible_p (file, nptr, p, depname,
+                                              stem_str))
+                    {
+                      DBS (DB_IMPLICIT,
+                           (_("Rejecting impossible implicit prerequisite '%s'.\n"),
+                            depname));
+                      dl = 0;
+                      failed = 1;
+                    }
+                  else
                     {
-                      ++deps_found;
-                      d->ignore_mtime = dep->ignore_mtime;
+                      /* Parse the expanded string.  It might have
+                         wildcards.  */
+                      p = depname;
+                      dl = PARSE_SIMPLE_SEQ (&p, struct dep);
+                      for (d = dl; d != NULL; d = d->next)
+                        {
+                          ++deps_found;
+                          d->ignore_mtime = dep->ignore_mtime;
+                        }
                     }
 
                   /* We've used up this dep, so next time get a new one.  */
@@ -995,5 +1096,6 @@ pattern_search (struct file *file, int archive,
   free (tryrules);
   free (deplist);
 
+  PROFILE_LEAVE (PROF_PATTERN);
   return rule != 0;
 }
@@ -20,9 +20,11 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "job.h"
 #include "debug.h"
+#include "trace.h"
 #include "filedef.h"
 #include "commands.h"
 #include "variable.h"
+#include "dbcache.h"
 #include "os.h"
 
 #include <string.h>
@@ -128,6 +130,12 @@ static void vmsWaitForChildren (int *);
 # include <sys/wait.h>
 #endif
 
+/* With wait3() we can learn the peak memory use of each child.  */
+#if defined (HAVE_WAIT3) && defined (HAVE_SYS_RESOURCE_H)
+# include <sys/resource.h>
+# define MEMORY_USAGE 1
+#endif
+
 #ifdef HAVE_WAITPID
 # define WAIT_NOHANG(status)    waitpid (-1, (status), WNOHANG)
 #else   /* Don't have waitpid.  */
@@ -219,6 +227,9 @@ int getloadavg (double loadavg[], int nelem);
 static void free_child (struct child *);
 static void start_job_command (struct child *child);
 static int load_too_high (void);
+static int memory_too_high (struct child *c);
+static unsigned long memory_estimate (struct file *file);
+static void record_memory (struct file *file, unsigned long kb);
 static int job_next_command (struct child *);
 static int start_waiting_job (struct child *);
 
@@ -249,6 +260,10 @@ unsigned long job_counter = 0;
 /* Number of jobserver tokens this instance is currently using.  */
 
 unsigned int jobserver_tokens = 0;
+
+/* Kilobytes of memory expected to be in use by running children.  */
+
+static unsigned long memory_reserved = 0;
 
 
 #ifdef WINDOWS32
@@ -645,11 +660,13 @@ reap_children (int block, int err)
          && (block || REAP_MORE))
     {
       unsigned int remote = 0;
+      unsigned int worker = 0;
+      unsigned long peak_rss = 0;
       pid_t pid;
       int exit_code, exit_sig, coredump;
       struct child *lastc, *c;
       int child_failed;
-      int any_remote, any_local;
+      int any_remote, any_local, any_worker;
       int dontcare;
 
       if (err && block)
@@ -685,11 +702,13 @@ reap_children (int block, int err)
         --dead_children;
 
       any_remote = 0;
+      any_worker = 0;
       any_local = shell_function_pid != 0;
       for (c = children; c != 0; c = c->next)
         {
           any_remote |= c->remote;
-          any_local |= ! c->remote;
+          any_worker |= c->worker;
+          any_local |= ! c->remote && ! c->worker;
           DB (DB_JOBS, (_("Live child %p (%s) PID %s %s\n"),
                         c, c->file->name, pid2str (c->pid),
                         c->remote ? _(" (remote)") : ""));
@@ -713,6 +732,19 @@ reap_children (int block, int err)
         remote_status_lose:
           pfatal_with_name ("remote_status");
         }
+      else if (any_worker
+               && (pid = worker_status (&exit_code, &exit_sig,
+                                        &coredump, 0)) != 0)
+        {
+          if (pid < 0)
+            {
+            worker_status_lose:
+              pfatal_with_name ("worker_status");
+            }
+
+          /* A worker answered.  */
+          worker = 1;
+        }
       else
         {
           /* No remote children.  Check for local children.  */
@@ -732,8 +764,23 @@ reap_children (int block, int err)
               if ((c->cstatus & VMS_POSIX_EXIT_MASK) == VMS_POSIX_EXIT_MASK)
                 status = (c->cstatus >> 3 & 255) << 8;
 #else
+#ifdef MEMORY_USAGE
+              /* When limiting memory, find out how much the child used.  */
+              if (max_memory)
+                {
+                  struct rusage usage;
+
+                  EINTRLOOP (pid, wait3 (&status,
+                                         !block || any_worker ? WNOHANG : 0,
+                                         &usage));
+                  if (pid > 0 && usage.ru_maxrss > 0)
+                    peak_rss = usage.ru_maxrss;
+                }
+              else
+#endif
 #ifdef WAIT_NOHANG
-              if (!block)
+              /* Don't block in wait() while a worker may answer first.  */
+              if (!block || any_worker)
                 pid = WAIT_NOHANG (&status);
               else
 #endif
@@ -766,19 +813,37 @@ reap_children (int block, int err)
               /* No local children are dead.  */
               reap_more = 0;
 
-              if (!block || !any_remote)
+              if (!block || !(any_remote || any_worker))
                 break;
 
-              /* Now try a blocking wait for a remote child.  */
-              pid = remote_status (&exit_code, &exit_sig, &coredump, 1);
-              if (pid < 0)
-                goto remote_status_lose;
-              else if (pid == 0)
-                /* No remote children either.  Finally give up.  */
-                break;
+              if (any_worker)
+                {
+                  /* Wait for a worker to answer.  If other children are
+                     also outstanding, only wait a little while so we get
+                     back to checking on them.  */
+                  pid = worker_status (&exit_code, &exit_sig, &coredump,
+                                       any_local || any_remote ? 100 : -1);
+                  if (pid < 0)
+                    goto worker_status_lose;
+                  else if (pid == 0)
+                    continue;
 
-              /* We got a remote child.  */
-              remote = 1;
+                  /* A worker answered.  */
+                  worker = 1;
+                }
+              else
+                {
+                  /* Now try a blocking wait for a remote child.  */
+                  pid = remote_status (&exit_code, &exit_sig, &coredump, 1);
+                  if (pid < 0)
+                    goto remote_status_lose;
+                  else if (pid == 0)
+                    /* No remote children either.  Finally give up.  */
+                    break;
+
+                  /* We got a remote child.  */
+                  remote = 1;
+                }
             }
 #endif /* !__MSDOS__, !Amiga, !WINDOWS32.  */
 
@@ -870,7 +935,7 @@ reap_children (int block, int err)
         }
 
       /* Check if this is the child of the 'shell' function.  */
-      if (!remote && pid == shell_function_pid)
+      if (!remote && !worker && pid == shell_function_pid)
         {
           shell_completed (exit_code, exit_sig);
           break;
@@ -879,7 +944,7 @@ reap_children (int block, int err)
       /* Search for a child matching the deceased one.  */
       lastc = 0;
       for (c = children; c != 0; lastc = c, c = c->next)
-        if (c->pid == pid && c->remote == remote)
+        if (c->pid == pid && c->remote == remote && c->worker == worker)
           break;
 
       if (c == 0)
@@ -887,6 +952,10 @@ reap_children (int block, int err)
            Ignore it; it was inherited from our invoker.  */
         continue;
 
+      /* Remember the largest of this target's commands.  */
+      if (peak_rss > c->peak_rss)
+        c->peak_rss = peak_rss;
+
       /* Determine the failure status: 0 for success, 1 for updating target in
          question mode, 2 for anything else.  */
       if (exit_sig == 0 && exit_code == 0)
@@ -901,6 +970,8 @@ reap_children (int block, int err)
                     : _("Reaping winning child %p PID %s %s\n"),
                     c, pid2str (c->pid), c->remote ? _(" (remote)") : ""));
 
+      trace_job_end (c, exit_code, exit_sig);
+
       if (c->sh_batch_file)
         {
           int rm_status;
@@ -1001,6 +1072,9 @@ reap_children (int block, int err)
 
       /* When we get here, all the commands for c->file are finished.  */
 
+      if (c->peak_rss)
+        record_memory (c->file, c->peak_rss);
+
 #ifndef NO_OUTPUT_SYNC
       /* Synchronize any remaining parallel output.  */
       output_dump (&c->output);
@@ -1011,6 +1085,9 @@ reap_children (int block, int err)
          ran; notice_finish_file looks for cs_running to tell it that
          it's interesting to check the file's modtime again now.  */
 
+      /* Whatever the commands changed, they are done changing it.  */
+      ++file_generation;
+
       if (! handling_fatal_signal)
         /* Notice if the target of the commands has been changed.
            This also propagates its values for command_state and
@@ -1078,6 +1155,11 @@ free_child (struct child *child)
 
   --jobserver_tokens;
 
+  /* Its memory is available to other jobs again.  */
+  memory_reserved -= child->memory;
+
+  trace_job_free (child);
+
   if (handling_fatal_signal) /* Don't bother free'ing if about to die.  */
     return;
 
@@ -1314,6 +1396,7 @@ start_job_command (struct child *child)
      chain (i.e., update_file recursion chain) we are processing.  */
 
   ++commands_started;
+  ++file_generation;
 
   /* Optimize an empty command.  People use this for timestamp rules,
      so avoid forking a useless shell.  Do this after we increment
@@ -1398,9 +1481,26 @@ start_job_command (struct child *child)
               good_stdin_used = 0;
             }
           child->remote = is_remote;
+          child->worker = 0;
           child->pid = id;
         }
     }
+  /* If the target names a persistent worker, hand it the line instead of
+     forking a shell.  Recursive lines always get a real process.  */
+  else if (!(flags & COMMANDS_RECURSE)
+           && (child->pid = start_worker_job (child->file, p,
+                                              child->environment)) > 0)
+    {
+      block_sigs ();
+
+      /* Workers never read our standard input.  */
+      if (child->good_stdin)
+        {
+          child->good_stdin = 0;
+          good_stdin_used = 0;
+        }
+      child->worker = 1;
+    }
   else
 #endif /* !VMS */
     {
@@ -1412,6 +1512,7 @@ start_job_command (struct child *child)
       block_sigs ();
 
       child->remote = 0;
+      child->worker = 0;
 
 #ifdef VMS
       if (!child_execute_job (child, argv))
@@ -1562,6 +1663,8 @@ start_job_command (struct child *child)
   /* Bump the number of jobs started in this second.  */
   ++job_counter;
 
+  trace_job_start (child);
+
   /* We are the parent side.  Set the state to
      say the commands are running and return.  */
 
@@ -1598,9 +1701,9 @@ start_waiting_job (struct child *c)
   c->remote = start_remote_job_p (1);
 
   /* If we are running at least one job already and the load average
-     is too high, make this one wait.  */
+     or the memory in use is too high, make this one wait.  */
   if (!c->remote
-      && ((job_slots_used > 0 && load_too_high ())
+      && ((job_slots_used > 0 && (load_too_high () || memory_too_high (c)))
 #ifdef WINDOWS32
           || process_table_full ()
 #endif
@@ -1614,6 +1717,13 @@ start_waiting_job (struct child *c)
       return 0;
     }
 
+  /* Set aside the memory we expect this job to need.  */
+  if (max_memory)
+    {
+      c->memory = memory_estimate (f);
+      memory_reserved += c->memory;
+    }
+
   /* Start the first command; reap_children will run later command lines.  */
   start_job_command (c);
 
@@ -1684,10 +1794,30 @@ new_job (struct file *file)
   /* Start saving output in case the expansion uses $(info ...) etc.  */
   OUTPUT_SET (&c->output);
 
+  /* The second time this recipe is run, parse its lines for next time.  */
+  if (cmds->expanded && cmds->compiled_lines == 0)
+    cmds->compiled_lines = xcalloc (cmds->ncommand_lines
+                                    * sizeof (struct expansion *));
+  cmds->expanded = 1;
+
   /* Expand the command lines and store the results in LINES.  */
   lines = xmalloc (cmds->ncommand_lines * sizeof (char *));
   for (i = 0; i < cmds->ncommand_lines; ++i)
     {
+      struct expansion **ep = 0;
+      char *in, *out, *ref;
+
+      cmds->fileinfo.offset = i;
+      if (cmds->compiled_lines)
+        ep = &cmds->compiled_lines[i];
+
+      /* A line that was parsed has been collapsed already.  */
+      if (ep && *ep && compiled_is_current (*ep))
+        {
+          lines[i] = allocated_expand_compiled_for_file (*ep, file);
+          continue;
+        }
+
       /* Collapse backslash-newline combinations that are inside variable
          or function references.  These are left alone by the parser so
          that they will appear in the echoing of commands (where they look
@@ -1695,8 +1825,6 @@ new_job (struct file *file)
          But letting them survive inside function invocations loses because
          we don't want the functions to see them as part of the text.  */
 
-      char *in, *out, *ref;
-
       /* IN points to where in the line we are scanning.
          OUT points to where in the line we are writing.
          When we collapse a backslash-newline combination,
@@ -1783,16 +1911,36 @@ new_job (struct file *file)
         memmove (out, in, strlen (in) + 1);
 
       /* Finally, expand the line.  */
-      cmds->fileinfo.offset = i;
-      lines[i] = allocated_variable_expand_for_file (cmds->command_lines[i],
-                                                     file);
+      if (ep)
+        {
+          free_expansion (*ep);
+          *ep = compile_expansion (cmds->command_lines[i],
+                                   strlen (cmds->command_lines[i]));
+        }
+      if (ep && *ep)
+        lines[i] = allocated_expand_compiled_for_file (*ep, file);
+      else
+        lines[i] = allocated_variable_expand_for_file (cmds->command_lines[i],
+                                                       file);
     }
 
   cmds->fileinfo.offset = 0;
   c->command_lines = lines;
 
-  /* Fetch the first command line to be run.  */
-  job_next_command (c);
+  contenthash_recipe (file, lines, cmds->ncommand_lines);
+
+  if (actioncache_restore (file, lines, &c->environment))
+    {
+      /* The targets were copied from the action cache, so there is
+         nothing left to run; but something was done.  */
+      c->command_line = cmds->ncommand_lines;
+      c->command_ptr = 0;
+      ++commands_started;
+      ++file_generation;
+    }
+  else
+    /* Fetch the first command line to be run.  */
+    job_next_command (c);
 
   /* Wait for a job slot to be freed up.  If we allow an infinite number
      don't bother; also job_slots will == 0 if we're using the jobserver.  */
@@ -1846,7 +1994,8 @@ new_job (struct file *file)
           O (fatal, NILF, "INTERNAL: no children as we go to sleep on read\n");
 
         /* Get a token.  */
-        got_token = jobserver_acquire (waiting_jobs != NULL);
+        got_token = jobserver_acquire (waiting_jobs != NULL
+                                       || workers_need_polling ());
 
         /* If we got one, we're done here.  */
         if (got_token == 1)
@@ -2106,6 +2255,374 @@ load_too_high (void)
 #endif
 }
 
+/* Memory-aware job limiting (--max-memory).
+
+   Each job is expected to need the amount of memory given by its target's
+   .MEMORY variable or, if that is not set, the peak memory its recipe used
+   the last time it ran.  A job is held back if it would take the memory
+   reserved by running jobs over the --max-memory limit, or if it needs more
+   memory than the system (or our cgroup) currently has available.  Peak
+   usage is measured with wait3() and, if .MEMORY_FILE names a file, saved
+   there for later runs.  All sizes are in kilobytes.  */
+
+/* Parse a memory size: a number of bytes with an optional K, M, G or T
+   suffix.  Store it in kilobytes in *KBP and return 0, or return -1 if STR
+   is not a valid size.  */
+
+int
+parse_memory_size (const char *str, unsigned long *kbp)
+{
+  const char *p = str;
+  double n;
+  char *end;
+
+  NEXT_TOKEN (p);
+  n = strtod (p, &end);
+  if (end == p || n < 0)
+    return -1;
+
+  switch (*end)
+    {
+    case 't': case 'T': n *= 1024.0;
+    /* FALLTHROUGH */
+    case 'g': case 'G': n *= 1024.0;
+    /* FALLTHROUGH */
+    case 'm': case 'M': n *= 1024.0;
+    /* FALLTHROUGH */
+    case 'k': case 'K':
+      ++end;
+      if (*end == 'b' || *end == 'B')
+        ++end;
+      break;
+    default:
+      n /= 1024.0;
+      break;
+    }
+
+  NEXT_TOKEN (end);
+  if (*end != '\0')
+    return -1;
+
+  *kbp = (unsigned long) (n + 0.5);
+  return 0;
+}
+
+/* Peak memory use recorded for targets, in this run or an earlier one.  */
+
+struct memory_record
+  {
+    const char *name;           /* Target name, in the strcache.  */
+    unsigned long kb;           /* Largest peak seen.  */
+  };
+
+static struct hash_table memory_records;
+static int memory_records_changed = 0;
+
+static unsigned long
+memory_record_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((struct memory_record const *) key)->name);
+}
+
+static unsigned long
+memory_record_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((struct memory_record const *) key)->name);
+}
+
+static int
+memory_record_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((struct memory_record const *) x)->name,
+                         ((struct memory_record const *) y)->name);
+}
+
+/* Return the name of the file to keep peak usage in, or NULL.  */
+
+static const char *
+memory_file_name (void)
+{
+  struct variable *v = lookup_variable (STRING_SIZE_TUPLE (".MEMORY_FILE"));
+  char *name;
+
+  if (v == 0)
+    return 0;
+
+  name = allocated_variable_expand (v->value);
+  if (*name == '\0')
+    {
+      free (name);
+      return 0;
+    }
+
+  return strcache_add (name);
+}
+
+static void
+set_memory_record (const char *name, unsigned long kb)
+{
+  struct memory_record key;
+  struct memory_record **slot;
+
+  key.name = strcache_add (name);
+  slot = (struct memory_record **) hash_find_slot (&memory_records, &key);
+  if (HASH_VACANT (*slot))
+    {
+      struct memory_record *r = xmalloc (sizeof (struct memory_record));
+      r->name = key.name;
+      r->kb = kb;
+      hash_insert_at (&memory_records, r, slot);
+    }
+  else
+    (*slot)->kb = kb;
+}
+
+/* Set up the record table, reading earlier results from .MEMORY_FILE.  */
+
+static void
+load_memory_records (void)
+{
+  const char *name;
+  FILE *fp;
+  char buf[8192];
+
+  if (memory_records.ht_vec)
+    return;
+
+  hash_init (&memory_records, 256,
+             memory_record_hash_1, memory_record_hash_2, memory_record_cmp);
+
+  name = memory_file_name ();
+  if (name == 0)
+    return;
+
+  ENULLLOOP (fp, _fopen (name, "r"));
+  if (fp == 0)
+    return;
+
+  /* Each line is "KILOBYTES TARGET".  Ignore anything else.  */
+  while (_fgets (buf, sizeof (buf), fp))
+    {
+      char *p = buf;
+      char *nl = strchr (buf, '\n');
+      unsigned long kb;
+
+      if (nl == 0)
+        continue;
+      *nl = '\0';
+      kb = strtoul (buf, &p, 10);
+      if (p == buf || *p != ' ' || p[1] == '\0')
+        continue;
+      set_memory_record (p + 1, kb);
+    }
+
+  _fclose (fp);
+}
+
+/* Write the recorded peaks back to .MEMORY_FILE, if anything changed.  */
+
+void
+save_memory_records (void)
+{
+  struct memory_record **recs, **end;
+  const char *name;
+  FILE *fp;
+
+  if (!memory_records_changed || (name = memory_file_name ()) == 0)
+    return;
+
+  ENULLLOOP (fp, _fopen (name, "w"));
+  if (fp == 0)
+    {
+      perror_with_name (_("cannot write memory records: "), name);
+      return;
+    }
+
+  recs = (struct memory_record **) memory_records.ht_vec;
+  end = recs + memory_records.ht_size;
+  for (; recs < end; ++recs)
+    if (! HASH_VACANT (*recs))
+      _fprintf (fp, "%lu %s\n", (*recs)->kb, (*recs)->name);
+
+  if (_fclose (fp) != 0)
+    perror_with_name (_("cannot write memory records: "), name);
+
+  memory_records_changed = 0;
+}
+
+/* Remember that FILE's recipe used KB kilobytes at its peak.  */
+
+static void
+record_memory (struct file *file, unsigned long kb)
+{
+  struct memory_record key;
+  struct memory_record *r;
+
+  if (!max_memory)
+    return;
+
+  load_memory_records ();
+
+  key.name = file->name;
+  r = hash_find_item (&memory_records, &key);
+  if (r && r->kb == kb)
+    return;
+
+  DB (DB_JOBS, (_("Recording peak memory %luK for '%s'\n"), kb, file->name));
+
+  set_memory_record (file->name, kb);
+  memory_records_changed = 1;
+}
+
+/* Return the memory we expect FILE's recipe to need.  */
+
+static unsigned long
+memory_estimate (struct file *file)
+{
+  struct memory_record key;
+  struct memory_record *r;
+  unsigned long kb = 0;
+  char *value;
+  int save;
+
+  /* An explicit .MEMORY setting wins.  */
+  save = warn_undefined_variables_flag;
+  warn_undefined_variables_flag = 0;
+  value = allocated_variable_expand_for_file ("$(.MEMORY)", file);
+  warn_undefined_variables_flag = save;
+
+  if (*value != '\0')
+    {
+      if (parse_memory_size (value, &kb) < 0)
+        {
+          OSS (error, &file->cmds->fileinfo,
+               _("invalid .MEMORY value '%s' for '%s'"), value, file->name);
+          kb = 0;
+        }
+      free (value);
+      return kb;
+    }
+  free (value);
+
+  /* Otherwise use what it took last time, if we know.  */
+  load_memory_records ();
+  key.name = strcache_add (file->name);
+  r = hash_find_item (&memory_records, &key);
+
+  return r ? r->kb : 0;
+}
+
+/* Read the whole of the small file NAME into BUF.  Return its length, or
+   -1 on error.  */
+
+static int
+read_small_file (const char *name, char *buf, int size)
+{
+  int fd, r;
+
+  EINTRLOOP (fd, open (name, O_RDONLY));
+  if (fd < 0)
+    return -1;
+
+  EINTRLOOP (r, read (fd, buf, size - 1));
+  close (fd);
+  if (r < 0)
+    return -1;
+
+  buf[r] = '\0';
+  return r;
+}
+
+/* Return the memory currently available to us, or ULONG_MAX if we can't
+   tell.  This is the smaller of MemAvailable from /proc/meminfo and the
+   room left below our cgroup's memory.max.  */
+
+static unsigned long
+memory_available (void)
+{
+  static char *cgroup_dir = 0;
+  static int cgroup_checked = 0;
+  unsigned long avail = ULONG_MAX;
+  char buf[4096];
+  const char *p;
+
+  if (read_small_file ("/proc/meminfo", buf, sizeof (buf)) > 0
+      && (p = strstr (buf, "MemAvailable:")) != 0)
+    avail = strtoul (p + CSTRLEN ("MemAvailable:"), NULL, 10);
+
+  /* Find our cgroup (v2) once.  */
+  if (!cgroup_checked)
+    {
+      cgroup_checked = 1;
+      if (read_small_file ("/proc/self/cgroup", buf, sizeof (buf)) > 0
+          && (p = strstr (buf, "0::/")) != 0)
+        {
+          const char *e = strchr (p, '\n');
+          size_t l = e ? (size_t) (e - p) - 3 : strlen (p + 3);
+
+          cgroup_dir = xmalloc (CSTRLEN ("/sys/fs/cgroup") + l + 1);
+          memcpy (cgroup_dir, "/sys/fs/cgroup", CSTRLEN ("/sys/fs/cgroup"));
+          memcpy (cgroup_dir + CSTRLEN ("/sys/fs/cgroup"), p + 3, l);
+          cgroup_dir[CSTRLEN ("/sys/fs/cgroup") + l] = '\0';
+        }
+    }
+
+  if (cgroup_dir)
+    {
+      char *name = alloca (strlen (cgroup_dir) + CSTRLEN ("/memory.current")
+                           + 1);
+      double limit, current;
+
+      sprintf (name, "%s/memory.max", cgroup_dir);
+      if (read_small_file (name, buf, sizeof (buf)) > 0 && ISDIGIT (buf[0]))
+        {
+          limit = strtod (buf, NULL) / 1024.0;
+
+          sprintf (name, "%s/memory.current", cgroup_dir);
+          if (read_small_file (name, buf, sizeof (buf)) > 0)
+            {
+              current = strtod (buf, NULL) / 1024.0;
+              if (current >= limit)
+                avail = 0;
+              else if (limit - current < avail)
+                avail = (unsigned long) (limit - current);
+            }
+        }
+    }
+
+  return avail;
+}
+
+/* Return nonzero if starting C now would use too much memory.  */
+
+static int
+memory_too_high (struct child *c)
+{
+  unsigned long need, avail;
+
+  if (!max_memory)
+    return 0;
+
+  need = memory_estimate (c->file);
+
+  if (memory_reserved + need > max_memory)
+    {
+      DB (DB_JOBS, (_("Deferring '%s': needs %luK, %luK of %luK reserved\n"),
+                    c->file->name, need, memory_reserved, max_memory));
+      return 1;
+    }
+
+  avail = memory_available ();
+  if (need > avail)
+    {
+      DB (DB_JOBS, (_("Deferring '%s': needs %luK, %luK available\n"),
+                    c->file->name, need, avail));
+      return 1;
+    }
+
+  return 0;
+}
+
 /* Start jobs that are waiting for the load to be lower.  */
 
 void
@@ -16,6 +16,12 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "output.h"
 
+/* Persistent workers need socketpair() and poll().  */
+#if !defined(WINDOWS32) && !defined(VMS) && !defined(__MSDOS__) \
+    && !defined(_AMIGA) && !defined(__EMX__)
+# define MAKE_WORKERS 1
+#endif
+
 /* Structure describing a running or dead child process.  */
 
 struct child
@@ -39,7 +45,10 @@ struct child
     unsigned int  command_line; /* Index into command_lines.  */
     struct output output;       /* Output for this child.  */
     pid_t         pid;          /* Child process's ID number.  */
+    unsigned long memory;       /* Kilobytes reserved for this job.  */
+    unsigned long peak_rss;     /* Largest memory use of its commands.  */
     unsigned int  remote:1;     /* Nonzero if executing remotely.  */
+    unsigned int  worker:1;     /* Nonzero if running in a worker.  */
     unsigned int  noerror:1;    /* Nonzero if commands contained a '-'.  */
     unsigned int  good_stdin:1; /* Nonzero if this child has a good stdin.  */
     unsigned int  deleted:1;    /* Nonzero if targets have been deleted.  */
@@ -75,5 +84,14 @@ void exec_command (char **argv, char **envp) __attribute__ ((noreturn));
 
 void unblock_all_sigs (void);
 
+pid_t start_worker_job (struct file *file, const char *line, char **envp);
+pid_t worker_status (int *exit_code_ptr, int *exit_sig_ptr,
+                     int *coredump_ptr, int timeout);
+int workers_need_polling (void);
+void worker_cleanup (void);
+
+int parse_memory_size (const char *str, unsigned long *kbp);
+void save_memory_records (void);
+
 extern unsigned int job_slots_used;
 extern unsigned int jobserver_tokens;
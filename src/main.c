@@ -23,6 +23,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "rule.h"
 #include "debug.h"
+#include "trace.h"
+#include "profile.h"
+#include "dbcache.h"
 #include "getopt.h"
 #include "libfs/libfs.h"
 #include "libfs/lfs_error.h"
@@ -209,6 +212,10 @@ int ignore_errors_flag = 0;
 
 int print_data_base_flag = 0;
 
+/* Nonzero means report the time make spent in its own work (--profile).  */
+
+int profile_flag = 0;
+
 /* Nonzero means don't remake anything; just return a nonzero status
    if the specified targets are not up to date (-q).  */
 
@@ -270,6 +277,39 @@ static const int inf_jobs = 0;
 
 static char *jobserver_auth = NULL;
 
+/* Style for the jobserver: "pipe" or "fifo".  */
+
+static char *jobserver_style = NULL;
+
+/* File to write a Chrome trace of the build to (--trace-json).  */
+
+static char *trace_json_file = NULL;
+
+/* File to cache the database read from the makefiles in (--db-cache).  */
+
+static char *db_cache_file = NULL;
+
+/* File to keep the state of files between runs in (--state-file).  */
+
+static char *state_file = NULL;
+
+/* File to keep hashes of the contents of files in (--content-hash).  */
+
+static char *content_hash_file = NULL;
+
+/* Directory to keep the targets made by recipes in (--action-cache).  */
+
+static char *action_cache_dir = NULL;
+
+/* File to keep the results of $(shell ...) between runs in
+   (--shell-cache).  */
+
+static char *shell_cache_file = NULL;
+
+/* Nonzero means update the goals again whenever a file changes (--watch).  */
+
+static int watch_flag = 0;
+
 /* Handle for the mutex used on Windows to synchronize output of our
    children under -O.  */
 
@@ -282,6 +322,12 @@ char *sync_mutex = NULL;
 double max_load_average = -1.0;
 double default_load_average = -1.0;
 
+/* Maximum memory, in kilobytes, that running jobs may use (--max-memory).
+   Zero means no limit.  */
+
+static char *max_memory_option = 0;
+unsigned long max_memory = 0;
+
 /* List of directories given with -C switches.  */
 
 static struct stringlist *directories = 0;
@@ -337,6 +383,9 @@ static const char *const usage[] =
   {
     N_("Options:\n"),
     N_("\
+  --action-cache=DIR          Keep the targets recipes make in DIR and copy\n\
+                              them from there instead of running them again.\n"),
+    N_("\
   -b, -m                      Ignored for compatibility.\n"),
     N_("\
   -B, --always-make           Unconditionally make all targets.\n"),
@@ -344,8 +393,14 @@ static const char *const usage[] =
   -C DIRECTORY, --directory=DIRECTORY\n\
                               Change to DIRECTORY before doing anything.\n"),
     N_("\
+  --content-hash=FILE         Keep hashes of file contents in FILE and don't\n\
+                              remake targets whose inputs are unchanged.\n"),
+    N_("\
   -d                          Print lots of debugging information.\n"),
     N_("\
+  --db-cache=FILE             Cache the database read from the makefiles\n\
+                              in FILE.\n"),
+    N_("\
   --debug[=FLAGS]             Print various types of debugging information.\n"),
     N_("\
   -e, --environment-overrides\n\
@@ -365,6 +420,8 @@ static const char *const usage[] =
     N_("\
   -j [N], --jobs[=N]          Allow N jobs at once; infinite jobs with no arg.\n"),
     N_("\
+  --jobserver-style=STYLE     Select the style of jobserver to use.\n"),
+    N_("\
   -k, --keep-going            Keep going when some targets can't be made.\n"),
     N_("\
   -l [N], --load-average[=N], --max-load[=N]\n\
@@ -372,6 +429,8 @@ static const char *const usage[] =
     N_("\
   -L, --check-symlink-times   Use the latest mtime between symlinks and target.\n"),
     N_("\
+  --max-memory=SIZE           Don't start jobs that would use more than SIZE.\n"),
+    N_("\
   -n, --just-print, --dry-run, --recon\n\
                               Don't actually run any recipe; just print them.\n"),
     N_("\
@@ -383,6 +442,8 @@ static const char *const usage[] =
     N_("\
   -p, --print-data-base       Print make's internal database.\n"),
     N_("\
+  --profile                   Print statistics on make's own work.\n"),
+    N_("\
   -q, --question              Run no recipe; exit status says if up to date.\n"),
     N_("\
   -r, --no-builtin-rules      Disable the built-in implicit rules.\n"),
@@ -396,10 +457,17 @@ static const char *const usage[] =
   -S, --no-keep-going, --stop\n\
                               Turns off -k.\n"),
     N_("\
+  --shell-cache=FILE          Keep the results of $(shell ...) under the\n\
+                              .SHELL_CACHE key in FILE.\n"),
+    N_("\
+  --state-file=FILE           Keep the state of files between runs in FILE.\n"),
+    N_("\
   -t, --touch                 Touch targets instead of remaking them.\n"),
     N_("\
   --trace                     Print tracing information.\n"),
     N_("\
+  --trace-json=FILE           Write a timeline of the build to FILE.\n"),
+    N_("\
   -v, --version               Print the version number of make and exit.\n"),
     N_("\
   -w, --print-directory       Print the current directory.\n"),
@@ -410,6 +478,8 @@ static const char *const usage[] =
                               Consider FILE to be infinitely new.\n"),
     N_("\
   --warn-undefined-variables  Warn when an undefined variable is referenced.\n"),
+    N_("\
+  --watch                     Update the goals again whenever a file changes.\n"),
     NULL
   };
 
@@ -470,6 +540,20 @@ static const struct command_switch switches[] =
     { CHAR_MAX+7, string, &sync_mutex, 1, 1, 0, 0, 0, "sync-mutex" },
     { CHAR_MAX+8, flag_off, &silent_flag, 1, 1, 0, 0, &default_silent_flag, "no-silent" },
     { CHAR_MAX+9, string, &jobserver_auth, 1, 0, 0, 0, 0, "jobserver-fds" },
+    { CHAR_MAX+10, string, &jobserver_style, 1, 0, 0, 0, 0,
+      "jobserver-style" },
+    { CHAR_MAX+11, string, &max_memory_option, 1, 1, 0, 0, 0, "max-memory" },
+    { CHAR_MAX+12, string, &trace_json_file, 0, 0, 0, 0, 0, "trace-json" },
+    { CHAR_MAX+13, flag, &profile_flag, 0, 0, 0, 0, 0, "profile" },
+    { CHAR_MAX+14, string, &db_cache_file, 0, 0, 0, 0, 0, "db-cache" },
+    { CHAR_MAX+15, string, &state_file, 0, 0, 0, 0, 0, "state-file" },
+    { CHAR_MAX+16, flag, &watch_flag, 0, 0, 0, 0, 0, "watch" },
+    { CHAR_MAX+17, string, &content_hash_file, 0, 0, 0, 0, 0,
+      "content-hash" },
+    { CHAR_MAX+18, string, &action_cache_dir, 0, 0, 0, 0, 0,
+      "action-cache" },
+    { CHAR_MAX+19, string, &shell_cache_file, 0, 0, 0, 0, 0,
+      "shell-cache" },
     { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
   };
 
@@ -805,6 +889,14 @@ decode_output_sync_flags (void)
 #endif
 }
 
+static void
+decode_max_memory (void)
+{
+  if (max_memory_option
+      && parse_memory_size (max_memory_option, &max_memory) < 0)
+    OS (fatal, NILF, _("invalid memory size '%s'"), max_memory_option);
+}
+
 #ifdef WINDOWS32
 
 #ifndef NO_OUTPUT_SYNC
@@ -1063,6 +1155,7 @@ main (int argc, char **argv, char **envp)
   static char *stdin_nm = 0;
   int makefile_status = MAKE_SUCCESS;
   struct goaldep *read_files;
+  int db_cached = 0;
   PATH_VAR (current_directory);
   unsigned int restarts = 0;
   unsigned int syncing = 0;
@@ -1366,6 +1459,12 @@ main (int argc, char **argv, char **envp)
 #endif
 #ifdef MAKE_LOAD
                            " load"
+#endif
+#ifdef MAKE_WORKERS
+                           " workers"
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+                           " watch"
 #endif
                            ;
 
@@ -1515,6 +1614,15 @@ main (int argc, char **argv, char **envp)
       arg_job_slots = env_slots;
   }
 
+#ifndef HAVE_SYS_INOTIFY_H
+  if (watch_flag)
+    O (fatal, NILF, _("--watch is not supported on this system"));
+#endif
+
+  /* Start the build timeline.  A re-executed make adds to it.  */
+  if (trace_json_file)
+    trace_open (trace_json_file, restarts != 0);
+
   /* Set a variable specifying whether stdout/stdin is hooked to a TTY.  */
 #ifdef HAVE_ISATTY
   if (isatty (fileno (stdout)))
@@ -1821,6 +1929,9 @@ main (int argc, char **argv, char **envp)
             if (stdin_nm)
               O (fatal, NILF,
                  _("Makefile from standard input specified twice."));
+            if (watch_flag)
+              O (fatal, NILF,
+                 _("--watch can't read a makefile from standard input again"));
 
 #ifdef VMS
 # define DEFAULT_TMPDIR     "/sys$scratch/"
@@ -1952,10 +2063,26 @@ main (int argc, char **argv, char **envp)
 
   default_goal_var = define_variable_cname (".DEFAULT_GOAL", "", o_file, 0);
 
+  trace_begin ("read makefiles");
+
+  /* Results of $(shell ...) from the last run may be used while reading
+     the makefiles.  */
+
+  if (shell_cache_file)
+    shellcache_load (shell_cache_file);
+
+  /* If the database built last time is still good, use it instead of
+     evaluating --eval strings and reading the makefiles.  */
+
+  if (db_cache_file)
+    db_cached = dbcache_load (db_cache_file, argv,
+                              makefiles == 0 ? 0 : makefiles->list,
+                              &read_files);
+
   /* Evaluate all strings provided with --eval.
      Also set up the $(-*-eval-flags-*-) variable.  */
 
-  if (eval_strings)
+  if (eval_strings && !db_cached)
     {
       char *p, *value;
       unsigned int i;
@@ -1984,7 +2111,14 @@ main (int argc, char **argv, char **envp)
 
   /* Read all the makefiles.  */
 
-  read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
+  if (!db_cached)
+    {
+      read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
+      if (db_cache_file)
+        dbcache_save (db_cache_file, makefiles == 0 ? 0 : makefiles->list,
+                      read_files);
+    }
+  trace_end ("read makefiles");
 
 #ifdef WINDOWS32
   /* look one last time after reading all Makefiles */
@@ -2121,7 +2255,7 @@ main (int argc, char **argv, char **envp)
      submakes it's the token they were given by their parent.  For the top
      make, we just subtract one from the number the user wants.  */
 
-  if (job_slots > 1 && jobserver_setup (job_slots - 1))
+  if (job_slots > 1 && jobserver_setup (job_slots - 1, jobserver_style))
     {
       /* Fill in the jobserver_auth for our children.  */
       jobserver_auth = jobserver_get_auth ();
@@ -2160,7 +2294,19 @@ main (int argc, char **argv, char **envp)
   /* Make each 'struct goaldep' point at the 'struct file' for the file
      depended on.  Also do magic for special targets.  */
 
+  trace_begin ("snap deps");
   snap_deps ();
+  trace_end ("snap deps");
+
+  /* Use the state of files from the last run, unless the makefiles have
+     just been remade.  */
+
+  if (state_file)
+    filestate_load (state_file, restarts == 0);
+  if (content_hash_file)
+    contenthash_load (content_hash_file);
+  if (action_cache_dir)
+    actioncache_init (action_cache_dir);
 
   /* Convert old-style suffix rules to pattern rules.  It is important to
      do this before installing the built-in pattern rules below, so that
@@ -2297,7 +2443,9 @@ main (int argc, char **argv, char **envp)
           db_level = DB_NONE;
 
         rebuilding_makefiles = 1;
+        trace_begin ("remake makefiles");
         status = update_goal_chain (read_files);
+        trace_end ("remake makefiles");
         rebuilding_makefiles = 0;
 
         db_level = orig_db_level;
@@ -2385,6 +2533,7 @@ main (int argc, char **argv, char **envp)
           /* Updated successfully.  Re-exec ourselves.  */
 
           remove_intermediates (0);
+          shellcache_save ();
 
           if (print_data_base_flag)
             print_data_base ();
@@ -2495,6 +2644,9 @@ main (int argc, char **argv, char **envp)
           _fflush (stdout);
           _fflush (stderr);
 
+          /* The new make carries on with the trace.  */
+          trace_close (0);
+
 #ifdef _AMIGA
           exec_command (nargv);
           exit (0);
@@ -2617,7 +2769,20 @@ main (int argc, char **argv, char **envp)
   DB (DB_BASIC, (_("Updating goal targets....\n")));
 
   {
-    switch (update_goal_chain (goals))
+    enum update_status status;
+
+  watch_again:
+    trace_begin ("prefetch mtimes");
+    PROFILE_ENTER (PROF_MTIME);
+    prefetch_mtimes ();
+    PROFILE_LEAVE (PROF_MTIME);
+    trace_end ("prefetch mtimes");
+
+    trace_begin ("update goals");
+    status = update_goal_chain (goals);
+    trace_end ("update goals");
+
+    switch (status)
     {
       case us_none:
         /* Nothing happened.  */
@@ -2640,6 +2805,22 @@ main (int argc, char **argv, char **envp)
       O (error, NILF,
          _("warning:  Clock skew detected.  Your build may be incomplete."));
 
+    filestate_save ();
+    contenthash_save ();
+    shellcache_save ();
+
+    /* Under --watch, wait for a file to change and update the goals again
+       with the files as they are now, or read the makefiles anew if one of
+       them changed.  */
+    if (watch_flag)
+      {
+        if (watch_changes ())
+          goto re_exec;
+        makefile_status = MAKE_SUCCESS;
+        clock_skew_detected = 0;
+        goto watch_again;
+      }
+
     /* Exit.  */
     die (makefile_status);
   }
@@ -3041,6 +3222,7 @@ decode_switches (int argc, const char **argv, int env)
   /* If there are any options that need to be decoded do it now.  */
   decode_debug_flags ();
   decode_output_sync_flags ();
+  decode_max_memory ();
 }
 
 /* Decode switches from environment variable ENVAR (which is LEN chars long).
@@ -3497,9 +3679,20 @@ die (int status)
       /* Let the remote job module clean up its state.  */
       remote_cleanup ();
 
+      /* Shut down any persistent workers.  */
+      worker_cleanup ();
+
+      /* Keep the peak memory use of this run's jobs for next time.  */
+      save_memory_records ();
+
+      trace_close (1);
+
       /* Remove the intermediate files.  */
       remove_intermediates (0);
 
+      if (profile_flag)
+        print_profile ();
+
       if (print_data_base_flag)
         print_data_base ();
 
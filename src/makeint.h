@@ -519,9 +519,28 @@ void *xcalloc (unsigned int);
 void *xrealloc (void *, unsigned int);
 char *xstrdup (const char *);
 char *xstrndup (const char *, unsigned int);
+
+/* A pool of objects of one size that mostly live as long as make does.  */
+struct pool
+  {
+    unsigned int size;          /* Size of each object, suitably aligned.  */
+    char *next;                 /* Next unused object in the current block.  */
+    char *end;                  /* End of the current block.  */
+    void *free;                 /* Chain of objects given back.  */
+  };
+
+#define POOL_ALIGN      (sizeof (uintmax_t) > sizeof (void *) \
+                         ? sizeof (uintmax_t) : sizeof (void *))
+#define POOL_INIT(_t)   { (sizeof (_t) + POOL_ALIGN - 1) / POOL_ALIGN \
+                          * POOL_ALIGN, 0, 0, 0 }
+
+void *pool_alloc (struct pool *);
+void *pool_alloc_array (struct pool *, unsigned int);
+void pool_free (struct pool *, void *);
 char *find_next_token (const char **, unsigned int *);
 char *next_token (const char *);
 char *end_of_token (const char *);
+char *find_stopchar (const char *, int);
 void collapse_continuations (char *);
 char *lindex (const char *, const char *, int);
 int alpha_compare (const void *, const void *);
@@ -553,9 +572,11 @@ int dir_file_exists_p (const char *, const char *);
 int file_exists_p (const char *);
 int file_impossible_p (const char *);
 void file_impossible (const char *);
+int dir_pattern_impossible_p (const char *, const char *);
 const char *dir_name (const char *);
 void print_dir_data_base (void);
 void dir_setup_glob (glob_t *);
+int dir_glob (const char *, const char ***, unsigned int *);
 void hash_init_directories (void);
 
 void define_default_variables (void);
@@ -566,6 +587,7 @@ void install_default_implicit_rules (void);
 
 void build_vpath_lists (void);
 void construct_vpath_list (char *pattern, char *dirpath);
+void map_vpaths (void (*fn) (const char *, const char **, void *), void *arg);
 const char *vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
                           unsigned int* vpath_index, unsigned int* path_index);
 int gpath_search (const char *file, unsigned int len);
@@ -584,6 +606,8 @@ void show_goal_error (void);
 void strcache_init (void);
 void strcache_print_stats (const char *prefix);
 int strcache_iscached (const char *str);
+unsigned int strcache_len (const char *str);
+unsigned int strcache_hash (const char *str);
 const char *strcache_add (const char *str);
 const char *strcache_add_len (const char *str, unsigned int len);
 
@@ -671,6 +695,7 @@ extern char cmd_prefix;
 
 extern unsigned int job_slots;
 extern double max_load_average;
+extern unsigned long max_memory;
 
 extern const char *program;
 
@@ -720,6 +745,7 @@ extern unsigned int makelevel;
 extern char *version_string, *remote_description, *make_host;
 
 extern unsigned int commands_started;
+extern unsigned int file_generation;
 
 extern int handling_fatal_signal;
 
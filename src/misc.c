@@ -33,6 +33,11 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 # include <sys/file.h>
 #endif
 
+#if defined(__SSE2__) && defined(__GNUC__)
+# include <emmintrin.h>
+# define SCAN_SSE2
+#endif
+
 /* Compare strings *S1 and *S2.
    Return negative if the first is less, positive if it is greater,
    zero if they are equal.  */
@@ -281,6 +286,79 @@ xstrndup (const char *str, unsigned int length)
   return result;
 }
 
+/* Size of the blocks objects are carved out of by pool_alloc.  */
+
+#define POOL_BLOCK_SIZE 65536
+
+/* Return a new zeroed object from POOL.  Objects are carved out of large
+   blocks which are never given back to the system: this is much cheaper
+   than a call to malloc for each of the many small records make keeps
+   until it exits, and keeps records made together close together in
+   memory.  Objects returned with pool_free are reused first.  */
+
+void *
+pool_alloc (struct pool *pool)
+{
+  void *obj = pool->free;
+
+  if (obj != 0)
+    {
+      pool->free = *(void **) obj;
+      memset (obj, '\0', pool->size);
+      return obj;
+    }
+
+  if (pool->next == pool->end)
+    {
+      unsigned int n = POOL_BLOCK_SIZE / pool->size;
+
+      if (n == 0)
+        n = 1;
+      pool->next = xcalloc (n * pool->size);
+      pool->end = pool->next + n * pool->size;
+    }
+
+  obj = pool->next;
+  pool->next += pool->size;
+  return obj;
+}
+
+/* Return N consecutive zeroed objects from POOL.  Each can be given back
+   on its own with pool_free.  */
+
+void *
+pool_alloc_array (struct pool *pool, unsigned int n)
+{
+  void *obj;
+
+  if ((size_t) (pool->end - pool->next) < (size_t) n * pool->size)
+    {
+      unsigned int count = POOL_BLOCK_SIZE / pool->size;
+
+      /* Keep what is left of the current block for pool_alloc.  */
+      for (; pool->next < pool->end; pool->next += pool->size)
+        pool_free (pool, pool->next);
+
+      if (count < n)
+        count = n;
+      pool->next = xcalloc (count * pool->size);
+      pool->end = pool->next + count * pool->size;
+    }
+
+  obj = pool->next;
+  pool->next += n * pool->size;
+  return obj;
+}
+
+/* Give OBJ back to POOL, which it was allocated from.  */
+
+void
+pool_free (struct pool *pool, void *obj)
+{
+  *(void **) obj = pool->free;
+  pool->free = obj;
+}
+
 
 /* Limited INDEX:
    Search through the string STRING, which ends at LIMIT, for the character C.
@@ -298,13 +376,74 @@ lindex (const char *s, const char *limit, int c)
   return 0;
 }
 
+/* Return the address of the first character in S that is in the stop set
+   MAP.  MAP must include MAP_NUL, or some other character known to be in S,
+   so that the scan ends.  */
+
+/* The stop sets that find_stopchar can scan 16 bytes at a time.  */
+#define SCAN_MAPS (MAP_NUL|MAP_BLANK|MAP_NEWLINE|MAP_COMMENT|MAP_SEMI \
+                   |MAP_EQUALS|MAP_COLON|MAP_PIPE|MAP_VARIABLE)
+
+char *
+find_stopchar (const char *s, int map)
+{
+#ifdef SCAN_SSE2
+  if (NONE_SET (map, ~SCAN_MAPS))
+    {
+      /* Every character in these sets is one of those compared below, or
+         isn't ASCII (isspace() may accept some of those in other locales),
+         so only the marked positions in each block need a closer look.
+         The loads are aligned, so they never cross into a page that the
+         string doesn't reach.  */
+      const __m128i *v = (const __m128i *) ((uintptr_t) s & ~(uintptr_t) 15);
+      unsigned int skip = (unsigned int) ((uintptr_t) s & 15);
+      const __m128i tab = _mm_set1_epi8 ('\t');
+      const __m128i four = _mm_set1_epi8 (4);
+
+      while (1)
+        {
+          __m128i b = _mm_load_si128 (v);
+          __m128i t = _mm_sub_epi8 (b, tab);
+          __m128i m;
+          unsigned int mask;
+
+          /* \t, \n, \v, \f and \r are consecutive.  */
+          m = _mm_cmpeq_epi8 (_mm_min_epu8 (t, four), t);
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_setzero_si128 ()));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 (' ')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 ('#')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 (';')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 ('=')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 (':')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 ('|')));
+          m = _mm_or_si128 (m, _mm_cmpeq_epi8 (b, _mm_set1_epi8 ('$')));
+          mask = _mm_movemask_epi8 (m) | _mm_movemask_epi8 (b);
+          mask &= ~0U << skip;
+          skip = 0;
+
+          while (mask)
+            {
+              const char *p = (const char *) v + __builtin_ctz (mask);
+              if (STOP_SET (*p, map))
+                return (char *) p;
+              mask &= mask - 1;
+            }
+          ++v;
+        }
+    }
+#endif
+
+  while (! STOP_SET (*s, map))
+    ++s;
+  return (char *)s;
+}
+
 /* Return the address of the first whitespace or null in the string S.  */
 
 char *
 end_of_token (const char *s)
 {
-  END_OF_TOKEN (s);
-  return (char *)s;
+  return find_stopchar (s, MAP_SPACE|MAP_NUL);
 }
 
 /* Return the address of the first nonwhitespace or null in the string S.  */
@@ -346,7 +485,7 @@ copy_dep_chain (const struct dep *d)
 
   while (d != 0)
     {
-      struct dep *c = xmalloc (sizeof (struct dep));
+      struct dep *c = alloc_dep ();
       memcpy (c, d, sizeof (struct dep));
 
       if (c->need_2nd_expansion)
@@ -377,6 +516,24 @@ free_ns_chain (struct nameseq *ns)
       free_ns (t);
     }
 }
+
+/* Free a chain of struct goaldep.  */
+
+void
+free_goal_chain (struct goaldep *g)
+{
+  while (g != 0)
+    {
+      struct goaldep *t = g;
+      g = g->next;
+      free_goaldep (t);
+    }
+}
+
+/* The pools elements of chains are allocated from: see dep.h.  */
+
+struct pool seq_pool = POOL_INIT (struct dep);
+struct pool goaldep_pool = POOL_INIT (struct goaldep);
 
 
 /* Provide support for temporary files.  */
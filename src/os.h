@@ -22,8 +22,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 /* Returns 1 if the jobserver is enabled, else 0.  */
 unsigned int jobserver_enabled (void);
 
-/* Called in the master instance to set up the jobserver initially.  */
-unsigned int jobserver_setup (int job_slots);
+/* Called in the master instance to set up the jobserver initially.
+   STYLE selects the kind of jobserver, or NULL for the default.  */
+unsigned int jobserver_setup (int job_slots, const char *style);
 
 /* Called in a child instance to connect to the jobserver.  */
 unsigned int jobserver_parse_auth (const char* auth);
@@ -62,7 +63,7 @@ unsigned int jobserver_acquire (int timeout);
 #else
 
 #define jobserver_enabled()         (0)
-#define jobserver_setup(_slots)     (0)
+#define jobserver_setup(_slots,_st) (0)
 #define jobserver_parse_auth(_auth) (0)
 #define jobserver_get_auth()        (NULL)
 #define jobserver_clear()           (void)(0)
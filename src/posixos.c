@@ -24,10 +24,14 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 # include <sys/file.h>
 #endif
 
-#if defined(HAVE_PSELECT) && defined(HAVE_SYS_SELECT_H)
+#ifdef HAVE_SYS_SELECT_H
 # include <sys/select.h>
 #endif
 
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #include "debug.h"
 #include "job.h"
 #include "os.h"
@@ -47,6 +51,35 @@ static int job_rfd = -1;
 /* Token written to the pipe (could be any character...)  */
 static char token = '+';
 
+/* The kind of jobserver in use.  */
+static enum { js_none = 0, js_pipe, js_fifo } js_type = js_none;
+
+/* For a FIFO jobserver, the name of the FIFO and of the accounting socket.
+   FIFO_OWNER is nonzero in the master, which created them.  */
+static char *fifo_name = NULL;
+static char *acct_name = NULL;
+static unsigned int fifo_owner = 0;
+
+/* Token accounting for FIFO jobservers.  The master listens on a unix
+   socket next to the FIFO; each client make connects to it and sends a '+'
+   for every token it reads from the FIFO and a '-' for every token it
+   writes back.  If a client dies holding tokens the kernel closes its
+   connection, and the master writes the missing tokens back to the FIFO.
+
+   In the master ACCT_FD is the listening socket; in a client it is the
+   connection to the master, or -1 if there is none.  */
+static int acct_fd = -1;
+
+struct js_client
+  {
+    struct js_client *next;
+    int fd;                     /* Our end of the client's connection.  */
+    pid_t pid;                  /* The client's process ID, if known.  */
+    int tokens;                 /* Tokens the client holds.  */
+  };
+
+static struct js_client *js_clients = NULL;
+
 static int
 make_job_rfd (void)
 {
@@ -80,14 +113,301 @@ set_blocking (int fd, int blocking)
 #endif
 }
 
-unsigned int
-jobserver_setup (int slots)
+static void
+set_nonblocking (int fd)
+{
+  int flags;
+  EINTRLOOP (flags, fcntl (fd, F_GETFL));
+  if (flags >= 0)
+    EINTRLOOP (flags, fcntl (fd, F_SETFL, flags | O_NONBLOCK));
+}
+
+/* Open both ends of the jobserver FIFO.  Return 0 on success, or -1 with
+   errno set.  */
+static int
+open_fifo (void)
+{
+  int flags;
+
+  /* Open the read side without blocking, so there is a reader when we open
+     the write side.  Then restore blocking reads; set_blocking() below
+     decides what we really want.  */
+  EINTRLOOP (job_fds[0], open (fifo_name, O_RDONLY|O_NONBLOCK));
+  if (job_fds[0] < 0)
+    return -1;
+
+  EINTRLOOP (job_fds[1], open (fifo_name, O_WRONLY));
+  if (job_fds[1] < 0)
+    {
+      int e = errno;
+      close (job_fds[0]);
+      job_fds[0] = -1;
+      errno = e;
+      return -1;
+    }
+
+  EINTRLOOP (flags, fcntl (job_fds[0], F_GETFL));
+  if (flags >= 0)
+    EINTRLOOP (flags, fcntl (job_fds[0], F_SETFL, flags & ~O_NONBLOCK));
+
+  /* Nobody needs these FDs: children open the FIFO by name.  */
+  fd_noinherit (job_fds[0]);
+  fd_noinherit (job_fds[1]);
+
+  return 0;
+}
+
+static int
+acct_address (struct sockaddr_un *sun)
+{
+  if (strlen (acct_name) >= sizeof (sun->sun_path))
+    return -1;
+
+  memset (sun, '\0', sizeof (*sun));
+  sun->sun_family = AF_UNIX;
+  strcpy (sun->sun_path, acct_name);
+  return 0;
+}
+
+/* In the master, start listening for clients.  Accounting is best-effort:
+   if it can't be set up the FIFO jobserver still works without it.  */
+static void
+acct_listen (void)
+{
+  struct sockaddr_un sun;
+  int r;
+
+  if (acct_address (&sun) < 0)
+    return;
+
+  EINTRLOOP (acct_fd, socket (AF_UNIX, SOCK_STREAM, 0));
+  if (acct_fd < 0)
+    return;
+
+  unlink (acct_name);
+  if (bind (acct_fd, (struct sockaddr *) &sun, sizeof (sun)) < 0
+      || listen (acct_fd, 64) < 0)
+    {
+      DB (DB_JOBS, (_("Jobserver accounting disabled: %s\n"),
+                    strerror (errno)));
+      close (acct_fd);
+      acct_fd = -1;
+      return;
+    }
+  EINTRLOOP (r, chmod (acct_name, 0600));
+
+  fd_noinherit (acct_fd);
+  set_nonblocking (acct_fd);
+}
+
+/* In a client, connect to the master's accounting socket, if it has one.  */
+static void
+acct_connect (void)
 {
+  struct sockaddr_un sun;
   int r;
 
-  EINTRLOOP (r, pipe (job_fds));
+  if (acct_address (&sun) < 0)
+    return;
+
+  EINTRLOOP (acct_fd, socket (AF_UNIX, SOCK_STREAM, 0));
+  if (acct_fd < 0)
+    return;
+
+  EINTRLOOP (r, connect (acct_fd, (struct sockaddr *) &sun, sizeof (sun)));
   if (r < 0)
-    pfatal_with_name (_("creating jobs pipe"));
+    {
+      DB (DB_JOBS, (_("No jobserver accounting: %s\n"), strerror (errno)));
+      close (acct_fd);
+      acct_fd = -1;
+      return;
+    }
+
+  fd_noinherit (acct_fd);
+}
+
+/* In a client, tell the master we took ('+') or returned ('-') a token.  */
+static void
+acct_note (char c)
+{
+  ssize_t r;
+
+  if (fifo_owner || acct_fd < 0)
+    return;
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+  EINTRLOOP (r, send (acct_fd, &c, 1, MSG_NOSIGNAL));
+  if (r != 1)
+    {
+      /* The master is gone: stop reporting.  */
+      close (acct_fd);
+      acct_fd = -1;
+    }
+}
+
+/* In the master, accept new clients and read their reports.  If READFDS is
+   not NULL only look at connections it marks as readable.  Clients that
+   have gone away are forgotten, and any tokens they still held are written
+   back to the FIFO.  */
+static void
+acct_poll (fd_set *readfds)
+{
+  struct js_client **cp;
+
+  if (!fifo_owner || acct_fd < 0)
+    return;
+
+  if (!readfds || FD_ISSET (acct_fd, readfds))
+    while (1)
+      {
+        struct js_client *c;
+        int fd;
+
+        EINTRLOOP (fd, accept (acct_fd, NULL, NULL));
+        if (fd < 0)
+          break;
+
+        fd_noinherit (fd);
+        set_nonblocking (fd);
+
+        c = xcalloc (sizeof (struct js_client));
+        c->fd = fd;
+#ifdef SO_PEERCRED
+        {
+          struct ucred cred;
+          socklen_t len = sizeof (cred);
+          if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+            c->pid = cred.pid;
+        }
+#endif
+        c->next = js_clients;
+        js_clients = c;
+
+        DB (DB_JOBS, (_("Jobserver client %ld connected\n"), (long) c->pid));
+      }
+
+  cp = &js_clients;
+  while (*cp)
+    {
+      struct js_client *c = *cp;
+      char buf[256];
+      ssize_t n;
+
+      if (readfds && !FD_ISSET (c->fd, readfds))
+        {
+          cp = &c->next;
+          continue;
+        }
+
+      while (1)
+        {
+          ssize_t i;
+
+          EINTRLOOP (n, read (c->fd, buf, sizeof (buf)));
+          if (n <= 0)
+            break;
+          for (i = 0; i < n; ++i)
+            c->tokens += buf[i] == '+' ? 1 : buf[i] == '-' ? -1 : 0;
+        }
+
+      if (n < 0 && errno == EAGAIN)
+        {
+          cp = &c->next;
+          continue;
+        }
+
+      /* The client has exited.  Take back whatever it didn't return.  */
+      if (c->tokens > 0)
+        DB (DB_JOBS, (_("Jobserver client %ld exited holding %d tokens\n"),
+                      (long) c->pid, c->tokens));
+      while (c->tokens-- > 0)
+        jobserver_release (0);
+
+      *cp = c->next;
+      close (c->fd);
+      free (c);
+    }
+}
+
+/* In the master, add the accounting connections to READFDS.  */
+static void
+acct_fdset (fd_set *readfds, int *maxfd)
+{
+  struct js_client *c;
+
+  if (!fifo_owner || acct_fd < 0)
+    return;
+
+  FD_SET (acct_fd, readfds);
+  if (acct_fd > *maxfd)
+    *maxfd = acct_fd;
+
+  for (c = js_clients; c; c = c->next)
+    {
+      FD_SET (c->fd, readfds);
+      if (c->fd > *maxfd)
+        *maxfd = c->fd;
+    }
+}
+
+static unsigned int
+fifo_setup (void)
+{
+  const char *tmpdir = getenv ("TMPDIR");
+  int r;
+
+  if (!tmpdir || !*tmpdir)
+    tmpdir = "/tmp";
+
+  fifo_name = xmalloc (strlen (tmpdir) + CSTRLEN ("/GMfifo") + INTSTR_LENGTH
+                       + 1);
+  sprintf (fifo_name, "%s/GMfifo%ld", tmpdir, (long) getpid ());
+
+  EINTRLOOP (r, mkfifo (fifo_name, 0600));
+  if (r < 0 || open_fifo () < 0)
+    {
+      OSS (error, NILF, _("cannot create jobserver fifo %s: %s"),
+           fifo_name, strerror (errno));
+      if (r == 0)
+        unlink (fifo_name);
+      free (fifo_name);
+      fifo_name = NULL;
+      return 0;
+    }
+
+  fifo_owner = 1;
+
+  acct_name = xmalloc (strlen (fifo_name) + CSTRLEN (".acct") + 1);
+  sprintf (acct_name, "%s.acct", fifo_name);
+  acct_listen ();
+
+  return 1;
+}
+
+unsigned int
+jobserver_setup (int slots, const char *style)
+{
+  int r;
+
+  if (style == NULL || streq (style, "pipe"))
+    js_type = js_pipe;
+  else if (streq (style, "fifo"))
+    js_type = js_fifo;
+  else
+    OS (fatal, NILF, _("unknown jobserver style '%s'"), style);
+
+  /* Fall back to a pipe if we can't create the FIFO.  */
+  if (js_type == js_fifo && !fifo_setup ())
+    js_type = js_pipe;
+
+  if (js_type == js_pipe)
+    {
+      EINTRLOOP (r, pipe (job_fds));
+      if (r < 0)
+        pfatal_with_name (_("creating jobs pipe"));
+    }
 
   /* By default we don't send the job pipe FDs to our children.
      See jobserver_pre_child() and jobserver_post_child().  */
@@ -113,6 +433,32 @@ jobserver_setup (int slots)
 unsigned int
 jobserver_parse_auth (const char *auth)
 {
+  /* A FIFO jobserver is named in the auth string: open it ourselves.  */
+  if (strneq (auth, "fifo:", CSTRLEN ("fifo:")))
+    {
+      fifo_name = xstrdup (auth + CSTRLEN ("fifo:"));
+
+      DB (DB_JOBS, (_("Jobserver client (fifo %s)\n"), fifo_name));
+
+      if (open_fifo () < 0 || make_job_rfd () < 0)
+        {
+          OSS (error, NILF, _("cannot open jobserver fifo %s: %s"),
+               fifo_name, strerror (errno));
+          jobserver_clear ();
+          return 0;
+        }
+
+      js_type = js_fifo;
+
+      acct_name = xmalloc (strlen (fifo_name) + CSTRLEN (".acct") + 1);
+      sprintf (acct_name, "%s.acct", fifo_name);
+      acct_connect ();
+
+      set_blocking (job_fds[0], 0);
+
+      return 1;
+    }
+
   /* Given the command-line parameter, parse it.  */
   if (sscanf (auth, "%d,%d", &job_fds[0], &job_fds[1]) != 2)
     OS (fatal, NILF,
@@ -142,6 +488,8 @@ jobserver_parse_auth (const char *auth)
       return 0;
     }
 
+  js_type = js_pipe;
+
   /* When using pselect() we want the read to be non-blocking.  */
   set_blocking (job_fds[0], 0);
 
@@ -151,7 +499,16 @@ jobserver_parse_auth (const char *auth)
 char *
 jobserver_get_auth (void)
 {
-  char *auth = xmalloc ((INTSTR_LENGTH * 2) + 2);
+  char *auth;
+
+  if (js_type == js_fifo)
+    {
+      auth = xmalloc (CSTRLEN ("fifo:") + strlen (fifo_name) + 1);
+      sprintf (auth, "fifo:%s", fifo_name);
+      return auth;
+    }
+
+  auth = xmalloc ((INTSTR_LENGTH * 2) + 2);
   sprintf (auth, "%d,%d", job_fds[0], job_fds[1]);
   return auth;
 }
@@ -173,6 +530,32 @@ jobserver_clear (void)
     close (job_rfd);
 
   job_fds[0] = job_fds[1] = job_rfd = -1;
+
+  while (js_clients)
+    {
+      struct js_client *c = js_clients;
+      js_clients = c->next;
+      close (c->fd);
+      free (c);
+    }
+
+  if (acct_fd >= 0)
+    close (acct_fd);
+  acct_fd = -1;
+
+  /* The master removes the FIFO; clients just forget its name.  */
+  if (fifo_owner)
+    {
+      unlink (fifo_name);
+      if (acct_name)
+        unlink (acct_name);
+    }
+
+  free (fifo_name);
+  free (acct_name);
+  fifo_name = acct_name = NULL;
+  fifo_owner = 0;
+  js_type = js_none;
 }
 
 void
@@ -186,6 +569,8 @@ jobserver_release (int is_fatal)
         pfatal_with_name (_("write jobserver"));
       perror_with_name ("write", "");
     }
+  else
+    acct_note ('-');
 }
 
 unsigned int
@@ -193,6 +578,9 @@ jobserver_acquire_all (void)
 {
   unsigned int tokens = 0;
 
+  /* Recover tokens held by clients that died without returning them.  */
+  acct_poll (NULL);
+
   /* Use blocking reads to wait for all outstanding jobs.  */
   set_blocking (job_fds[0], 1);
 
@@ -215,7 +603,8 @@ jobserver_acquire_all (void)
 void
 jobserver_pre_child (int recursive)
 {
-  if (recursive && job_fds[0] >= 0)
+  /* Children find a FIFO by name; only a pipe must be inherited.  */
+  if (recursive && js_type == js_pipe)
     {
       fd_inherit (job_fds[0]);
       fd_inherit (job_fds[1]);
@@ -226,7 +615,7 @@ jobserver_pre_child (int recursive)
 void
 jobserver_post_child (int recursive)
 {
-  if (recursive && job_fds[0] >= 0)
+  if (recursive && js_type == js_pipe)
     {
       fd_noinherit (job_fds[0]);
       fd_noinherit (job_fds[1]);
@@ -249,6 +638,9 @@ jobserver_pre_acquire (void)
   /* Make sure we have a dup'd FD.  */
   if (job_rfd < 0 && job_fds[0] >= 0 && make_job_rfd () < 0)
     pfatal_with_name (_("duping jobs pipe"));
+
+  /* Catch up on clients that have come and gone.  */
+  acct_poll (NULL);
 }
 
 #ifdef HAVE_PSELECT
@@ -280,13 +672,18 @@ jobserver_acquire (int timeout)
   while (1)
     {
       fd_set readfds;
+      int maxfd;
       int r;
       char intake;
 
       FD_ZERO (&readfds);
       FD_SET (job_fds[0], &readfds);
+      maxfd = job_fds[0];
 
-      r = pselect (job_fds[0]+1, &readfds, NULL, NULL, specp, &empty);
+      /* The master also listens for clients reporting their tokens.  */
+      acct_fdset (&readfds, &maxfd);
+
+      r = pselect (maxfd+1, &readfds, NULL, NULL, specp, &empty);
       if (r < 0)
         switch (errno)
           {
@@ -307,6 +704,10 @@ jobserver_acquire (int timeout)
         /* Timeout.  */
         return 0;
 
+      acct_poll (&readfds);
+      if (!FD_ISSET (job_fds[0], &readfds))
+        continue;
+
       /* The read FD is ready: read it!  This is non-blocking.  */
       EINTRLOOP (r, read (job_fds[0], &intake, 1));
 
@@ -321,6 +722,8 @@ jobserver_acquire (int timeout)
 
       /* read() should never return 0: only the master make can reap all the
          tokens and close the write side...??  */
+      if (r > 0)
+        acct_note ('+');
       return r > 0;
     }
 }
@@ -423,7 +826,10 @@ jobserver_acquire (int timeout)
   set_child_handler_action_flags (0, timeout);
 
   if (got_token == 1)
-    return 1;
+    {
+      acct_note ('+');
+      return 1;
+    }
 
   /* If the error _wasn't_ expected (EINTR or EBADF), fatal.  Otherwise,
      go back and reap_children(), and try again.  */
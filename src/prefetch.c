@@ -0,0 +1,481 @@
+/* Looking up file modification times ahead of time for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "hash.h"
+#include "filedef.h"
+#include "debug.h"
+#include "dbcache.h"
+
+/* Before the goals are updated, the names of all the files that will
+   probably have their mtimes checked are known.  Rather than let the walk
+   over the graph stat them one at a time, they are all stat'd at once up
+   front: as a batch of statx requests through io_uring where the kernel
+   has it, or by a few threads otherwise.  The waits for the disk then
+   overlap instead of following each other.
+
+   The answers are only kept until something might change the file
+   system, that is until file_generation moves on; name_mtime asks for
+   one before it calls stat itself.  */
+
+#if HAVE_DECL_IORING_OP_STATX && defined(HAVE_STATX)
+# include <sys/syscall.h>
+# if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  define PREFETCH_URING
+# endif
+#endif
+
+#ifdef MAKE_THREADS
+# include <pthread.h>
+# include <signal.h>
+#endif
+
+#if defined(PREFETCH_URING) || defined(MAKE_THREADS)
+
+/* Below this many files it isn't worth the trouble.  */
+#define PREFETCH_MIN    64
+
+/* How many requests go into the ring at once.  */
+#define URING_ENTRIES   256
+
+/* How many threads stat files when there is no io_uring.  They mostly
+   wait, so there can be more of them than there are CPUs.  */
+#define PREFETCH_THREADS 8
+
+struct prefetch
+  {
+    const char *name;           /* The file name, in the strcache.  */
+    int error;                  /* 0, the errno from stat, or NOT_DONE.  */
+    time_t sec;                 /* The modification time.  */
+    long int nsec;
+  };
+
+#define NOT_DONE        (-1)
+
+static unsigned long
+prefetch_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct prefetch *) key)->name);
+}
+
+static unsigned long
+prefetch_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct prefetch *) key)->name);
+}
+
+static int
+prefetch_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct prefetch *) x)->name,
+                         ((const struct prefetch *) y)->name);
+}
+
+static struct prefetch *prefetches;
+static unsigned int prefetch_count;
+static unsigned int prefetch_size;
+static struct hash_table prefetch_table;
+static unsigned int prefetch_generation;
+
+/* Add FILE to the list of files to stat, unless its mtime can't be
+   needed or is already known, here, from the last run or in the
+   directory cache.  */
+
+static void
+collect_file (const void *item, void *arg UNUSED)
+{
+  const struct file *f = item;
+
+  if (f->phony || f->last_mtime != UNKNOWN_MTIME)
+    return;
+#ifndef NO_ARCHIVES
+  if (ar_name (f->name))
+    return;
+#endif
+  if (filestate_mtime (f->name) != UNKNOWN_MTIME
+      || dir_file_mtime (f->name, 0) != UNKNOWN_MTIME)
+    return;
+
+  if (prefetch_count == prefetch_size)
+    {
+      prefetch_size = prefetch_size ? prefetch_size * 2 : 1024;
+      prefetches = xrealloc (prefetches,
+                             prefetch_size * sizeof (struct prefetch));
+    }
+  prefetches[prefetch_count].name = f->name;
+  prefetches[prefetch_count].error = NOT_DONE;
+  ++prefetch_count;
+}
+
+#ifdef PREFETCH_URING
+
+/* The two rings shared with the kernel.  */
+
+struct uring
+  {
+    int fd;
+    unsigned int entries;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+  };
+
+static int
+uring_open (struct uring *r, unsigned int entries)
+{
+  struct io_uring_params p;
+
+  memset (&p, '\0', sizeof (p));
+  r->fd = syscall (__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0)
+    return 0;
+
+  r->entries = p.sq_entries;
+  r->sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  r->sqes_len = p.sq_entries * sizeof (struct io_uring_sqe);
+
+  r->sq_ptr = mmap (0, r->sq_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_ptr = r->sq_ptr == MAP_FAILED ? MAP_FAILED
+    : mmap (0, r->cq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes = r->cq_ptr == MAP_FAILED ? MAP_FAILED
+    : mmap (0, r->sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+    {
+      if (r->cq_ptr != MAP_FAILED)
+        munmap (r->cq_ptr, r->cq_len);
+      if (r->sq_ptr != MAP_FAILED)
+        munmap (r->sq_ptr, r->sq_len);
+      close (r->fd);
+      return 0;
+    }
+
+  r->sq_tail = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.tail);
+  r->sq_mask = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.ring_mask);
+  r->sq_array = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.array);
+  r->cq_head = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.head);
+  r->cq_tail = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.tail);
+  r->cq_mask = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ptr + p.cq_off.cqes);
+
+  return 1;
+}
+
+static void
+uring_close (struct uring *r)
+{
+  munmap (r->sqes, r->sqes_len);
+  munmap (r->cq_ptr, r->cq_len);
+  munmap (r->sq_ptr, r->sq_len);
+  close (r->fd);
+}
+
+/* Stat all the files with io_uring.  Return zero if that can't be done,
+   leaving the rest for the threads.  */
+
+static int
+prefetch_uring (void)
+{
+  struct uring r;
+  struct statx *bufs;
+  unsigned int next = 0;
+  int ok = 1;
+
+  if (!uring_open (&r, URING_ENTRIES))
+    return 0;
+
+  bufs = xmalloc (r.entries * sizeof (struct statx));
+
+  while (ok && next < prefetch_count)
+    {
+      unsigned int n = MIN (r.entries, prefetch_count - next);
+      unsigned int tail = *r.sq_tail;
+      unsigned int head;
+      unsigned int i;
+      int e;
+
+      for (i = 0; i < n; ++i)
+        {
+          unsigned int idx = (tail + i) & *r.sq_mask;
+          struct io_uring_sqe *sqe = &r.sqes[idx];
+
+          memset (sqe, '\0', sizeof (*sqe));
+          sqe->opcode = IORING_OP_STATX;
+          sqe->fd = AT_FDCWD;
+          sqe->addr = (unsigned long) prefetches[next + i].name;
+          sqe->len = STATX_MTIME;
+          sqe->addr2 = (unsigned long) &bufs[i];
+          sqe->user_data = i;
+          r.sq_array[idx] = idx;
+        }
+      __atomic_store_n (r.sq_tail, tail + n, __ATOMIC_RELEASE);
+
+      do
+        e = syscall (__NR_io_uring_enter, r.fd, n, n,
+                     IORING_ENTER_GETEVENTS, NULL, 0);
+      while (e < 0 && errno == EINTR);
+      if (e < 0)
+        {
+          ok = 0;
+          break;
+        }
+      if ((unsigned int) e < n)
+        {
+          /* Not everything was submitted, and what was is still in
+             flight.  */
+          bufs = 0;
+          ok = 0;
+          break;
+        }
+
+      /* Every request was submitted; wait for the answers.  */
+      head = *r.cq_head;
+      for (i = 0; i < n; )
+        {
+          unsigned int ctail = __atomic_load_n (r.cq_tail, __ATOMIC_ACQUIRE);
+
+          if (head == ctail)
+            {
+              do
+                e = syscall (__NR_io_uring_enter, r.fd, 0, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+              while (e < 0 && errno == EINTR);
+              if (e < 0)
+                {
+                  /* The kernel may still write into BUFS.  */
+                  bufs = 0;
+                  ok = 0;
+                  break;
+                }
+              continue;
+            }
+
+          for (; head != ctail; ++head, ++i)
+            {
+              struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+              unsigned int j = (unsigned int) cqe->user_data;
+              struct prefetch *pf = &prefetches[next + j];
+
+              if (cqe->res == 0)
+                {
+                  pf->error = 0;
+                  pf->sec = bufs[j].stx_mtime.tv_sec;
+                  pf->nsec = bufs[j].stx_mtime.tv_nsec;
+                }
+              else if (cqe->res == -EINVAL)
+                /* A kernel without IORING_OP_STATX.  */
+                ok = 0;
+              else
+                pf->error = -cqe->res;
+            }
+          __atomic_store_n (r.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+      next += n;
+    }
+
+  free (bufs);
+  uring_close (&r);
+
+  DB (DB_VERBOSE, (_("Looked up %u mtimes with io_uring.\n"), next));
+  return ok;
+}
+
+#endif /* PREFETCH_URING */
+
+#ifdef MAKE_THREADS
+
+static unsigned int thread_next;
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* How many files a thread takes at a time.  */
+#define THREAD_CHUNK    32
+
+static void *
+prefetch_worker (void *arg UNUSED)
+{
+  while (1)
+    {
+      unsigned int first, last;
+
+      pthread_mutex_lock (&thread_lock);
+      first = thread_next;
+      last = MIN (first + THREAD_CHUNK, prefetch_count);
+      thread_next = last;
+      pthread_mutex_unlock (&thread_lock);
+
+      if (first == last)
+        break;
+
+      for (; first < last; ++first)
+        {
+          struct prefetch *pf = &prefetches[first];
+          struct stat st;
+          int e;
+
+          if (pf->error != NOT_DONE)
+            continue;
+
+          EINTRLOOP (e, stat (pf->name, &st));
+          if (e != 0)
+            pf->error = errno;
+          else
+            {
+              pf->error = 0;
+              pf->sec = st.st_mtime;
+#ifdef ST_MTIM_NSEC
+              pf->nsec = st.ST_MTIM_NSEC;
+#else
+              pf->nsec = 0;
+#endif
+            }
+        }
+    }
+
+  return 0;
+}
+
+/* Stat the files no one has yet with a few threads.  */
+
+static void
+prefetch_threads (void)
+{
+  pthread_t threads[PREFETCH_THREADS];
+  sigset_t all, old;
+  unsigned int n;
+  unsigned int i;
+
+  thread_next = 0;
+  n = MIN (PREFETCH_THREADS, prefetch_count / THREAD_CHUNK + 1);
+
+  /* Leave signals to the main thread.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (i = 0; i < n; ++i)
+    if (pthread_create (&threads[i], NULL, prefetch_worker, NULL) != 0)
+      break;
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  /* Whatever the threads don't get to, name_mtime will.  */
+  n = i;
+  for (i = 0; i < n; ++i)
+    pthread_join (threads[i], NULL);
+
+  DB (DB_VERBOSE, (_("Looked up %u mtimes with %u threads.\n"),
+                   prefetch_count, n));
+}
+
+#endif /* MAKE_THREADS */
+
+/* Forget what was looked up.  */
+
+static void
+prefetch_free (void)
+{
+  if (prefetch_table.ht_vec)
+    hash_free (&prefetch_table, 0);
+  prefetch_table.ht_vec = 0;
+  free (prefetches);
+  prefetches = 0;
+  prefetch_count = prefetch_size = 0;
+}
+
+#endif /* PREFETCH_URING || MAKE_THREADS */
+
+/* Look up the mtimes of the files that updating the goals will ask for.  */
+
+void
+prefetch_mtimes (void)
+{
+#if defined(PREFETCH_URING) || defined(MAKE_THREADS)
+  unsigned int i;
+
+  prefetch_free ();
+  map_files (collect_file, NULL);
+  if (prefetch_count < PREFETCH_MIN)
+    {
+      prefetch_free ();
+      return;
+    }
+
+#ifdef PREFETCH_URING
+  if (!prefetch_uring ())
+#endif
+    {
+#ifdef MAKE_THREADS
+      prefetch_threads ();
+#endif
+    }
+
+  hash_init (&prefetch_table, prefetch_count,
+             prefetch_hash_1, prefetch_hash_2, prefetch_hash_cmp);
+  for (i = 0; i < prefetch_count; ++i)
+    if (prefetches[i].error != NOT_DONE)
+      hash_insert (&prefetch_table, &prefetches[i]);
+  prefetch_generation = file_generation;
+#endif
+}
+
+/* Return the mtime of the file NAME as looked up by prefetch_mtimes, or
+   UNKNOWN_MTIME if it wasn't or might have changed since.  Errors other
+   than the file not existing are left for the caller to find again.  */
+
+FILE_TIMESTAMP
+prefetched_mtime (const char *name)
+{
+#if defined(PREFETCH_URING) || defined(MAKE_THREADS)
+  struct prefetch key;
+  struct prefetch *pf;
+
+  if (prefetch_table.ht_vec == 0)
+    return UNKNOWN_MTIME;
+
+  if (prefetch_generation != file_generation)
+    {
+      prefetch_free ();
+      return UNKNOWN_MTIME;
+    }
+
+  key.name = name;
+  pf = hash_find_item (&prefetch_table, &key);
+  if (pf == 0)
+    return UNKNOWN_MTIME;
+
+  if (pf->error == 0)
+    return file_timestamp_cons (name, pf->sec, pf->nsec);
+  if (pf->error == ENOENT || pf->error == ENOTDIR)
+    return NONEXISTENT_MTIME;
+#else
+  (void) name;
+#endif
+  return UNKNOWN_MTIME;
+}
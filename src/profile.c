@@ -0,0 +1,111 @@
+/* Self-profiling for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "hash.h"
+#include "trace.h"
+#include "profile.h"
+
+/* With --profile, make counts the calls to, and the time spent in, a few
+   of its own functions that usually dominate a build with nothing to do,
+   and reports them together with the statistics of its main hash tables
+   when it exits.  Times include everything called from the function, so
+   eval() includes the expansions it does; a function that recurses is
+   only timed at its outermost call.  */
+
+struct profile_counter
+  {
+    const char *name;
+    unsigned long calls;        /* Number of calls.  */
+    unsigned int depth;         /* Current depth of recursion.  */
+    double start;               /* When the outermost call began.  */
+    double total;               /* Microseconds spent so far.  */
+  };
+
+static struct profile_counter counters[PROF_MAX] =
+  {
+    { "eval", 0, 0, 0.0, 0.0 },
+    { "variable_expand_string", 0, 0, 0.0, 0.0 },
+    { "pattern_search", 0, 0, 0.0, 0.0 },
+    { "f_mtime", 0, 0, 0.0, 0.0 },
+    { "target_environment", 0, 0, 0.0, 0.0 }
+  };
+
+/* The hash tables whose statistics we report.  */
+
+#define PROFILE_TABLES 8
+
+static struct
+  {
+    const char *name;
+    struct hash_table *ht;
+  } tables[PROFILE_TABLES];
+
+static unsigned int ntables = 0;
+
+void
+profile_enter (enum profile_phase p)
+{
+  struct profile_counter *c = &counters[p];
+
+  ++c->calls;
+  if (c->depth++ == 0)
+    c->start = trace_clock ();
+}
+
+void
+profile_leave (enum profile_phase p)
+{
+  struct profile_counter *c = &counters[p];
+
+  if (c->depth > 0 && --c->depth == 0)
+    c->total += trace_clock () - c->start;
+}
+
+/* Report the statistics of hash table HT, called NAME, with the profile.  */
+
+void
+profile_hash_table (const char *name, struct hash_table *ht)
+{
+  if (ntables < PROFILE_TABLES)
+    {
+      tables[ntables].name = name;
+      tables[ntables].ht = ht;
+      ++ntables;
+    }
+}
+
+void
+print_profile (void)
+{
+  unsigned int i;
+
+  printf (_("\n# Profile of make (PID %lu)\n"), (unsigned long) getpid ());
+  printf (_("# %-24s %12s %14s\n"), _("function"), _("calls"), _("seconds"));
+
+  for (i = 0; i < PROF_MAX; ++i)
+    printf ("# %-24s %12lu %14.6f\n",
+            counters[i].name, counters[i].calls, counters[i].total / 1e6);
+
+  for (i = 0; i < ntables; ++i)
+    {
+      printf (_("# %s hash-table stats:\n# "), tables[i].name);
+      hash_print_stats (tables[i].ht, stdout);
+      putc ('\n', stdout);
+    }
+
+  fflush (stdout);
+}
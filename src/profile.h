@@ -0,0 +1,38 @@
+/* Self-profiling for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The parts of make that --profile measures.  */
+enum profile_phase
+  {
+    PROF_EVAL,                  /* Parsing makefiles: eval().  */
+    PROF_EXPAND,                /* variable_expand_string().  */
+    PROF_PATTERN,               /* Implicit rule search: pattern_search().  */
+    PROF_MTIME,                 /* Finding timestamps: f_mtime().  */
+    PROF_ENVIRON,               /* Building job environments.  */
+    PROF_MAX
+  };
+
+struct hash_table;
+
+extern int profile_flag;
+
+void profile_enter (enum profile_phase p);
+void profile_leave (enum profile_phase p);
+void profile_hash_table (const char *name, struct hash_table *ht);
+void print_profile (void);
+
+#define PROFILE_ENTER(_p)   do{ if (profile_flag) profile_enter (_p); }while(0)
+#define PROFILE_LEAVE(_p)   do{ if (profile_flag) profile_leave (_p); }while(0)
@@ -27,7 +27,12 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "rule.h"
 #include "debug.h"
 #include "hash.h"
+#include "profile.h"
+#include "dbcache.h"
 
+#ifdef MAKE_THREADS
+# include <pthread.h>
+#endif
 
 #ifdef WINDOWS32
 #include <windows.h>
@@ -133,8 +138,18 @@ const floc *reading_file = 0;
 
 static struct goaldep *read_files = 0;
 
+/* The included makefiles being read ahead of time, if any.  */
+
+struct readahead;
+static struct readahead *read_ahead = 0;
+
 static struct goaldep *eval_makefile (const char *filename, int flags);
 static void eval (struct ebuffer *buffer, int flags);
+struct depfile;
+static struct depfile *readahead_take (const char *filename);
+static void readahead_stop (struct readahead *ra);
+static int eval_depfile (FILE **fpp, const char *filename, floc *flocp,
+                         struct depfile *ahead, int flags);
 
 static long readline (struct ebuffer *ebuf);
 static void do_undefine (char *name, enum variable_origin origin,
@@ -249,8 +264,12 @@ read_all_makefiles (const char **makefiles)
 #endif /* AMIGA */
 #endif /* VMS */
       const char **p = default_makefiles;
-      while (*p != 0 && !file_exists_p (*p))
-        ++p;
+      for (; *p != 0; ++p)
+        {
+          dbcache_note (*p, 0);
+          if (file_exists_p (*p))
+            break;
+        }
 
       if (*p != 0)
         {
@@ -319,6 +338,7 @@ eval_makefile (const char *filename, int flags)
   struct goaldep *deps;
   struct ebuffer ebuf;
   const floc *curfile;
+  struct depfile *ahead;
   char *expanded = 0;
 
   /* Create a new goaldep entry.  */
@@ -341,9 +361,14 @@ eval_makefile (const char *filename, int flags)
         printf (_(" (don't care)"));
       if (flags & RM_NO_TILDE)
         printf (_(" (no ~ expansion)"));
+      if (flags & RM_DEPFILE)
+        printf (_(" (dependency file)"));
       puts ("...");
     }
 
+  /* See if it was read ahead of time.  */
+  ahead = readahead_take (filename);
+
   /* First, get a stream to read.  */
 
   /* Expand ~ in FILENAME unless it came from 'include',
@@ -358,6 +383,7 @@ eval_makefile (const char *filename, int flags)
   errno = 0;
   ENULLLOOP (ebuf.fp, _fopen (filename, "r"));
   deps->error = errno;
+  dbcache_note (filename, 0);
 
   /* Check for unrecoverable errors: out of mem or FILE slots.  */
   switch (deps->error)
@@ -386,6 +412,7 @@ eval_makefile (const char *filename, int flags)
           const char *included = concat (3, include_directories[i],
                                          "/", filename);
           ebuf.fp = _fopen (included, "r");
+          dbcache_note (included, 0);
           if (ebuf.fp)
             {
               filename = included;
@@ -424,14 +451,27 @@ eval_makefile (const char *filename, int flags)
   do_variable_definition (&ebuf.floc, "MAKEFILE_LIST", filename, o_file,
                           f_append_value, 0);
 
+  curfile = reading_file;
+  reading_file = &ebuf.floc;
+
+  /* Try reading a dependency file the quick way.  If it has anything but
+     plain rules, read it like any other makefile.  */
+
+  if (eval_depfile (&ebuf.fp, filename, &ebuf.floc, ahead, flags))
+    {
+      reading_file = curfile;
+      _fclose (ebuf.fp);
+      errno = 0;
+      return deps;
+    }
+
   /* Evaluate the makefile */
 
+  readahead_stop (read_ahead);
+
   ebuf.size = 200;
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
 
-  curfile = reading_file;
-  reading_file = &ebuf.floc;
-
   eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
 
   reading_file = curfile;
@@ -445,6 +485,602 @@ eval_makefile (const char *filename, int flags)
   return deps;
 }
 
+/* Directives, which a rule in a dependency file can't start with.  */
+
+static const char *const depfile_directives[] =
+  {
+    "define", "endef", "undefine", "ifdef", "ifndef", "ifeq", "ifneq",
+    "else", "endif", "export", "unexport", "override", "private", "vpath",
+    "include", "-include", "sinclude", "include-deps", "-include-deps",
+    "load", "-load", 0
+  };
+
+/* Return the next word of the dependency file line at *PP that starts
+   before END, and store its length in *LENP; or return 0 if there is none.
+   Words are separated by blanks and backslash/newlines.  Leading "./"s are
+   stripped, as parse_file_seq() does.  */
+
+static const char *
+depfile_word (const char **pp, const char *end, unsigned int *lenp)
+{
+  const char *p = *pp;
+  const char *w;
+
+  while (p < end && (ISBLANK (*p) || *p == '\\' || *p == '\n'))
+    ++p;
+  if (p == end)
+    return 0;
+
+  w = p;
+  while (p < end && ! ISBLANK (*p) && *p != '\\' && *p != '\n')
+    ++p;
+  *pp = p;
+
+  while (p - w > 2 && w[0] == '.' && w[1] == '/')
+    {
+      w += 2;
+      while (*w == '/')
+        ++w;
+    }
+  if (w == p)
+    {
+      *lenp = 2;
+      return "./";
+    }
+
+  *lenp = p - w;
+  return w;
+}
+
+/* Return nonzero if BUF holds nothing but rules without recipes, the way
+   compilers write dependency files: "foo.o: foo.c foo.h" or "foo.h:".
+   There must be no variable or function references, comments, patterns,
+   wildcards, archive members, quoting, special targets or directives.  */
+
+static int
+depfile_check (const char *buf)
+{
+  const char *p = buf;
+
+  while (*p != '\0')
+    {
+      const char *bol;
+      const char *colon = 0;
+      const char *w;
+      const char *const *dp;
+      unsigned int len;
+
+      /* A recipe line can't be handled here.  */
+      if (*p == cmd_prefix || *p == '\t')
+        return 0;
+
+      /* Nor can a directive.  */
+      while (ISBLANK (*p))
+        ++p;
+      bol = p;
+      while (! STOP_SET (*p, MAP_SPACE|MAP_COLON|MAP_NUL))
+        ++p;
+      for (dp = depfile_directives; *dp != 0; ++dp)
+        if (strlen (*dp) == (size_t) (p - bol) && strneq (*dp, bol, p - bol))
+          return 0;
+
+      for (p = bol; *p != '\n' && *p != '\0'; ++p)
+        switch (*p)
+          {
+          case ':':
+            if (colon)
+              return 0;
+            colon = p;
+            break;
+
+          case '\\':
+            if (p[1] != '\n')
+              return 0;
+            ++p;
+            break;
+
+          case '$': case '#': case ';': case '=': case '%': case '|':
+          case '*': case '?': case '[': case '(': case ')': case '~':
+            return 0;
+
+          default:
+            if (STOP_SET (*p, MAP_NEWLINE))
+              return 0;
+            break;
+          }
+
+      if (!colon)
+        {
+          /* Only blank lines can have no colon.  */
+          if (p != bol)
+            return 0;
+        }
+      else
+        {
+          /* There must be targets, and none of them special.  */
+          const char *t = bol;
+
+          if (depfile_word (&t, colon, &len) == 0)
+            return 0;
+          for (t = bol; (w = depfile_word (&t, colon, &len)) != 0; )
+            if (w[0] == '.' && memchr (w, '/', len) == 0)
+              return 0;
+        }
+
+      if (*p == '\n')
+        ++p;
+    }
+
+  return 1;
+}
+
+/* A dependency file split into rules.  The words of each rule, targets
+   first, follow those of the rule before it in WORDS.  Since these are
+   filled in by worker threads they use malloc(), and give up rather than
+   calling fatal() when it fails.  */
+
+struct depword
+  {
+    const char *str;            /* Points into BUF, or at a constant.  */
+    unsigned int len;
+  };
+
+struct deprule
+  {
+    unsigned long lineno;       /* Line the rule starts on.  */
+    unsigned int ntargets;
+    unsigned int nprereqs;
+  };
+
+enum depstate { DF_WAITING, DF_READING, DF_OK, DF_FAILED };
+
+struct depfile
+  {
+    const char *name;           /* Name it was included by.  */
+    enum depstate state;
+    char *buf;                  /* The whole file.  */
+    struct deprule *rules;
+    struct depword *words;
+    unsigned long nrules;
+    unsigned long nwords;
+  };
+
+static void
+depfile_free (struct depfile *df)
+{
+  free (df->buf);
+  free (df->rules);
+  free (df->words);
+  df->buf = 0;
+  df->rules = 0;
+  df->words = 0;
+}
+
+/* Split DF->buf, which depfile_check() accepted, into rules and words.
+   Return nonzero on success.  */
+
+static int
+depfile_parse (struct depfile *df)
+{
+  const char *p = df->buf;
+  unsigned long maxrules = 64;
+  unsigned long maxwords = 1024;
+  unsigned long lineno = 1;
+
+  df->nrules = df->nwords = 0;
+  df->rules = malloc (maxrules * sizeof (struct deprule));
+  df->words = malloc (maxwords * sizeof (struct depword));
+  if (df->rules == 0 || df->words == 0)
+    return 0;
+
+  while (*p != '\0')
+    {
+      const char *bol = p;
+      const char *colon = 0;
+      unsigned long lines = 1;
+
+      /* Find the end of this line, and its colon.  */
+      for (; *p != '\n' && *p != '\0'; ++p)
+        if (*p == ':')
+          colon = p;
+        else if (*p == '\\')
+          {
+            ++p;
+            ++lines;
+          }
+
+      if (colon)
+        {
+          struct deprule *r;
+          const char *q;
+          unsigned int *countp;
+
+          if (df->nrules == maxrules)
+            {
+              void *n = realloc (df->rules,
+                                 (maxrules *= 2) * sizeof (struct deprule));
+              if (n == 0)
+                return 0;
+              df->rules = n;
+            }
+          r = &df->rules[df->nrules++];
+          r->lineno = lineno;
+          r->ntargets = r->nprereqs = 0;
+
+          /* The targets, then the prerequisites.  */
+          q = bol;
+          countp = &r->ntargets;
+          while (1)
+            {
+              struct depword *w;
+              const char *end = countp == &r->ntargets ? colon : p;
+
+              if (df->nwords == maxwords)
+                {
+                  void *n = realloc (df->words, (maxwords *= 2)
+                                     * sizeof (struct depword));
+                  if (n == 0)
+                    return 0;
+                  df->words = n;
+                }
+              w = &df->words[df->nwords];
+              w->str = depfile_word (&q, end, &w->len);
+              if (w->str != 0)
+                {
+                  ++df->nwords;
+                  ++*countp;
+                }
+              else if (countp == &r->ntargets)
+                {
+                  q = colon + 1;
+                  countp = &r->nprereqs;
+                }
+              else
+                break;
+            }
+        }
+
+      lineno += lines;
+      if (*p == '\n')
+        ++p;
+    }
+
+  return 1;
+}
+
+/* Read all of FP into DF, check it and split it up.  Return nonzero if
+   it is a dependency file we can handle.  */
+
+static int
+depfile_read (FILE *fp, struct depfile *df)
+{
+  size_t size = 8192;
+  size_t len = 0;
+  size_t n;
+
+  df->buf = malloc (size);
+  if (df->buf == 0)
+    return 0;
+
+  while ((n = _fread (df->buf + len, 1, size - len - 1, fp)) > 0)
+    {
+      len += n;
+      if (size - len < 2)
+        {
+          char *b = realloc (df->buf, size *= 2);
+          if (b == 0)
+            return 0;
+          df->buf = b;
+        }
+    }
+  df->buf[len] = '\0';
+
+  return strlen (df->buf) == len && depfile_check (df->buf)
+         && depfile_parse (df);
+}
+
+/* Enter the rules in DF into the database, as record_files() would.
+   FLOCP is updated to each rule in turn for error messages.  */
+
+static void
+depfile_record (struct depfile *df, floc *flocp)
+{
+  const struct depword *w = df->words;
+  unsigned long r;
+
+  for (r = 0; r < df->nrules; ++r)
+    {
+      const struct deprule *rule = &df->rules[r];
+      const struct depword *targets = w;
+      struct dep *deps = 0;
+      struct dep **dp = &deps;
+      unsigned int i;
+
+      flocp->lineno = rule->lineno;
+
+      w += rule->ntargets;
+      for (i = 0; i < rule->nprereqs; ++i, ++w)
+        {
+          struct dep *d = alloc_dep ();
+          d->name = strcache_add_len (w->str, w->len);
+          *dp = d;
+          dp = &d->next;
+        }
+      deps = enter_prereqs (deps, NULL);
+
+      for (i = 0; i < rule->ntargets; ++i)
+        {
+          struct file *f = enter_file (strcache_add_len (targets[i].str,
+                                                         targets[i].len));
+          struct dep *this;
+
+          if (f->double_colon)
+            OS (fatal, flocp,
+                _("target file '%s' has both : and :: entries"), f->name);
+          f->is_target = 1;
+
+          /* As in record_files, every target but the last gets a copy
+             of the prerequisites, which go after any it already has.  */
+          this = i + 1 < rule->ntargets ? copy_dep_chain (deps) : deps;
+          if (this != 0)
+            {
+              if (f->deps == 0)
+                f->deps = this;
+              else
+                {
+                  struct dep *d = f->deps;
+                  while (d->next != 0)
+                    d = d->next;
+                  d->next = this;
+                }
+            }
+        }
+    }
+}
+
+/* Included makefiles read ahead of time by worker threads.  The names in
+   an include directive are all known once it is expanded, so while the
+   main thread enters the rules of one file into the database, workers
+   read, check and split up the ones after it.  Nothing but reading is
+   done out of order, and no worker is running while eval() is, since it
+   can fork.  */
+
+struct readahead
+  {
+    struct depfile *files;
+    unsigned int count;
+    unsigned int next;          /* Next file for a worker to read.  */
+    unsigned int used;          /* Next file for the main thread.  */
+    int stop;                   /* Nonzero if the workers should quit.  */
+#ifdef MAKE_THREADS
+    unsigned int nthreads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t done;        /* A file was read.  */
+    pthread_cond_t room;        /* A file was used, or the workers should
+                                   stop.  */
+#endif
+  };
+
+/* How many files the workers may get ahead of the main thread.  */
+#define READAHEAD_WINDOW(_r)    (16 * (_r)->nthreads)
+
+#ifdef MAKE_THREADS
+
+static void *
+readahead_worker (void *arg)
+{
+  struct readahead *ra = arg;
+
+  pthread_mutex_lock (&ra->lock);
+  while (1)
+    {
+      struct depfile *df;
+      FILE *fp;
+      int ok = 0;
+
+      while (!ra->stop && ra->next < ra->count
+             && ra->next >= ra->used + READAHEAD_WINDOW (ra))
+        pthread_cond_wait (&ra->room, &ra->lock);
+      if (ra->stop || ra->next == ra->count)
+        break;
+
+      df = &ra->files[ra->next++];
+      df->state = DF_READING;
+      pthread_mutex_unlock (&ra->lock);
+
+      fp = _fopen (df->name, "r");
+      if (fp != 0)
+        {
+          ok = depfile_read (fp, df);
+          _fclose (fp);
+        }
+      if (!ok)
+        depfile_free (df);
+
+      pthread_mutex_lock (&ra->lock);
+      df->state = ok ? DF_OK : DF_FAILED;
+      pthread_cond_broadcast (&ra->done);
+    }
+  pthread_mutex_unlock (&ra->lock);
+
+  return 0;
+}
+
+#endif /* MAKE_THREADS */
+
+/* Start reading the makefiles in FILES ahead of time, if that's worth
+   doing.  Return the new readahead, or 0.  */
+
+static struct readahead *
+readahead_start (const struct nameseq *files)
+{
+#ifdef MAKE_THREADS
+  struct readahead *ra;
+  const struct nameseq *ns;
+  unsigned int count = 0;
+  long ncpus = 1;
+  sigset_t all, old;
+  unsigned int i;
+
+  for (ns = files; ns != 0; ns = ns->next)
+    ++count;
+
+# ifdef _SC_NPROCESSORS_ONLN
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+# endif
+
+  /* The main thread is kept busy entering what the workers read.  */
+  if (count < 2 || ncpus < 2)
+    return 0;
+
+  ra = xcalloc (sizeof (struct readahead));
+  ra->files = xcalloc (count * sizeof (struct depfile));
+  ra->count = count;
+  for (i = 0, ns = files; ns != 0; ++i, ns = ns->next)
+    ra->files[i].name = ns->name;
+
+  ra->nthreads = MIN (count, (unsigned int) ncpus - 1);
+  ra->threads = xmalloc (ra->nthreads * sizeof (pthread_t));
+  pthread_mutex_init (&ra->lock, NULL);
+  pthread_cond_init (&ra->done, NULL);
+  pthread_cond_init (&ra->room, NULL);
+
+  /* Leave signals to the main thread.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (i = 0; i < ra->nthreads; ++i)
+    if (pthread_create (&ra->threads[i], NULL, readahead_worker, ra) != 0)
+      break;
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  ra->nthreads = i;
+
+  return ra;
+#else
+  (void) files;
+  return 0;
+#endif
+}
+
+/* Make the workers of RA quit once they've read what they're reading.  */
+
+static void
+readahead_stop (struct readahead *ra)
+{
+#ifdef MAKE_THREADS
+  unsigned int i;
+
+  if (ra == 0 || ra->stop)
+    return;
+
+  pthread_mutex_lock (&ra->lock);
+  ra->stop = 1;
+  pthread_cond_broadcast (&ra->room);
+  pthread_mutex_unlock (&ra->lock);
+
+  for (i = 0; i < ra->nthreads; ++i)
+    pthread_join (ra->threads[i], NULL);
+#endif
+}
+
+/* Stop the workers of RA and free it.  */
+
+static void
+readahead_finish (struct readahead *ra)
+{
+  unsigned int i;
+
+  if (ra == 0)
+    return;
+
+  readahead_stop (ra);
+  for (i = 0; i < ra->count; ++i)
+    depfile_free (&ra->files[i]);
+#ifdef MAKE_THREADS
+  pthread_mutex_destroy (&ra->lock);
+  pthread_cond_destroy (&ra->done);
+  pthread_cond_destroy (&ra->room);
+  free (ra->threads);
+#endif
+  free (ra->files);
+  free (ra);
+}
+
+/* Return the makefile FILENAME as read ahead of time, or 0 if it wasn't.
+   The makefiles must be asked for in the order they were given.  */
+
+static struct depfile *
+readahead_take (const char *filename)
+{
+  struct readahead *ra = read_ahead;
+  struct depfile *df;
+
+  if (ra == 0 || ra->used == ra->count
+      || !streq (ra->files[ra->used].name, filename))
+    return 0;
+
+  df = &ra->files[ra->used];
+#ifdef MAKE_THREADS
+  pthread_mutex_lock (&ra->lock);
+  ++ra->used;
+  pthread_cond_broadcast (&ra->room);
+  while (df->state == DF_READING
+         || (df->state == DF_WAITING && !ra->stop))
+    pthread_cond_wait (&ra->done, &ra->lock);
+  pthread_mutex_unlock (&ra->lock);
+#else
+  ++ra->used;
+#endif
+
+  return df->state == DF_OK ? df : 0;
+}
+
+/* Read the makefile open on *FPP the quick way, if it is a dependency file:
+   either AHEAD, if it was read ahead of time, or by reading it now if it
+   was included with include-deps.  Return nonzero if it was read, or zero
+   if it needs to be read with eval(); in that case, nothing has been
+   changed, and *FPP is still at the start of the file.  */
+
+static int
+eval_depfile (FILE **fpp, const char *filename, floc *flocp,
+              struct depfile *ahead, int flags)
+{
+  struct depfile df;
+  int ok;
+
+  /* The default goal and rules in recipes need eval()'s handling.  */
+  if (snapped_deps
+      || (!(flags & RM_NO_DEFAULT_GOAL) && default_goal_var->value[0] == '\0'))
+    return 0;
+
+  if (ahead != 0)
+    {
+      depfile_record (ahead, flocp);
+      depfile_free (ahead);
+      return 1;
+    }
+
+  if (!(flags & RM_DEPFILE))
+    return 0;
+
+  memset (&df, '\0', sizeof (df));
+  df.name = filename;
+  ok = depfile_read (*fpp, &df);
+  if (ok)
+    depfile_record (&df, flocp);
+  depfile_free (&df);
+
+  if (!ok)
+    {
+      _fclose (*fpp);
+      ENULLLOOP (*fpp, _fopen (filename, "r"));
+      if (*fpp == 0)
+        pfatal_with_name (filename);
+    }
+
+  return ok;
+}
+
 void
 eval_buffer (char *buffer, const floc *flocp)
 {
@@ -601,6 +1237,8 @@ eval (struct ebuffer *ebuf, int set_default)
       pattern = 0;                                                            \
     } while (0)
 
+  PROFILE_ENTER (PROF_EVAL);
+
   pattern_percent = 0;
   cmds_started = tgts_started = 1;
 
@@ -854,16 +1492,20 @@ eval (struct ebuffer *ebuf, int set_default)
         }
 
       /* Handle include and variants.  */
-      if (word1eq ("include") || word1eq ("-include") || word1eq ("sinclude"))
+      if (word1eq ("include") || word1eq ("-include") || word1eq ("sinclude")
+          || word1eq ("include-deps") || word1eq ("-include-deps"))
         {
           /* We have found an 'include' line specifying a nested
              makefile to be read at this point.  */
           struct conditionals *save;
           struct conditionals new_conditionals;
+          struct readahead *save_readahead;
           struct nameseq *files;
           /* "-include" (vs "include") says no error if the file does not
              exist.  "sinclude" is an alias for this from SGI.  */
           int noerror = (p[0] != 'i');
+          /* "include-deps" says the files were written by a compiler.  */
+          int depfile = word1eq ("include-deps") || word1eq ("-include-deps");
 
           /* Include ends the previous rule.  */
           record_waiting_files ();
@@ -891,12 +1533,17 @@ eval (struct ebuffer *ebuf, int set_default)
              the default goal before those in the included makefile.  */
           record_waiting_files ();
 
+          /* Start reading the included makefiles ahead of time.  */
+          save_readahead = read_ahead;
+          read_ahead = readahead_start (files);
+
           /* Read each included makefile.  */
           while (files != 0)
             {
               struct nameseq *next = files->next;
               int flags = (RM_INCLUDED | RM_NO_TILDE
                            | (noerror ? RM_DONTCARE : 0)
+                           | (depfile ? RM_DEPFILE : 0)
                            | (set_default ? 0 : RM_NO_DEFAULT_GOAL));
 
               struct goaldep *d = eval_makefile (files->name, flags);
@@ -908,6 +1555,9 @@ eval (struct ebuffer *ebuf, int set_default)
               files = next;
             }
 
+          readahead_finish (read_ahead);
+          read_ahead = save_readahead;
+
           /* Restore conditional state.  */
           restore_conditionals (save);
 
@@ -924,6 +1574,9 @@ eval (struct ebuffer *ebuf, int set_default)
           /* Load ends the previous rule.  */
           record_waiting_files ();
 
+          /* The object can do anything; we can't replay that.  */
+          dbcache_disable (_("a 'load' directive was used"));
+
           p = allocated_variable_expand (p2);
 
           /* If no filenames, it's a no-op.  */
@@ -1389,6 +2042,8 @@ eval (struct ebuffer *ebuf, int set_default)
 
   free (collapsed);
   free (commands);
+
+  PROFILE_LEAVE (PROF_EVAL);
 }
 
 
@@ -1905,6 +2560,7 @@ record_target_var (struct nameseq *filenames, char *defn,
           if (gv && v != gv
               && (gv->origin == o_env_override || gv->origin == o_command))
             {
+              uncompile_variable (v);
               free (v->value);
               v->value = xstrdup (gv->value);
               v->origin = gv->origin;
@@ -1952,7 +2608,7 @@ record_files (struct nameseq *filenames, const char *pattern,
   /* If there's a recipe, set up a struct for it.  */
   if (commands_idx > 0)
     {
-      cmds = xmalloc (sizeof (struct commands));
+      cmds = alloc_commands ();
       cmds->fileinfo.filenm = flocp->filenm;
       cmds->fileinfo.lineno = cmds_started;
       cmds->fileinfo.offset = 0;
@@ -2242,8 +2898,7 @@ find_map_unquote (char *string, int stopmap)
 
   while (1)
     {
-      while (! STOP_SET (*p, stopmap))
-        ++p;
+      p = find_stopchar (p, stopmap);
 
       if (*p == '\0')
         break;
@@ -3057,13 +3712,12 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
   struct nameseq **newp = &new;
 #define NEWELT(_n)  do { \
                         const char *__n = (_n); \
-                        *newp = xcalloc (size); \
+                        *newp = pool_alloc (&seq_pool); \
                         (*newp)->name = (cachep ? strcache_add (__n) : xstrdup (__n)); \
                         newp = &(*newp)->next; \
                     } while(0)
 
   char *p;
-  glob_t gl;
   char *tp;
   int findmap = stopmap|MAP_VMSCOMMA|MAP_BLANK|MAP_NUL;
 
@@ -3073,9 +3727,6 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
   if (size < sizeof (struct nameseq))
     size = sizeof (struct nameseq);
 
-  if (NONE_SET (flags, PARSEFS_NOGLOB))
-    dir_setup_glob (&gl);
-
   /* Get enough temporary space to construct the largest possible target.  */
   {
     static int tmpbuf_len = 0;
@@ -3095,7 +3746,6 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
       const char *name;
       const char **nlist = 0;
       char *tildep = 0;
-      int globme = 1;
 #ifndef NO_ARCHIVES
       char *arname = 0;
       char *memname = 0;
@@ -3103,6 +3753,7 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
       char *s;
       int nlen;
       int i;
+      unsigned int nfound;
 
       /* Skip whitespace; at the end of the string or STOPCHAR we're done.  */
       NEXT_TOKEN (p);
@@ -3310,20 +3961,15 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
       /* glob() is expensive: don't call it unless we need to.  */
       if (NONE_SET (flags, PARSEFS_EXISTS) && strpbrk (name, "?*[") == NULL)
         {
-          globme = 0;
           i = 1;
           nlist = &name;
         }
       else
-        switch (glob (name, GLOB_NOSORT|GLOB_ALTDIRFUNC, NULL, &gl))
+        switch (dir_glob (name, &nlist, &nfound))
           {
-          case GLOB_NOSPACE:
-            out_of_memory ();
-
           case 0:
             /* Success.  */
-            i = gl.gl_pathc;
-            nlist = (const char **)gl.gl_pathv;
+            i = nfound;
             break;
 
           case GLOB_NOMATCH:
@@ -3380,9 +4026,6 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
 #endif /* !NO_ARCHIVES */
           NEWELT (concat (2, prefix, nlist[i]));
 
-      if (globme)
-        globfree (&gl);
-
 #ifndef NO_ARCHIVES
       free (arname);
 #endif
@@ -21,6 +21,8 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "dep.h"
 #include "variable.h"
 #include "debug.h"
+#include "profile.h"
+#include "dbcache.h"
 
 #include <assert.h>
 
@@ -234,7 +236,7 @@ update_goal_chain (struct goaldep *goaldeps)
                 lastgoal->next = g->next;
 
               /* Free the storage.  */
-              free (g);
+              free_dep (g);
 
               g = lastgoal == 0 ? goals : lastgoal->next;
 
@@ -793,6 +795,13 @@ update_file_1 (struct file *file, unsigned int depth)
       must_make = 1;
       DBF (DB_VERBOSE, _("Making '%s' due to always-make flag.\n"));
     }
+  else if (must_make && !noexist && file->cmds != 0 && !always_make_flag
+           && contenthash_unchanged (file))
+    {
+      must_make = 0;
+      DBF (DB_BASIC,
+           _("Contents of '%s' and its prerequisites have not changed.\n"));
+    }
 
   if (!must_make)
     {
@@ -907,6 +916,7 @@ notice_finished_file (struct file *file)
               /* Pretend we ran a real touch command, to suppress the
                  "'foo' is up to date" message.  */
               commands_started++;
+              ++file_generation;
 
               /* Request for the timestamp to be updated (and distributed
                  to the double-colon entries). Simply setting ran=1 would
@@ -993,6 +1003,12 @@ notice_finished_file (struct file *file)
     /* Nothing was done for FILE, but it needed nothing done.
        So mark it now as "succeeded".  */
     file->update_status = us_success;
+
+  if (ran && !file->phony)
+    {
+      contenthash_remade (file);
+      actioncache_remade (file);
+    }
 }
 
 /* Check whether another file (whose mtime is THIS_MTIME) needs updating on
@@ -1257,6 +1273,8 @@ f_mtime (struct file *file, int search)
   FILE_TIMESTAMP mtime;
   int propagate_timestamp;
 
+  PROFILE_ENTER (PROF_MTIME);
+
   /* File's mtime is not known; must get it from the system.  */
 
 #ifndef NO_ARCHIVES
@@ -1310,8 +1328,11 @@ f_mtime (struct file *file, int search)
       file->low_resolution_time = 1;
 
       if (mtime == NONEXISTENT_MTIME)
-        /* The archive doesn't exist, so its members don't exist either.  */
-        return NONEXISTENT_MTIME;
+        {
+          /* The archive doesn't exist, so its members don't exist either.  */
+          PROFILE_LEAVE (PROF_MTIME);
+          return NONEXISTENT_MTIME;
+        }
 
       member_date = ar_member_date (file->hname);
       mtime = (member_date == (time_t) -1
@@ -1353,7 +1374,9 @@ f_mtime (struct file *file, int search)
                 {
                   rename_file (file, name);
                   check_renamed (file);
-                  return file_mtime (file);
+                  mtime = file_mtime (file);
+                  PROFILE_LEAVE (PROF_MTIME);
+                  return mtime;
                 }
 
               rehash_file (file, name);
@@ -1450,6 +1473,7 @@ f_mtime (struct file *file, int search)
     }
   while (file != 0);
 
+  PROFILE_LEAVE (PROF_MTIME);
   return mtime;
 }
 
@@ -1465,7 +1489,7 @@ f_mtime (struct file *file, int search)
 static FILE_TIMESTAMP
 name_mtime (const char *name)
 {
-  FILE_TIMESTAMP mtime;
+  FILE_TIMESTAMP mtime = UNKNOWN_MTIME;
   struct stat st;
   int e;
 
@@ -1506,17 +1530,29 @@ name_mtime (const char *name)
       }
   }
 #else
-  EINTRLOOP (e, stat (name, &st));
+  /* The last run may have seen it, it may have been looked up already, or
+     the directory cache may know.  */
+  mtime = filestate_mtime (name);
+  if (mtime == UNKNOWN_MTIME)
+    mtime = prefetched_mtime (name);
+  if (mtime == UNKNOWN_MTIME)
+    mtime = dir_file_mtime (name, 1);
+  if (mtime == UNKNOWN_MTIME)
+    EINTRLOOP (e, stat (name, &st));
 #endif
-  if (e == 0)
-    mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
-  else if (errno == ENOENT || errno == ENOTDIR)
-    mtime = NONEXISTENT_MTIME;
-  else
+  if (mtime == UNKNOWN_MTIME)
     {
-      perror_with_name ("stat: ", name);
-      return NONEXISTENT_MTIME;
+      if (e == 0)
+        mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+      else if (errno == ENOENT || errno == ENOTDIR)
+        mtime = NONEXISTENT_MTIME;
+      else
+        {
+          perror_with_name ("stat: ", name);
+          return NONEXISTENT_MTIME;
+        }
     }
+  filestate_note (name, mtime);
 
   /* If we get here we either found it, or it doesn't exist.
      If it doesn't exist see if we can use a symlink mtime instead.  */
@@ -24,6 +24,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "variable.h"
 #include "rule.h"
+#include "hash.h"
 
 static void freerule (struct rule *rule, struct rule *lastrule);
 
@@ -51,6 +52,25 @@ unsigned int max_pattern_deps;
 
 unsigned int max_pattern_dep_length;
 
+/* The pattern rule index.  Every target pattern of every rule is in the
+   bucket for its suffix, except those that end in % which are all in
+   ANY_SUFFIX.  A file name can only match the patterns in the buckets
+   for its own trailing substrings, and there are only as many of those
+   to look up as there are distinct suffix lengths in SUFFIX_LENS.  */
+
+static struct hash_table rule_buckets;
+static struct rule_bucket any_suffix;
+static unsigned int *suffix_lens;
+static unsigned int num_suffix_lens;
+
+/* Nonzero if the index is up to date with the chain of pattern rules.  */
+
+static int rules_indexed;
+
+/* Most buckets find_pattern_rules can return.  */
+
+unsigned int max_rule_buckets;
+
 /* Pointer to structure for the file .SUFFIXES
    whose dependencies are the suffixes to be searched.  */
 
@@ -141,6 +161,151 @@ count_implicit_rule_limits (void)
     }
 
   free (name);
+
+  index_pattern_rules ();
+}
+
+static unsigned long
+rule_bucket_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct rule_bucket *) key)->suffix);
+}
+
+static unsigned long
+rule_bucket_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct rule_bucket *) key)->suffix);
+}
+
+static int
+rule_bucket_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct rule_bucket *) x)->suffix,
+                         ((const struct rule_bucket *) y)->suffix);
+}
+
+static void
+free_rule_bucket (const void *item)
+{
+  free (((struct rule_bucket *) item)->targets);
+}
+
+static void
+add_rule_target (struct rule_bucket *b, struct rule *rule, unsigned int ti,
+                 unsigned int order)
+{
+  if (b->count == b->size)
+    {
+      b->size = b->size ? b->size * 2 : 4;
+      b->targets = xrealloc (b->targets,
+                             b->size * sizeof (struct rule_target));
+    }
+  b->targets[b->count].rule = rule;
+  b->targets[b->count].ti = ti;
+  b->targets[b->count].order = order;
+  ++b->count;
+}
+
+/* Build the index of pattern rules by target suffix, unless it is
+   already up to date.  */
+
+void
+index_pattern_rules (void)
+{
+  struct rule *rule;
+  unsigned int order = 0;
+
+  if (rules_indexed)
+    return;
+
+  if (rule_buckets.ht_vec != 0)
+    {
+      hash_map (&rule_buckets, free_rule_bucket);
+      hash_free (&rule_buckets, 1);
+    }
+  hash_init (&rule_buckets, 64,
+             rule_bucket_hash_1, rule_bucket_hash_2, rule_bucket_hash_cmp);
+  free (any_suffix.targets);
+  memset (&any_suffix, '\0', sizeof (any_suffix));
+  num_suffix_lens = 0;
+
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      unsigned int ti;
+
+      for (ti = 0; ti < rule->num; ++ti, ++order)
+        {
+          const char *suffix = rule->suffixes[ti];
+          struct rule_bucket key;
+          struct rule_bucket **slot;
+          struct rule_bucket *b;
+          unsigned int len, i;
+
+          if (*suffix == '\0')
+            {
+              add_rule_target (&any_suffix, rule, ti, order);
+              continue;
+            }
+
+          key.suffix = suffix;
+          slot = (struct rule_bucket **) hash_find_slot (&rule_buckets, &key);
+          b = *slot;
+          if (HASH_VACANT (b))
+            {
+              b = xcalloc (sizeof (struct rule_bucket));
+              b->suffix = suffix;
+              hash_insert_at (&rule_buckets, b, slot);
+            }
+          add_rule_target (b, rule, ti, order);
+
+          /* Keep the distinct suffix lengths in increasing order.  */
+          len = strlen (suffix);
+          for (i = 0; i < num_suffix_lens && suffix_lens[i] < len; ++i)
+            ;
+          if (i == num_suffix_lens || suffix_lens[i] != len)
+            {
+              suffix_lens = xrealloc (suffix_lens, (num_suffix_lens + 1)
+                                      * sizeof (unsigned int));
+              memmove (&suffix_lens[i + 1], &suffix_lens[i],
+                       (num_suffix_lens - i) * sizeof (unsigned int));
+              suffix_lens[i] = len;
+              ++num_suffix_lens;
+            }
+        }
+    }
+
+  max_rule_buckets = num_suffix_lens + 1;
+  rules_indexed = 1;
+}
+
+/* Store in BUCKETS the buckets of pattern rule targets that NAME, of
+   length LEN, might match, and return how many there are.  BUCKETS must
+   have room for max_rule_buckets entries; the index must be up to date.
+   The targets are not returned in chain order: the ORDER of each one
+   tells where it is in the chain.  */
+
+unsigned int
+find_pattern_rules (const char *name, unsigned int len,
+                    struct rule_bucket **buckets)
+{
+  unsigned int n = 0;
+  unsigned int i;
+
+  for (i = 0; i < num_suffix_lens && suffix_lens[i] <= len; ++i)
+    {
+      struct rule_bucket key;
+      struct rule_bucket *b;
+
+      key.suffix = name + len - suffix_lens[i];
+      b = hash_find_item (&rule_buckets, &key);
+      if (b != 0)
+        buckets[n++] = b;
+    }
+
+  if (any_suffix.count != 0)
+    buckets[n++] = &any_suffix;
+
+  return n;
 }
 
 /* Create a pattern rule from a suffix rule.
@@ -288,6 +453,8 @@ new_pattern_rule (struct rule *rule, int override)
 
   rule->next = 0;
 
+  rules_indexed = 0;
+
   /* Search for an identical rule.  */
   lastrule = 0;
   for (r = pattern_rules; r != 0; lastrule = r, r = r->next)
@@ -377,7 +544,7 @@ install_pattern_rule (struct pspec *p, int terminal)
   if (new_pattern_rule (r, 0))
     {
       r->terminal = terminal;
-      r->cmds = xmalloc (sizeof (struct commands));
+      r->cmds = alloc_commands ();
       r->cmds->fileinfo.filenm = 0;
       r->cmds->fileinfo.lineno = 0;
       r->cmds->fileinfo.offset = 0;
@@ -399,6 +566,8 @@ freerule (struct rule *rule, struct rule *lastrule)
 {
   struct rule *next = rule->next;
 
+  rules_indexed = 0;
+
   free_dep_chain (rule->deps);
 
   /* MSVC erroneously warns without a cast here.  */
@@ -30,6 +30,24 @@ struct rule
     char in_use;                /* If in use by a parent pattern_search.  */
   };
 
+/* One target pattern of a pattern rule, as kept in the rule index:
+   target TI of RULE, which is the ORDER'th target pattern in the chain.  */
+struct rule_target
+  {
+    struct rule *rule;
+    unsigned int ti;
+    unsigned int order;
+  };
+
+/* All the target patterns with the same suffix (the text after the %).  */
+struct rule_bucket
+  {
+    const char *suffix;
+    unsigned int count;
+    unsigned int size;
+    struct rule_target *targets;
+  };
+
 /* For calling install_pattern_rule.  */
 struct pspec
   {
@@ -44,12 +62,16 @@ extern unsigned int num_pattern_rules;
 extern unsigned int max_pattern_deps;
 extern unsigned int max_pattern_targets;
 extern unsigned int max_pattern_dep_length;
+extern unsigned int max_rule_buckets;
 
 extern struct file *suffix_file;
 extern unsigned int maxsuffix;
 
 
 void count_implicit_rule_limits (void);
+void index_pattern_rules (void);
+unsigned int find_pattern_rules (const char *name, unsigned int len,
+                                 struct rule_bucket **buckets);
 void convert_to_pattern (void);
 void install_pattern_rule (struct pspec *p, int terminal);
 void create_pattern_rule (const char **targets, const char **target_percents,
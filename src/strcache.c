@@ -20,139 +20,94 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <assert.h>
 
 #include "hash.h"
+#include "profile.h"
 
 /* A string cached here will never be freed, so we don't need to worry about
    reference counting.  We just store the string, and then remember it in a
-   hash so it can be looked up again. */
+   hash so it can be looked up again.
 
-typedef unsigned short int sc_buflen_t;
+   Strings are carved off the end of large chunks, and each one follows a
+   header holding its length and hash: strcache_len() and strcache_hash()
+   get them back from the string pointer, which is the handle callers
+   keep, without looking at the string itself.  */
 
-struct strcache {
-  struct strcache *next;    /* The next block of strings.  Must be first!  */
-  sc_buflen_t end;          /* Offset to the beginning of free space.  */
-  sc_buflen_t bytesfree;    /* Free space left in this buffer.  */
-  sc_buflen_t count;        /* # of strings in this buffer (for stats).  */
-  char buffer[1];           /* The buffer comes after this.  */
+struct strentry {
+  unsigned int len;         /* The length of the string.  */
+  unsigned int hash;        /* Its str_hash_1() value.  */
+  char str[1];              /* The string comes after this.  */
 };
 
-/* The size (in bytes) of each cache buffer.
-   Try to pick something that will map well into the heap.
-   This must be able to be represented by a short int (<=65535).  */
-#define CACHE_BUFFER_BASE       (8192)
-#define CACHE_BUFFER_ALLOC(_s)  ((_s) - (2 * sizeof (size_t)))
-#define CACHE_BUFFER_OFFSET     (offsetof (struct strcache, buffer))
-#define CACHE_BUFFER_SIZE(_s)   (CACHE_BUFFER_ALLOC(_s) - CACHE_BUFFER_OFFSET)
-#define BUFSIZE                 CACHE_BUFFER_SIZE (CACHE_BUFFER_BASE)
+#define ENTRY_OFFSET            (offsetof (struct strentry, str))
+#define ENTRY(_s)               ((const struct strentry *) ((_s) - ENTRY_OFFSET))
 
-static struct strcache *strcache = NULL;
-static struct strcache *fullcache = NULL;
+/* The space taken by an entry for a string of length _L, including its nul,
+   rounded up to keep the next header aligned.  */
+#define ENTRY_ALIGN             (sizeof (unsigned int))
+#define ENTRY_SIZE(_l) \
+  ((ENTRY_OFFSET + (_l) + 1 + ENTRY_ALIGN - 1) & ~(ENTRY_ALIGN - 1))
 
-static unsigned long total_buffers = 0;
+struct strchunk {
+  struct strchunk *next;    /* The chunk before this one.  */
+  char *end;                /* The beginning of free space.  */
+  char *limit;              /* The end of the chunk.  */
+  unsigned long count;      /* # of strings in this chunk (for stats).  */
+};
+
+/* The size (in bytes) of each chunk, including its header.  Strings bigger
+   than HUGE_STRING get a chunk of their own rather than waste the end of
+   the current one.  */
+#define CHUNK_SIZE              (1024 * 1024)
+#define HUGE_STRING             (CHUNK_SIZE / 8)
+
+/* The current chunk is at the front of 'chunks'.  */
+static struct strchunk *chunks = NULL;
+static struct strchunk *hugechunks = NULL;
+
+static unsigned long total_chunks = 0;
 static unsigned long total_strings = 0;
 static unsigned long total_size = 0;
 
-/* Add a new buffer to the cache.  Add it at the front to reduce search time.
-   This can also increase the overhead, since it's less likely that older
-   buffers will be filled in.  However, GNU make has so many smaller strings
-   that this doesn't seem to be much of an issue in practice.
- */
-static struct strcache *
-new_cache (struct strcache **head, sc_buflen_t buflen)
+static struct strchunk *
+new_chunk (struct strchunk **head, unsigned long size)
 {
-  struct strcache *new = xmalloc (buflen + CACHE_BUFFER_OFFSET);
-  new->end = 0;
+  struct strchunk *new = xmalloc (size);
+
+  new->end = (char *) (new + 1);
+  new->limit = (char *) new + size;
   new->count = 0;
-  new->bytesfree = buflen;
 
   new->next = *head;
   *head = new;
 
-  ++total_buffers;
+  ++total_chunks;
   return new;
 }
 
 static const char *
-copy_string (struct strcache *sp, const char *str, unsigned int len)
+add_string (const char *str, unsigned int len, unsigned int hash)
 {
-  /* Add the string to this cache.  */
-  char *res = &sp->buffer[sp->end];
-
-  memmove (res, str, len);
-  res[len++] = '\0';
-  sp->end += len;
-  sp->bytesfree -= len;
-  ++sp->count;
-
-  return res;
-}
-
-static const char *
-add_string (const char *str, unsigned int len)
-{
-  const char *res;
-  struct strcache *sp;
-  struct strcache **spp = &strcache;
-  /* We need space for the nul char.  */
-  unsigned int sz = len + 1;
+  struct strchunk *cp = chunks;
+  struct strentry *e;
+  unsigned long sz = ENTRY_SIZE (len);
 
   ++total_strings;
   total_size += sz;
 
-  /* If the string we want is too large to fit into a single buffer, then
-     no existing cache is large enough.  Add it directly to the fullcache.  */
-  if (sz > BUFSIZE)
-    {
-      sp = new_cache (&fullcache, sz);
-      return copy_string (sp, str, len);
-    }
-
-  /* Find the first cache with enough free space.  */
-  for (; *spp != NULL; spp = &(*spp)->next)
-    if ((*spp)->bytesfree > sz)
-      break;
-  sp = *spp;
-
-  /* If nothing is big enough, make a new cache at the front.  */
-  if (sp == NULL)
-    {
-      sp = new_cache (&strcache, BUFSIZE);
-      spp = &strcache;
-    }
-
-  /* Add the string to this cache.  */
-  res = copy_string (sp, str, len);
-
-  /* If the amount free in this cache is less than the average string size,
-     consider it full and move it to the full list.  */
-  if (total_strings > 20 && sp->bytesfree < (total_size / total_strings) + 1)
-    {
-      *spp = sp->next;
-      sp->next = fullcache;
-      fullcache = sp;
-    }
-
-  return res;
-}
-
-/* For strings too large for the strcache, we just save them in a list.  */
-struct hugestring {
-  struct hugestring *next;  /* The next string.  */
-  char buffer[1];           /* The string.  */
-};
-
-static struct hugestring *hugestrings = NULL;
+  if (sz > HUGE_STRING)
+    cp = new_chunk (&hugechunks, sizeof (struct strchunk) + sz);
+  else if (cp == NULL || (unsigned long) (cp->limit - cp->end) < sz)
+    cp = new_chunk (&chunks, CHUNK_SIZE);
 
-static const char *
-add_hugestring (const char *str, unsigned int len)
-{
-  struct hugestring *new = xmalloc (sizeof (struct hugestring) + len);
-  memcpy (new->buffer, str, len);
-  new->buffer[len] = '\0';
+  e = (struct strentry *) cp->end;
+  cp->end += sz;
+  ++cp->count;
 
-  new->next = hugestrings;
-  hugestrings = new;
+  e->len = len;
+  e->hash = hash;
+  memcpy (e->str, str, len);
+  e->str[len] = '\0';
 
-  return new->buffer;
+  return e->str;
 }
 
 /* Hash table of strings in the cache.  */
@@ -175,6 +130,19 @@ str_hash_cmp (const void *x, const void *y)
   return_ISTRING_COMPARE ((const char *) x, (const char *) y);
 }
 
+/* Return str_hash_1 of the LEN bytes at STR, which are followed by a nul.  */
+
+static unsigned int
+str_hash_len (const char *str, unsigned int len)
+{
+#ifdef HAVE_CASE_INSENSITIVE_FS
+  (void) len;
+  return str_hash_1 (str);
+#else
+  return hash_string (str, len);
+#endif
+}
+
 static struct hash_table strings;
 static unsigned long total_adds = 0;
 
@@ -183,14 +151,10 @@ add_hash (const char *str, unsigned int len)
 {
   char *const *slot;
   const char *key;
-
-  /* If it's too large for the string cache, just copy it.
-     We don't bother trying to match these.  */
-  if (len > USHRT_MAX - 1)
-    return add_hugestring (str, len);
+  unsigned int hash = str_hash_len (str, len);
 
   /* Look up the string in the hash.  If it's there, return it.  */
-  slot = (char *const *) hash_find_slot (&strings, str);
+  slot = (char *const *) hash_find_slot_hashed (&strings, str, hash);
   key = *slot;
 
   /* Count the total number of add operations we performed.  */
@@ -199,8 +163,8 @@ add_hash (const char *str, unsigned int len)
   if (!HASH_VACANT (key))
     return key;
 
-  /* Not there yet so add it to a buffer, then into the hash table.  */
-  key = add_string (str, len);
+  /* Not there yet so add it to a chunk, then into the hash table.  */
+  key = add_string (str, len, hash);
   hash_insert_at (&strings, key, slot);
   return key;
 }
@@ -209,25 +173,33 @@ add_hash (const char *str, unsigned int len)
 int
 strcache_iscached (const char *str)
 {
-  struct strcache *sp;
+  const struct strchunk *cp;
 
-  for (sp = strcache; sp != 0; sp = sp->next)
-    if (str >= sp->buffer && str < sp->buffer + sp->end)
+  for (cp = chunks; cp != 0; cp = cp->next)
+    if (str > (const char *) cp && str < cp->end)
       return 1;
-  for (sp = fullcache; sp != 0; sp = sp->next)
-    if (str >= sp->buffer && str < sp->buffer + sp->end)
+  for (cp = hugechunks; cp != 0; cp = cp->next)
+    if (str > (const char *) cp && str < cp->end)
       return 1;
 
-  {
-    struct hugestring *hp;
-    for (hp = hugestrings; hp != 0; hp = hp->next)
-      if (str == hp->buffer)
-        return 1;
-  }
-
   return 0;
 }
 
+/* Return the length of STR, which must be in the cache.  */
+unsigned int
+strcache_len (const char *str)
+{
+  return ENTRY (str)->len;
+}
+
+/* Return the hash of STR, which must be in the cache.  It's the same as
+   ISTRING_HASH_1 computes for STR.  */
+unsigned int
+strcache_hash (const char *str)
+{
+  return ENTRY (str)->hash;
+}
+
 /* If the string is already in the cache, return a pointer to the cached
    version.  If not, add it then return a pointer to the cached version.
    Note we do NOT take control of the string passed in.  */
@@ -257,6 +229,7 @@ void
 strcache_init (void)
 {
   hash_init (&strings, 8000, str_hash_1, str_hash_2, str_hash_cmp);
+  profile_hash_table ("strcache", &strings);
 }
 
 
@@ -265,63 +238,39 @@ strcache_init (void)
 void
 strcache_print_stats (const char *prefix)
 {
-  const struct strcache *sp;
-  unsigned long numbuffs = 0, fullbuffs = 0;
-  unsigned long totfree = 0, maxfree = 0, minfree = BUFSIZE;
+  const struct strchunk *cp;
+  unsigned long numchunks = 0, numhuge = 0, totfree = 0;
 
-  if (! strcache)
+  if (! chunks)
     {
-      printf (_("\n%s No strcache buffers\n"), prefix);
+      printf (_("\n%s No strcache chunks\n"), prefix);
       return;
     }
 
-  /* Count the first buffer separately since it's not full.  */
-  for (sp = strcache->next; sp != NULL; sp = sp->next)
-    {
-      sc_buflen_t bf = sp->bytesfree;
-
-      totfree += bf;
-      maxfree = (bf > maxfree ? bf : maxfree);
-      minfree = (bf < minfree ? bf : minfree);
-
-      ++numbuffs;
-    }
-  for (sp = fullcache; sp != NULL; sp = sp->next)
+  /* The current chunk's free space isn't wasted, so don't count it.  */
+  for (cp = chunks; cp != NULL; cp = cp->next)
     {
-      sc_buflen_t bf = sp->bytesfree;
-
-      totfree += bf;
-      maxfree = (bf > maxfree ? bf : maxfree);
-      minfree = (bf < minfree ? bf : minfree);
-
-      ++numbuffs;
-      ++fullbuffs;
+      if (cp != chunks)
+        totfree += cp->limit - cp->end;
+      ++numchunks;
     }
+  for (cp = hugechunks; cp != NULL; cp = cp->next)
+    ++numhuge;
 
-  /* Make sure we didn't lose any buffers.  */
-  assert (total_buffers == numbuffs + 1);
+  /* Make sure we didn't lose any chunks.  */
+  assert (total_chunks == numchunks + numhuge);
 
-  printf (_("\n%s strcache buffers: %lu (%lu) / strings = %lu / storage = %lu B / avg = %lu B\n"),
-          prefix, numbuffs + 1, fullbuffs, total_strings, total_size,
+  printf (_("\n%s strcache chunks: %lu (%lu huge) / strings = %lu / storage = %lu B / avg = %lu B\n"),
+          prefix, numchunks + numhuge, numhuge, total_strings, total_size,
           (total_size / total_strings));
 
-  printf (_("%s current buf: size = %hu B / used = %hu B / count = %hu / avg = %hu B\n"),
-          prefix, (sc_buflen_t)BUFSIZE, strcache->end, strcache->count,
-          (strcache->end / strcache->count));
-
-  if (numbuffs)
-    {
-      /* Show information about non-current buffers.  */
-      unsigned long sz = total_size - strcache->end;
-      unsigned long cnt = total_strings - strcache->count;
-      sc_buflen_t avgfree = totfree / numbuffs;
-
-      printf (_("%s other used: total = %lu B / count = %lu / avg = %lu B\n"),
-              prefix, sz, cnt, sz / cnt);
+  printf (_("%s current chunk: size = %lu B / used = %lu B / count = %lu\n"),
+          prefix, (unsigned long) CHUNK_SIZE,
+          (unsigned long) (chunks->end - (const char *) chunks),
+          chunks->count);
 
-      printf (_("%s other free: total = %lu B / max = %lu B / min = %lu B / avg = %hu B\n"),
-              prefix, totfree, maxfree, minfree, avgfree);
-    }
+  printf (_("%s unused at the end of other chunks: %lu B\n"),
+          prefix, totfree);
 
   printf (_("\n%s strcache performance: lookups = %lu / hit rate = %lu%%\n"),
           prefix, total_adds, (long unsigned)(100.0 * (total_adds - total_strings) / total_adds));
@@ -0,0 +1,239 @@
+/* Build timeline tracing for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "job.h"
+#include "trace.h"
+
+/* With --trace-json=FILE, make writes a timeline of the build to FILE in
+   the Chrome trace event format, which can be loaded into chrome://tracing
+   or Perfetto.  The file is a JSON array of events.
+
+   Make's own phases (reading makefiles, remaking them, updating goals...)
+   appear on thread 0.  Each running job is given the lowest free slot
+   number, starting at 1, and its recipe lines appear as begin/end pairs on
+   the thread of that slot; so a gap on a slot's thread is time the slot
+   was idle.  Each make writes its own file: the option is not passed to
+   sub-makes.  When make re-executes itself after remaking makefiles, the
+   new make appends to the file.  */
+
+static FILE *trace_fp = 0;
+
+/* Number of events written, to know when a comma is needed.  */
+static unsigned long trace_events = 0;
+
+/* Our process ID, used as the trace's "pid" for every event.  */
+static unsigned long trace_pid;
+
+/* The job occupying each slot, or NULL if the slot is free.  */
+static struct child **trace_slots = 0;
+static unsigned int trace_nslots = 0;
+
+/* Return the current time in microseconds.  */
+
+double
+trace_clock (void)
+{
+#if HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+#if HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+    if (gettimeofday (&tv, 0) == 0)
+      return tv.tv_sec * 1e6 + tv.tv_usec;
+  }
+#endif
+  return time (NULL) * 1e6;
+}
+
+/* Write S as a JSON string.  */
+
+static void
+trace_string (const char *s)
+{
+  _fputc ('"', trace_fp);
+  for (; *s != '\0'; ++s)
+    {
+      unsigned char ch = *s;
+
+      if (ch == '"' || ch == '\\')
+        _fprintf (trace_fp, "\\%c", ch);
+      else if (ch < 0x20)
+        _fprintf (trace_fp, "\\u%04x", ch);
+      else
+        _fputc (ch, trace_fp);
+    }
+  _fputc ('"', trace_fp);
+}
+
+/* Start a new event of type PH, for thread TID, named NAME.  The caller
+   finishes it, with any "args", and closes the brace.  */
+
+static void
+trace_event (const char *ph, const char *cat, unsigned int tid,
+             const char *name)
+{
+  _fputs (trace_events++ ? ",\n" : "\n", trace_fp);
+  _fprintf (trace_fp, "{\"ph\":\"%s\",\"cat\":\"%s\",\"ts\":%.0f,"
+            "\"pid\":%lu,\"tid\":%u,\"name\":",
+            ph, cat, trace_clock (), trace_pid, tid);
+  trace_string (name);
+}
+
+/* Name thread TID in the trace viewer.  */
+
+static void
+trace_thread_name (unsigned int tid, const char *name)
+{
+  trace_event ("M", "__metadata", tid, "thread_name");
+  _fputs (",\"args\":{\"name\":", trace_fp);
+  trace_string (name);
+  _fputs ("}}", trace_fp);
+}
+
+/* Start writing a trace to NAME.  If APPEND, add to the trace that an
+   earlier incarnation of this make started.  */
+
+void
+trace_open (const char *name, int append)
+{
+  ENULLLOOP (trace_fp, _fopen (name, append ? "a" : "w"));
+  if (trace_fp == 0)
+    {
+      perror_with_name (_("cannot open trace file: "), name);
+      return;
+    }
+
+  trace_pid = (unsigned long) getpid ();
+
+  if (append)
+    trace_events = 1;
+  else
+    _fputc ('[', trace_fp);
+
+  trace_event ("M", "__metadata", 0, "process_name");
+  _fputs (",\"args\":{\"name\":\"make\"}}", trace_fp);
+  trace_thread_name (0, "make");
+}
+
+/* Stop writing the trace.  If DONE, this is the end of the build and the
+   JSON array is closed; otherwise another make will append to it.  */
+
+void
+trace_close (int done)
+{
+  if (trace_fp == 0)
+    return;
+
+  if (done)
+    _fputs ("\n]\n", trace_fp);
+  if (_fclose (trace_fp) != 0)
+    perror_with_name (_("cannot write trace file"), "");
+  trace_fp = 0;
+}
+
+/* Note the start and the end of one of make's own phases.  */
+
+void
+trace_begin (const char *phase)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ("B", "make", 0, phase);
+  _fputc ('}', trace_fp);
+}
+
+void
+trace_end (const char *phase)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ("E", "make", 0, phase);
+  _fputc ('}', trace_fp);
+}
+
+/* Return the slot of job C, assigning it the lowest free one if it has
+   none yet.  */
+
+static unsigned int
+trace_slot (struct child *c)
+{
+  unsigned int i, free_slot = trace_nslots;
+
+  for (i = 0; i < trace_nslots; ++i)
+    if (trace_slots[i] == c)
+      return i + 1;
+    else if (trace_slots[i] == 0 && free_slot == trace_nslots)
+      free_slot = i;
+
+  if (free_slot == trace_nslots)
+    {
+      char name[INTSTR_LENGTH + sizeof ("slot ")];
+
+      trace_slots = xrealloc (trace_slots,
+                              ++trace_nslots * sizeof (struct child *));
+      sprintf (name, "slot %u", trace_nslots);
+      trace_thread_name (trace_nslots, name);
+    }
+
+  trace_slots[free_slot] = c;
+  return free_slot + 1;
+}
+
+/* Note that job C has started a recipe line.  */
+
+void
+trace_job_start (struct child *c)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ("B", "job", trace_slot (c), c->file->name);
+  _fprintf (trace_fp, ",\"args\":{\"pid\":%lu}}", (unsigned long) c->pid);
+}
+
+/* Note that the recipe line job C was running has finished.  */
+
+void
+trace_job_end (struct child *c, int exit_code, int exit_sig)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ("E", "job", trace_slot (c), c->file->name);
+  _fprintf (trace_fp, ",\"args\":{\"status\":%d", exit_code);
+  if (exit_sig)
+    _fprintf (trace_fp, ",\"signal\":%d", exit_sig);
+  _fputs ("}}", trace_fp);
+}
+
+/* Job C is finished: give up its slot.  */
+
+void
+trace_job_free (struct child *c)
+{
+  unsigned int i;
+
+  for (i = 0; i < trace_nslots; ++i)
+    if (trace_slots[i] == c)
+      trace_slots[i] = 0;
+}
@@ -0,0 +1,27 @@
+/* Build timeline tracing for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+struct child;
+
+double trace_clock (void);
+void trace_open (const char *name, int append);
+void trace_close (int done);
+void trace_begin (const char *phase);
+void trace_end (const char *phase);
+void trace_job_start (struct child *c);
+void trace_job_end (struct child *c, int exit_code, int exit_sig);
+void trace_job_free (struct child *c);
+
@@ -24,6 +24,8 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "variable.h"
 #include "rule.h"
+#include "profile.h"
+#include "dbcache.h"
 #ifdef WINDOWS32
 #include "pathstuff.h"
 #endif
@@ -32,6 +34,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 /* Incremented every time we add or remove a global variable.  */
 static unsigned long variable_changenum;
 
+/* Variable records; those of scopes that are popped are reused.  */
+static struct pool variable_pool = POOL_INIT (struct variable);
+
 /* Chain of all pattern-specific variables.  */
 
 static struct pattern_var *pattern_vars;
@@ -95,6 +100,15 @@ create_pattern_var (const char *target, const char *suffix)
   return p;
 }
 
+/* Return the first pattern-specific variable, in the order they are
+   searched.  */
+
+struct pattern_var *
+pattern_var_list (void)
+{
+  return pattern_vars;
+}
+
 /* Look up a target in the pattern-specific variable list.  */
 
 static struct pattern_var *
@@ -183,6 +197,7 @@ init_hash_global_variable_set (void)
 {
   hash_init (&global_variable_set.table, VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
+  profile_hash_table ("global variables", &global_variable_set.table);
 }
 
 /* Define variable named NAME with value VALUE in SET.  VALUE is copied.
@@ -253,6 +268,7 @@ define_variable_in_set (const char *name, unsigned int length,
          than this one, don't redefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          uncompile_variable (v);
           free (v->value);
           v->value = xstrdup (value);
           if (flocp != 0)
@@ -267,7 +283,7 @@ define_variable_in_set (const char *name, unsigned int length,
 
   /* Create a new variable definition and add it to the hash table.  */
 
-  v = xmalloc (sizeof (struct variable));
+  v = pool_alloc (&variable_pool);
   v->name = xstrndup (name, length);
   v->length = length;
   hash_insert_at (&set->table, v, var_slot);
@@ -283,6 +299,8 @@ define_variable_in_set (const char *name, unsigned int length,
   v->recursive = recursive;
   v->special = 0;
   v->expanding = 0;
+  v->expanded = 0;
+  v->compiled = 0;
   v->exp_count = 0;
   v->per_target = 0;
   v->append = 0;
@@ -313,18 +331,20 @@ define_variable_in_set (const char *name, unsigned int length,
    variable (makefile, command line or environment). */
 
 static void
-free_variable_name_and_value (const void *item)
+free_variable (const void *item)
 {
   struct variable *v = (struct variable *) item;
+  uncompile_variable (v);
   free (v->name);
   free (v->value);
+  pool_free (&variable_pool, v);
 }
 
 void
 free_variable_set (struct variable_set_list *list)
 {
-  hash_map (&list->set->table, free_variable_name_and_value);
-  hash_free (&list->set->table, 1);
+  hash_map (&list->set->table, free_variable);
+  hash_free (&list->set->table, 0);
   free (list->set);
   free (list);
 }
@@ -361,8 +381,7 @@ undefine_variable_in_set (const char *name, unsigned int length,
       if ((int) origin >= (int) v->origin)
         {
           hash_delete_at (&set->table, var_slot);
-          free_variable_name_and_value (v);
-          free (v);
+          free_variable (v);
           if (set == &global_variable_set)
             ++variable_changenum;
         }
@@ -419,6 +438,7 @@ lookup_special_var (struct variable *var)
       struct variable **end = &vp[global_variable_set.table.ht_size];
 
       /* Make sure we have at least MAX bytes in the allocated buffer.  */
+      uncompile_variable (var);
       var->value = xrealloc (var->value, max);
 
       /* Walk through the hash of variables, constructing a list of names.  */
@@ -461,6 +481,31 @@ lookup_special_var (struct variable *var)
 
 struct variable *
 lookup_variable (const char *name, unsigned int length)
+{
+  return lookup_variable_hashed (name, length,
+                                 variable_name_hash (name, length));
+}
+
+/* Return the hash of the variable name NAME, LENGTH chars long.  */
+
+unsigned int
+variable_name_hash (const char *name, unsigned int length)
+{
+  struct variable var_key;
+
+  var_key.name = (char *) name;
+  var_key.length = length;
+
+  return variable_hash_1 (&var_key);
+}
+
+/* Like lookup_variable, given HASH, the variable_name_hash() of NAME.
+   Every set uses the same hash function, so the name need only be hashed
+   once, or even ahead of time.  */
+
+struct variable *
+lookup_variable_hashed (const char *name, unsigned int length,
+                        unsigned int hash)
 {
   const struct variable_set_list *setlist;
   struct variable var_key;
@@ -475,7 +520,7 @@ lookup_variable (const char *name, unsigned int length)
       const struct variable_set *set = setlist->set;
       struct variable *v;
 
-      v = (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
+      v = (struct variable *) hash_find_item_hashed ((struct hash_table *) &set->table, &var_key, hash);
       if (v && (!is_parent || !v->private_var))
         return v->special ? lookup_special_var (v) : v;
 
@@ -744,8 +789,8 @@ pop_variable_scope (void)
 
   /* Free the one we no longer need.  */
   free (setlist);
-  hash_map (&set->table, free_variable_name_and_value);
-  hash_free (&set->table, 1);
+  hash_map (&set->table, free_variable);
+  hash_free (&set->table, 0);
   free (set);
 }
 
@@ -774,8 +819,9 @@ merge_variable_sets (struct variable_set *to_set,
         else
           {
             /* GKM FIXME: delete in from_set->table */
+            uncompile_variable (from_var);
             free (from_var->value);
-            free (from_var);
+            pool_free (&variable_pool, from_var);
           }
       }
 }
@@ -877,6 +923,7 @@ define_automatic_variables (void)
           || shell->origin == o_env_override))
         {
           /* overwrite whatever we got from the environment */
+          uncompile_variable (shell);
           free (shell->value);
           shell->value = xstrdup (default_shell);
           shell->origin = o_default;
@@ -924,6 +971,7 @@ define_automatic_variables (void)
   /* Don't let SHELL come from the environment.  */
   if (*v->value == '\0' || v->origin == o_env || v->origin == o_env_override)
     {
+      uncompile_variable (v);
       free (v->value);
       v->origin = o_file;
       v->value = xstrdup (default_shell);
@@ -989,6 +1037,8 @@ target_environment (struct file *file)
   char **result_0;
   char **result;
 
+  PROFILE_ENTER (PROF_ENVIRON);
+
   if (file == 0)
     set_list = current_variable_set_list;
   else
@@ -1113,6 +1163,7 @@ target_environment (struct file *file)
 
   hash_free (&table, 0);
 
+  PROFILE_LEAVE (PROF_ENVIRON);
   return result_0;
 }
 
@@ -1142,6 +1193,8 @@ shell_result (const char *p)
   char *args[2];
   char *result;
 
+  dbcache_disable (_("a != assignment was used"));
+
   install_variable_buffer (&buf, &len);
 
   args[0] = (char *) p;
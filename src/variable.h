@@ -65,6 +65,7 @@ struct variable
     unsigned int expanding:1;   /* Nonzero if currently being expanded.  */
     unsigned int private_var:1; /* Nonzero avoids inheritance of this
                                    target-specific variable.  */
+    unsigned int expanded:1;    /* Nonzero if expanded at least once.  */
     unsigned int exp_count:EXP_COUNT_BITS;
                                 /* If >1, allow this many self-referential
                                    expansions.  */
@@ -79,6 +80,7 @@ struct variable
         v_ifset,                /* Export it if it has a non-default value.  */
         v_default               /* Decide in target_environment.  */
       } export ENUM_BITFIELD (2);
+    struct expansion *compiled; /* Value parsed for expanding, or 0.  */
   };
 
 /* Structure that represents a variable set.  */
@@ -124,9 +126,22 @@ char *expand_argument (const char *str, const char *end);
 char *variable_expand_string (char *line, const char *string, long length);
 void install_variable_buffer (char **bufp, unsigned int *lenp);
 void restore_variable_buffer (char *buf, unsigned int len);
+struct expansion *compile_expansion (const char *string, unsigned int length);
+void free_expansion (struct expansion *e);
+int compiled_is_current (const struct expansion *e);
+char *expand_compiled (char *o, struct expansion *e);
+char *allocated_expand_compiled (struct expansion *e);
+char *allocated_expand_compiled_for_file (struct expansion *e,
+                                          struct file *file);
+void uncompile_variable (struct variable *v);
 
 /* function.c */
 int handle_function (char **op, const char **stringp);
+struct funcall;
+int compile_function (const char **stringp, struct funcall **fcp);
+char *expand_funcall (char *o, const struct funcall *fc);
+void free_funcall (struct funcall *fc);
+extern unsigned int function_generation;
 int pattern_matches (const char *pattern, const char *percent, const char *str);
 char *subst_expand (char *o, const char *text, const char *subst,
                     const char *replace, unsigned int slen, unsigned int rlen,
@@ -170,6 +185,9 @@ void define_new_function(const floc *flocp, const char *name,
                          unsigned int min, unsigned int max, unsigned int flags,
                          gmk_func_ptr func);
 struct variable *lookup_variable (const char *name, unsigned int length);
+struct variable *lookup_variable_hashed (const char *name, unsigned int length,
+                                         unsigned int hash);
+unsigned int variable_name_hash (const char *name, unsigned int length);
 struct variable *lookup_variable_in_set (const char *name, unsigned int length,
                                          const struct variable_set *set);
 
@@ -230,6 +248,7 @@ char **target_environment (struct file *file);
 
 struct pattern_var *create_pattern_var (const char *target,
                                         const char *suffix);
+struct pattern_var *pattern_var_list (void);
 
 extern int export_all_variables;
 
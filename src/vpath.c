@@ -591,6 +591,21 @@ vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
 
 
 
+
+/* Call FN with the pattern and search path of each selective VPATH, from
+   the newest to the oldest until build_vpath_lists reverses them, and
+   ARG.  */
+
+void
+map_vpaths (void (*fn) (const char *, const char **, void *), void *arg)
+{
+  struct vpath *v;
+
+  for (v = vpaths; v != 0; v = v->next)
+    (*fn) (v->pattern, v->searchpath, arg);
+}
+
+
 
 /* Print the data base of VPATH search paths.  */
 
@@ -34,7 +34,7 @@ static char jobserver_semaphore_name[MAX_PATH + 1];
 static HANDLE jobserver_semaphore = NULL;
 
 unsigned int
-jobserver_setup (int slots)
+jobserver_setup (int slots, const char *style UNUSED)
 {
   /* sub_proc.c is limited in the number of objects it can wait for. */
 
@@ -0,0 +1,428 @@
+/* Watching files for changes for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "hash.h"
+#include "filedef.h"
+#include "variable.h"
+#include "debug.h"
+
+/* Under --watch, make doesn't exit once the goals are updated.  It asks
+   inotify to tell it about changes in the directories of all the files
+   it knows, waits for one of those files to change, and updates the
+   goals again with the graph it already has: only the files that
+   changed have their modification times looked up again, so only the
+   targets that depend on them are remade.  When a makefile changes the
+   graph itself may be wrong, so make executes itself again to read them
+   all anew, as it does after remaking a makefile.
+
+   Files the recipes write change too, but that is no reason to start
+   again; so while the goals were being updated only changes to files
+   that no rule makes count, and the rest are only looked at anew.  */
+
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+# include <poll.h>
+
+/* The events that may change a file's modification time or existence.  */
+#define WATCH_MASK      (IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE \
+                         | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* How long to wait, in milliseconds, for more changes after one.  An
+   editor saving a file, or a 'git checkout', causes several.  */
+#define WATCH_SETTLE    100
+
+/* A file name make knows, or a makefile.  */
+
+struct watched
+  {
+    const char *name;           /* The name, in the strcache.  */
+    struct file *file;          /* Its file, or null for a makefile that
+                                   isn't one.  */
+    int makefile;               /* Nonzero if it's in MAKEFILE_LIST.  */
+  };
+
+/* A directory inotify watches.  */
+
+struct watchdir
+  {
+    const char *name;           /* The name, in the strcache.  */
+    int wd;                     /* The watch descriptor, or -1.  */
+  };
+
+static unsigned long
+watched_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (*(const char **) key);
+}
+
+static unsigned long
+watched_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (*(const char **) key);
+}
+
+static int
+watched_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (*(const char **) x, *(const char **) y);
+}
+
+static int watch_fd = -1;
+static struct hash_table watched_table;
+static struct hash_table watchdir_table;
+
+/* The directory of each watch descriptor, indexed by it.  */
+static const char **wd_dirs;
+static unsigned int wd_size;
+
+/* What reading the events found.  */
+#define WATCH_CHANGED   1       /* A file changed that is worth updating
+                                   the goals for.  */
+#define WATCH_MAKEFILE  2       /* A makefile changed.  */
+
+/* Ask inotify to watch the directory DIR.  */
+
+static void
+watch_dir (const char *dir)
+{
+  struct watchdir key;
+  struct watchdir **slot;
+  struct watchdir *wdir;
+
+  key.name = dir;
+  slot = (struct watchdir **) hash_find_slot (&watchdir_table, &key);
+  if (!HASH_VACANT (*slot))
+    return;
+
+  wdir = xmalloc (sizeof (struct watchdir));
+  wdir->name = dir;
+  wdir->wd = inotify_add_watch (watch_fd, dir, WATCH_MASK | IN_ONLYDIR);
+  hash_insert_at (&watchdir_table, wdir, slot);
+
+  if (wdir->wd < 0)
+    {
+      /* A directory that doesn't exist yet holds no file that could
+         change.  */
+      if (errno != ENOENT && errno != ENOTDIR)
+        perror_with_name ("inotify_add_watch: ", dir);
+      return;
+    }
+
+  DB (DB_VERBOSE, (_("Watching directory '%s'.\n"), dir));
+
+  if ((unsigned int) wdir->wd >= wd_size)
+    {
+      unsigned int size = wd_size ? wd_size : 64;
+      while (size <= (unsigned int) wdir->wd)
+        size *= 2;
+      wd_dirs = xrealloc (wd_dirs, size * sizeof (const char *));
+      memset (wd_dirs + wd_size, '\0', (size - wd_size) * sizeof (char *));
+      wd_size = size;
+    }
+  wd_dirs[wdir->wd] = dir;
+}
+
+/* Remember that NAME is the name of the file F, if it isn't null, and of
+   a makefile if MAKEFILE is nonzero, and watch its directory.  */
+
+static void
+watch_name (const char *name, struct file *f, int makefile)
+{
+  struct watched key;
+  struct watched **slot;
+  struct watched *w;
+  const char *slash;
+
+  while (name[0] == '.' && name[1] == '/')
+    {
+      name += 2;
+      while (*name == '/')
+        ++name;
+    }
+  if (*name == '\0')
+    return;
+
+  name = strcache_add (name);
+  key.name = name;
+  slot = (struct watched **) hash_find_slot (&watched_table, &key);
+  if (!HASH_VACANT (*slot))
+    {
+      w = *slot;
+      if (f)
+        w->file = f;
+      w->makefile |= makefile;
+      return;
+    }
+
+  w = xmalloc (sizeof (struct watched));
+  w->name = name;
+  w->file = f;
+  w->makefile = makefile;
+  hash_insert_at (&watched_table, w, slot);
+
+  slash = strrchr (name, '/');
+  if (slash == 0)
+    watch_dir (".");
+  else if (slash == name)
+    watch_dir ("/");
+  else
+    watch_dir (strcache_add_len (name, slash - name));
+}
+
+/* Watch the file at ITEM, under each of its names.  */
+
+static void
+watch_file (const void *item, void *arg UNUSED)
+{
+  struct file *f = (struct file *) item;
+
+  if (f->phony)
+    return;
+#ifndef NO_ARCHIVES
+  /* The archive itself is watched as a file of its own.  */
+  if (ar_name (f->name))
+    return;
+#endif
+
+  watch_name (f->name, f, 0);
+  if (f->hname != f->name)
+    watch_name (f->hname, f, 0);
+}
+
+/* Watch every file in the data base and every makefile read.  New files
+   may have been entered while the goals were updated, so this is done
+   again each time.  */
+
+static void
+watch_all (void)
+{
+  struct variable *v;
+
+  map_files (watch_file, NULL);
+
+  v = lookup_variable (STRING_SIZE_TUPLE ("MAKEFILE_LIST"));
+  if (v && v->value)
+    {
+      const char *p = v->value;
+      const char *name;
+      unsigned int len;
+
+      while ((name = find_next_token (&p, &len)) != 0)
+        {
+          const char *mk = strcache_add_len (name, len);
+          watch_name (mk, lookup_file (mk), 1);
+        }
+    }
+}
+
+/* Forget the modification time of the file at ITEM.  */
+
+static void
+forget_mtime (const void *item, void *arg UNUSED)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    f->last_mtime = UNKNOWN_MTIME;
+}
+
+/* Forget what updating the goals found out about the file at ITEM, other
+   than its modification time.  A time that only says the file was remade
+   has to be looked up again.  */
+
+static void
+reset_file (const void *item, void *arg UNUSED)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      f->updating = 0;
+      f->updated = 0;
+      f->no_diag = 0;
+      f->command_state = cs_not_started;
+      f->update_status = us_none;
+      f->mtime_before_update = UNKNOWN_MTIME;
+      if (f->last_mtime == NEW_MTIME)
+        f->last_mtime = UNKNOWN_MTIME;
+    }
+}
+
+/* Read the events waiting on the inotify descriptor, and forget the
+   modification times of the files they are about.  BUILT is nonzero if
+   they happened while the goals were being updated.  Return a mask of
+   WATCH_CHANGED and WATCH_MAKEFILE.  */
+
+static int
+read_events (int built)
+{
+  union
+    {
+      struct inotify_event ev;
+      char buf[8192];
+    } u;
+  int found = 0;
+
+  while (1)
+    {
+      ssize_t n;
+      char *p;
+
+      EINTRLOOP (n, read (watch_fd, u.buf, sizeof (u.buf)));
+      if (n < 0)
+        {
+          if (errno == EAGAIN)
+            break;
+          pfatal_with_name ("inotify");
+        }
+
+      for (p = u.buf; p < u.buf + n;
+           p += sizeof (struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+          const struct inotify_event *ev = (const struct inotify_event *) p;
+          const char *dir;
+          struct watched key;
+          struct watched *w;
+
+          if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED))
+            {
+              /* Some events were lost, or a directory went away: anything
+                 could have changed.  */
+              DB (DB_VERBOSE, (_("Lost track of changes; checking all files again.\n")));
+              if (ev->mask & IN_IGNORED && (unsigned int) ev->wd < wd_size
+                  && wd_dirs[ev->wd])
+                {
+                  struct watchdir dkey;
+                  dkey.name = wd_dirs[ev->wd];
+                  free (hash_delete (&watchdir_table, &dkey));
+                  wd_dirs[ev->wd] = 0;
+                }
+              map_files (forget_mtime, NULL);
+              found |= WATCH_CHANGED;
+              continue;
+            }
+
+          if (ev->len == 0 || (unsigned int) ev->wd >= wd_size
+              || (dir = wd_dirs[ev->wd]) == 0)
+            continue;
+
+          if (streq (dir, "."))
+            key.name = ev->name;
+          else
+            key.name = concat (3, dir, streq (dir, "/") ? "" : "/", ev->name);
+          w = hash_find_item (&watched_table, &key);
+          if (w == 0)
+            continue;
+
+          if (w->makefile)
+            {
+              DB (DB_BASIC, (_("Makefile '%s' changed.\n"), w->name));
+              found |= WATCH_MAKEFILE;
+            }
+          if (w->file)
+            {
+              struct file *f = w->file;
+
+              check_renamed (f);
+              DB (DB_VERBOSE, (_("File '%s' changed.\n"), w->name));
+              forget_mtime (f, NULL);
+              if (!built || f->cmds == 0)
+                found |= WATCH_CHANGED;
+            }
+        }
+    }
+
+  return found;
+}
+
+/* Wait until a change is found that's worth updating the goals for.  */
+
+static int
+wait_for_change (void)
+{
+  struct pollfd pfd;
+  int found = 0;
+  int timeout = -1;
+
+  pfd.fd = watch_fd;
+  pfd.events = POLLIN;
+
+  /* Once something has changed, keep reading until things settle.  */
+  while (1)
+    {
+      int r;
+
+      EINTRLOOP (r, poll (&pfd, 1, timeout));
+      if (r < 0)
+        pfatal_with_name ("poll");
+      if (r == 0)
+        break;
+
+      found |= read_events (0);
+      if (found)
+        timeout = WATCH_SETTLE;
+    }
+
+  return found;
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Get ready to update the goals again, once something has changed.
+   Return nonzero if a makefile changed, and the makefiles should be read
+   again instead.  */
+
+int
+watch_changes (void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  int found;
+
+  remove_intermediates (0);
+
+  if (watch_fd < 0)
+    {
+      watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+      if (watch_fd < 0)
+        pfatal_with_name ("inotify_init1");
+      hash_init (&watched_table, 1024,
+                 watched_hash_1, watched_hash_2, watched_hash_cmp);
+      hash_init (&watchdir_table, 64,
+                 watched_hash_1, watched_hash_2, watched_hash_cmp);
+    }
+
+  watch_all ();
+  found = read_events (1);
+
+  map_files (reset_file, NULL);
+
+  if (!(found & WATCH_MAKEFILE) && !(found & WATCH_CHANGED))
+    {
+      if (!silent_flag)
+        O (message, 1, _("Watching for changes..."));
+      fflush (stdout);
+      found = wait_for_change ();
+    }
+
+  /* Anything the directory cache knows may be out of date.  */
+  ++file_generation;
+
+  return found & WATCH_MAKEFILE;
+#else
+  return 0;
+#endif
+}
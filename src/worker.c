@@ -0,0 +1,438 @@
+/* Persistent worker processes for GNU Make.
+Copyright (C) 2017 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "os.h"
+#include "job.h"
+#include "variable.h"
+#include "debug.h"
+
+#ifdef MAKE_WORKERS
+
+#include "libfs/libfs.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#ifndef WCOREDUMP
+# define WCOREDUMP(x) ((x) & 0x80)
+#endif
+
+/* A target whose .WORKER variable expands to a non-empty command hands its
+   recipe lines to a long-running worker process instead of forking a new
+   shell for each one.  The worker is started once, by running the .WORKER
+   command with the shell, and is then reused for every line that names the
+   same command.
+
+   The protocol is deliberately trivial so a worker can be written in any
+   language.  The worker's standard input and standard output are connected
+   to make.  For each request make writes the text of the recipe line,
+   terminated by a null byte.  The worker runs it and answers with the exit
+   status as a decimal number followed by a newline.  Anything the worker
+   wants the user to see must go to its standard error, which it shares
+   with make.  When make is finished it closes the connection; the worker
+   should then exit.  */
+
+struct worker
+  {
+    struct worker *next;        /* Link in the chain.  */
+    const char *command;        /* The .WORKER command, in the strcache.  */
+    pid_t pid;                  /* The worker's process ID.  */
+    int fd;                     /* Our end of the worker's socket.  */
+    unsigned int busy:1;        /* Nonzero while running a request.  */
+    unsigned int buflen;        /* Bytes of the current reply read so far.  */
+    char buf[INTSTR_LENGTH + 2];
+  };
+
+static struct worker *workers = 0;
+
+/* Number of workers currently running a request.  */
+static unsigned int workers_busy = 0;
+
+/* Start a new worker process running COMMAND for FILE, with environment
+   ENVP.  Return the new worker, or NULL if it could not be started.  */
+
+static struct worker *
+spawn_worker (const char *command, struct file *file, char **envp)
+{
+  struct worker *w;
+  char **argv;
+  char *cmd;
+  int sv[2];
+  int r;
+  pid_t pid;
+
+  cmd = xstrdup (command);
+  argv = construct_command_argv (cmd, NULL, file, 0, NULL);
+  free (cmd);
+  if (argv == 0)
+    return 0;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      perror_with_name ("socketpair", "");
+      free (argv[0]);
+      free (argv);
+      return 0;
+    }
+
+  /* Neither end may leak into other children: the worker only sees EOF
+     when every copy of our end is closed.  */
+  fd_noinherit (sv[0]);
+  fd_noinherit (sv[1]);
+
+  /* nofs: the worker attaches once and keeps the handoff for its life.  */
+  lfs_handoff_bias_mutex ();
+
+  pid = vfork ();
+  if (pid == 0)
+    {
+      /* We are the child.  */
+      unblock_all_sigs ();
+      EINTRLOOP (r, dup2 (sv[1], FD_STDIN));
+      EINTRLOOP (r, dup2 (sv[1], FD_STDOUT));
+      exec_command (argv, envp);
+    }
+
+  close (sv[1]);
+  free (argv[0]);
+  free (argv);
+
+  if (pid < 0)
+    {
+      perror_with_name ("fork", "");
+      close (sv[0]);
+      return 0;
+    }
+
+#if defined(F_SETSIG) && defined(O_ASYNC) && defined(SIGCHLD)
+  /* Have a reply raise SIGCHLD, just as a dying child would, so that a
+     make sleeping on the jobserver wakes up to collect it.  */
+  if (fcntl (sv[0], F_SETOWN, getpid ()) == 0
+      && fcntl (sv[0], F_SETSIG, SIGCHLD) == 0)
+    {
+      EINTRLOOP (r, fcntl (sv[0], F_GETFL));
+      if (r >= 0)
+        EINTRLOOP (r, fcntl (sv[0], F_SETFL, r | O_ASYNC));
+    }
+#endif
+
+  w = xcalloc (sizeof (struct worker));
+  w->command = command;
+  w->pid = pid;
+  w->fd = sv[0];
+  w->next = workers;
+  workers = w;
+
+  DB (DB_JOBS, (_("Started worker PID %lu for '%s'\n"),
+                (unsigned long) pid, command));
+
+  return w;
+}
+
+/* Forget about worker W and close our end of its socket.  */
+
+static void
+drop_worker (struct worker *w)
+{
+  struct worker **wp;
+
+  for (wp = &workers; *wp != w; wp = &(*wp)->next)
+    ;
+  *wp = w->next;
+
+  if (w->busy)
+    --workers_busy;
+  close (w->fd);
+  free (w);
+}
+
+/* If FILE names a worker, hand the recipe LINE to an idle worker running
+   that command, starting one with environment ENVP if none is idle.
+   Return the worker's process ID if the line was accepted, 0 if FILE does
+   not use a worker, or -1 if no worker could take the line; the caller
+   should then run it normally.  */
+
+pid_t
+start_worker_job (struct file *file, const char *line, char **envp)
+{
+  struct worker *w;
+  const char *command;
+  char *value, *p;
+  size_t len;
+  int save;
+
+  /* Turn off --warn-undefined-variables: most targets have no worker.  */
+  save = warn_undefined_variables_flag;
+  warn_undefined_variables_flag = 0;
+  value = allocated_variable_expand_for_file ("$(.WORKER)", file);
+  warn_undefined_variables_flag = save;
+
+  p = value;
+  while (ISSPACE (*p))
+    ++p;
+  len = strlen (p);
+  while (len > 0 && ISSPACE (p[len - 1]))
+    --len;
+
+  if (len == 0)
+    {
+      free (value);
+      return 0;
+    }
+
+  command = strcache_add_len (p, len);
+  free (value);
+
+  for (w = workers; w != 0; w = w->next)
+    if (!w->busy && w->command == command)
+      break;
+
+  if (w == 0)
+    {
+      w = spawn_worker (command, file, envp);
+      if (w == 0)
+        return -1;
+    }
+
+  /* Send the line including its terminating null.  */
+  len = strlen (line) + 1;
+  while (len > 0)
+    {
+      ssize_t n;
+      EINTRLOOP (n, send (w->fd, line, len, MSG_NOSIGNAL));
+      if (n < 0)
+        {
+          OSS (error, NILF, _("cannot send to worker '%s': %s"),
+               command, strerror (errno));
+          drop_worker (w);
+          return -1;
+        }
+      line += n;
+      len -= n;
+    }
+
+  w->busy = 1;
+  w->buflen = 0;
+  ++workers_busy;
+
+  DB (DB_JOBS, (_("Sent request to worker PID %lu\n"),
+                (unsigned long) w->pid));
+
+  return w->pid;
+}
+
+/* Read what is available of W's reply.  Return nonzero once it is complete
+   (or the worker has gone away), storing the status in *EXIT_CODE_PTR etc.  */
+
+static int
+read_reply (struct worker *w, int *exit_code_ptr, int *exit_sig_ptr,
+            int *coredump_ptr)
+{
+  ssize_t n;
+  char *nl;
+
+  EINTRLOOP (n, read (w->fd, w->buf + w->buflen,
+                      sizeof (w->buf) - 1 - w->buflen));
+  if (n > 0)
+    {
+      w->buflen += n;
+      w->buf[w->buflen] = '\0';
+      nl = strchr (w->buf, '\n');
+      if (nl == 0 && w->buflen < sizeof (w->buf) - 1)
+        return 0;
+
+      *exit_sig_ptr = 0;
+      *coredump_ptr = 0;
+      if (nl != 0 && nl > w->buf)
+        {
+          *nl = '\0';
+          *exit_code_ptr = atoi (w->buf);
+          return 1;
+        }
+
+      OS (error, NILF, _("invalid reply from worker '%s'"), w->command);
+      *exit_code_ptr = 1;
+      return 1;
+    }
+
+  /* The worker closed its end, or died.  Collect its status if we can;
+     otherwise it has already been reaped by reap_children.  */
+  {
+    int status;
+    pid_t pid;
+
+    EINTRLOOP (pid, waitpid (w->pid, &status, WNOHANG));
+    if (pid == w->pid)
+      {
+        /* nofs: add lock reacquire */
+        lfs_reacquire_bias_mutex ();
+        *exit_code_ptr = WEXITSTATUS (status);
+        *exit_sig_ptr = WIFSIGNALED (status) ? WTERMSIG (status) : 0;
+        *coredump_ptr = WCOREDUMP (status);
+        if (*exit_code_ptr == 0 && *exit_sig_ptr == 0)
+          *exit_code_ptr = 1;
+      }
+    else
+      {
+        *exit_code_ptr = 1;
+        *exit_sig_ptr = 0;
+        *coredump_ptr = 0;
+      }
+  }
+
+  OS (error, NILF, _("worker '%s' exited unexpectedly"), w->command);
+  return -1;
+}
+
+/* Check for a worker that has answered its request.  Wait up to TIMEOUT
+   milliseconds for one, or forever if TIMEOUT is negative.  If one has
+   answered, store its status in *EXIT_CODE_PTR, *EXIT_SIG_PTR and
+   *COREDUMP_PTR and return its process ID.  Return 0 if none answered in
+   time, or -1 on error.  */
+
+pid_t
+worker_status (int *exit_code_ptr, int *exit_sig_ptr, int *coredump_ptr,
+               int timeout)
+{
+  struct pollfd *fds;
+  struct worker *w;
+  unsigned int n;
+  int r;
+
+  if (workers_busy == 0)
+    return 0;
+
+  fds = alloca (workers_busy * sizeof (struct pollfd));
+
+  while (1)
+    {
+      n = 0;
+      for (w = workers; w != 0; w = w->next)
+        if (w->busy)
+          {
+            fds[n].fd = w->fd;
+            fds[n].events = POLLIN;
+            fds[n].revents = 0;
+            ++n;
+          }
+
+      EINTRLOOP (r, poll (fds, n, timeout));
+      if (r <= 0)
+        return r;
+
+      n = 0;
+      for (w = workers; w != 0; w = w->next)
+        if (w->busy)
+          {
+            if (fds[n++].revents != 0)
+              {
+                pid_t pid = w->pid;
+
+                r = read_reply (w, exit_code_ptr, exit_sig_ptr, coredump_ptr);
+                if (r < 0)
+                  drop_worker (w);
+                else if (r > 0)
+                  {
+                    w->busy = 0;
+                    --workers_busy;
+                  }
+                if (r != 0)
+                  return pid;
+              }
+          }
+
+      /* Only part of a reply arrived; go back for the rest.  */
+    }
+}
+
+/* Return nonzero if a busy worker's reply would not interrupt a blocking
+   wait for a jobserver token, so the caller must not wait forever.  */
+
+int
+workers_need_polling (void)
+{
+#if defined(F_SETSIG) && defined(O_ASYNC) && defined(SIGCHLD)
+  return 0;
+#else
+  return workers_busy != 0;
+#endif
+}
+
+/* Shut down all the workers: close their input and wait for them.  */
+
+void
+worker_cleanup (void)
+{
+  while (workers)
+    {
+      struct worker *w = workers;
+      int status;
+      pid_t pid;
+
+      workers = w->next;
+      close (w->fd);
+
+      DB (DB_JOBS, (_("Stopping worker PID %lu\n"),
+                    (unsigned long) w->pid));
+
+      EINTRLOOP (pid, waitpid (w->pid, &status, 0));
+      /* nofs: add lock reacquire */
+      if (pid == w->pid)
+        lfs_reacquire_bias_mutex ();
+
+      free (w);
+    }
+
+  workers_busy = 0;
+}
+
+#else /* !MAKE_WORKERS */
+
+pid_t
+start_worker_job (struct file *file UNUSED, const char *line UNUSED,
+                  char **envp UNUSED)
+{
+  return 0;
+}
+
+pid_t
+worker_status (int *exit_code_ptr UNUSED, int *exit_sig_ptr UNUSED,
+               int *coredump_ptr UNUSED, int timeout UNUSED)
+{
+  return 0;
+}
+
+int
+workers_need_polling (void)
+{
+  return 0;
+}
+
+void
+worker_cleanup (void)
+{
+}
+
+#endif /* !MAKE_WORKERS */